@@ -0,0 +1,33 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#version 140
+
+in vec3 v2f_normal;
+in vec3 v2f_light;
+in float v2f_albedo;
+
+out vec4 f_color;
+
+#include "lighting.glsl"
+#include "greyscale.glsl"
+
+const vec3 rock = vec3(0.55, 0.50, 0.45);
+
+void main()
+{
+    vec3 N = normalize(v2f_normal);
+    vec3 L = normalize(v2f_light);
+
+    // ambient and diffuse component (rocks are not glossy)
+    vec3 albedo = v2f_albedo * rock;
+    vec3 color = lambert(N, L, albedo);
+
+    f_color = vec4(display_color(color), 1.0);
+}
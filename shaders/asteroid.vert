@@ -0,0 +1,48 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#version 140
+#extension GL_ARB_explicit_attrib_location : enable
+
+layout (location = 0) in vec4 v_position;
+layout (location = 1) in vec3 v_normal;
+
+// per-instance attributes (see asteroid_belt.hh)
+layout (location = 3) in vec4 i_pos_scale;
+layout (location = 4) in vec4 i_spin_tilt_albedo;
+
+out vec3 v2f_normal;
+out vec3 v2f_light;
+out float v2f_albedo;
+
+uniform mat4 view_matrix;
+uniform mat4 projection_matrix;
+uniform vec4 light_position; //in eye space coordinates already
+
+
+void main()
+{
+    // rotate around the tilted spin axis: first spin around y, then tilt around x
+    float cs = cos(i_spin_tilt_albedo.x), ss = sin(i_spin_tilt_albedo.x);
+    float ct = cos(i_spin_tilt_albedo.y), st = sin(i_spin_tilt_albedo.y);
+    mat3 spin = mat3(cs, 0.0, -ss,   0.0, 1.0, 0.0,   ss, 0.0, cs);
+    mat3 tilt = mat3(1.0, 0.0, 0.0,   0.0, ct, st,   0.0, -st, ct);
+    mat3 rotation = tilt * spin;
+
+    // world position: rotate, scale, and translate
+    vec3 wpos = rotation * v_position.xyz * i_pos_scale.w + i_pos_scale.xyz;
+    vec4 vpos_vertex = view_matrix * vec4(wpos, 1.0);
+
+    // rotations are orthogonal, the view matrix is a rigid motion
+    v2f_normal = mat3(view_matrix) * (rotation * v_normal);
+    v2f_light = vec3(light_position) - vec3(vpos_vertex);
+    v2f_albedo = i_spin_tilt_albedo.z;
+
+    gl_Position = projection_matrix * vpos_vertex;
+}
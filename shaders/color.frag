@@ -13,7 +13,8 @@ in  vec2 v2f_texcoord;
 out vec4 f_color;
 
 uniform sampler2D tex;
-uniform bool greyscale;
+
+#include "greyscale.glsl"
 
 
 void main()
@@ -21,10 +22,5 @@ void main()
     // fetch color (rgb and alpha) from texture
     vec4 color = texture(tex, v2f_texcoord.st);
 
-    // For greyscale mode, convert RGB color to YUV and use only the luminance
-    if (greyscale) color.rgb = vec3(0.299 * color.r
-                                  + 0.587 * color.g
-                                  + 0.114 * color.b);
-
-    f_color = color;
+    f_color = vec4(display_color(color.rgb), color.a);
 }
@@ -18,12 +18,43 @@ out vec4 f_color;
 
 uniform sampler2D day_texture;
 uniform sampler2D night_texture;
-uniform sampler2D cloud_texture;
-uniform sampler2D gloss_texture;
-uniform bool greyscale;
+uniform sampler2D cloud_gloss_texture; // clouds in red, gloss in green
+
+// bump map as virtual texture (see VirtualTexture), if bump_scale > 0
+uniform sampler2D vt_cache;     // page cache
+uniform sampler2D vt_table;     // page table: cache slot and level of every page
+uniform vec3 vt_size;           // width and height of level 0, number of levels
+uniform float vt_cache_pages;   // slots per side of the cache
+uniform float bump_scale;       // height of the bumps in view space
+
+const float VT_PAGE = 128.0;
+const float VT_BORDER = 4.0;
+
+#include "lighting.glsl"
+#include "greyscale.glsl"
 
 const float shininess = 20.0;
-const vec3  sunlight = vec3(1.0, 0.941, 0.898);
+
+
+// sample the virtual texture: the level by the texel footprint (as in
+// vt_feedback.frag), the page at that level or its finest resident
+// ancestor from the page table, bilinear within the page
+float vt_sample(vec2 uv)
+{
+    vec2 texel = uv * vt_size.xy;
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+    int level = int(clamp(floor(lod), 0.0, vt_size.z - 1.0));
+
+    vec2 st = vec2(fract(uv.x), clamp(uv.y, 0.0, 0.99999));
+    vec2 size = max(floor(vt_size.xy / exp2(float(level))), 1.0);
+    vec3 entry = floor(texelFetch(vt_table, ivec2(st * size / VT_PAGE), level).xyz * 255.0 + 0.5);
+
+    vec2 page_size = max(floor(vt_size.xy / exp2(entry.z)), 1.0);
+    vec2 in_page = mod(st * page_size, VT_PAGE);
+    const float stride = VT_PAGE + 2.0 * VT_BORDER;
+    return textureLod(vt_cache, (entry.xy * stride + VT_BORDER + in_page) / (vt_cache_pages * stride), 0.0).r;
+}
 
 void main()
 {
@@ -31,40 +62,41 @@ void main()
     vec3 N = normalize(v2f_normal);
     vec3 L = normalize(v2f_light);
     vec3 V = normalize(v2f_view);
-    vec3 R = reflect(-L, N);
 
-    // colors are RGBs and gloss is a 1-channel grayscale r=g=b
+    // bump mapping from the screen-space derivatives of the height and the
+    // position (no tangent frame needed)
+    if (bump_scale > 0.0) {
+        float height = bump_scale * vt_sample(v2f_texcoord);
+        vec3 dpdx = dFdx(-v2f_view), dpdy = dFdy(-v2f_view);
+        vec3 r1 = cross(dpdy, N), r2 = cross(N, dpdx);
+        float det = dot(dpdx, r1);
+        vec3 gradient = sign(det) * (dFdx(height) * r1 + dFdy(height) * r2);
+        N = normalize(abs(det) * N - gradient);
+    }
+
+    // colors are RGBs, cloudiness and gloss are grayscale values packed
+    // into one texture
     vec3 day_color = texture(day_texture, v2f_texcoord).rgb;
     vec3 night_color = texture(night_texture, v2f_texcoord).rgb;
-    vec3 cloud_color = texture(cloud_texture, v2f_texcoord).rgb;
-    float gloss = texture(gloss_texture, v2f_texcoord).r;
+    vec2 cloud_gloss = texture(cloud_gloss_texture, v2f_texcoord).rg;
+    float cloudiness = cloud_gloss.r;
+    float gloss = cloud_gloss.g;
+    vec3 cloud_color = vec3(cloudiness);
 
     // Step 1: Combine gloss and cloudiness textures to get a grayscale value
     // specifying the amount of specularity ((0, 1).
     // clouds are white (high values) where present, gloss is high over water
     // we want specularity where there's water (high gloss) but no clouds
-    float cloudiness = cloud_color.r;
     float specularity = gloss * (1.0 - cloudiness);
 
     // Step 2: Get a color of the day component by applying Phong lighting model
     // (disregarding the clouds) and day texture.
-    float cos_theta = max(dot(N, L), 0.0);
-    vec3 day_ambient = sunlight * 0.2 * day_color;
-    vec3 day_diffuse = sunlight * day_color * cos_theta;
-    vec3 day_specular = vec3(0.0);
-    if (cos_theta > 0.0) {
-        float cos_alpha = max(dot(R, V), 0.0);
-        day_specular = sunlight * specularity * pow(cos_alpha, shininess);
-    }
-
-    vec3 day_component = day_ambient + day_diffuse + day_specular;
+    vec3 day_component = phong(N, L, V, day_color, vec3(specularity), shininess);
 
     // Step 3: Get the final color of the day component by interpolating between
     // the current day and clouds rendered with Lambertian lighting model;
     // interpolation weight is given by cloudiness.
-    vec3 cloud_ambient = sunlight * 0.2 * cloud_color;
-    vec3 cloud_diffuse = sunlight * cloud_color * cos_theta;
-    vec3 clouds_lambertian = cloud_ambient + cloud_diffuse;
+    vec3 clouds_lambertian = lambert(N, L, cloud_color);
 
     // mix day surface with clouds based on cloudiness
     vec3 day_final = mix(day_component, clouds_lambertian, cloudiness);
@@ -78,13 +110,10 @@ void main()
     // use the diffuse lighting factor (cos_theta) as interpolation weight
     // when sun is up (cos_theta > 0), show day; when sun is down, show night
     // clamp cos_theta to [0,1] range for linear interpolation
+    float cos_theta = dot(N, L);
     float day_night_mix = clamp(cos_theta, 0.0, 1.0);
     vec3 color = mix(night_component, day_final, day_night_mix);
 
-    // convert to grayscale if requested
-    if (greyscale) color = vec3(0.299*color.r + 0.587*color.g + 0.114*color.b);
-
-
-    // final color
-    f_color = vec4(color, 1.0);
+    // final color, grey in the greyscale variant
+    f_color = vec4(display_color(color), 1.0);
 }
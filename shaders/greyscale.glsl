@@ -0,0 +1,19 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+// The color as displayed: in the GREYSCALE variant of a shader the
+// luminance (Y of YUV) of the RGB color, otherwise the color itself.
+vec3 display_color(vec3 color)
+{
+#ifdef GREYSCALE
+    return vec3(0.299 * color.r + 0.587 * color.g + 0.114 * color.b);
+#else
+    return color;
+#endif
+}
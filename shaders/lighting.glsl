@@ -0,0 +1,31 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+const vec3 sunlight = vec3(1.0, 0.941, 0.898);
+
+// ambient and diffuse reflection (Lambert) of the sunlight
+// N and L are the normalized normal and direction to the light
+vec3 lambert(vec3 N, vec3 L, vec3 color)
+{
+    return sunlight * color * (0.2 + max(dot(N, L), 0.0));
+}
+
+// ambient, diffuse and specular reflection (Phong) of the sunlight
+// N, L and V are the normalized normal, direction to the light and to the viewer
+vec3 phong(vec3 N, vec3 L, vec3 V, vec3 diffuse_color, vec3 specular_color, float shininess)
+{
+    vec3 color = 0.2 * diffuse_color;
+    float cos_theta = dot(N, L);
+    if (cos_theta > 0.0) {
+        color += diffuse_color * cos_theta;
+        float cos_alpha = max(dot(reflect(-L, N), V), 0.0);
+        color += specular_color * pow(cos_alpha, shininess);
+    }
+    return sunlight * color;
+}
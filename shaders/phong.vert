@@ -14,14 +14,19 @@ layout (location = 0) in vec4 v_position;
 layout (location = 1) in vec3 v_normal;
 layout (location = 2) in vec2 v_texcoord;
 
+// per-instance attributes (see instance_buffer.hh)
+layout (location = 3)  in mat4  i_model_matrix;
+layout (location = 7)  in mat3  i_normal_matrix;
+layout (location = 10) in float i_layer;
+
 out vec2 v2f_texcoord;
 out vec3 v2f_normal;
 out vec3 v2f_light;
 out vec3 v2f_view;
+flat out float v2f_layer;
 
-uniform mat4 modelview_projection_matrix;
-uniform mat4 modelview_matrix;
-uniform mat3 normal_matrix;
+uniform mat4 view_matrix;
+uniform mat4 projection_matrix;
 uniform vec4 light_position; //in eye space coordinates already
 
 
@@ -37,10 +42,11 @@ void main()
     */
 
     // vertex position in view space
-    vec4 vpos_vertex = modelview_matrix * v_position;
+    vec4 vpos_vertex = view_matrix * (i_model_matrix * v_position);
 
-    // vertex normals in view space
-    v2f_normal = normal_matrix * v_normal;
+    // vertex normals in view space (the view matrix is a rigid motion, so its
+    // upper 3x3 part transforms normals as well)
+    v2f_normal = mat3(view_matrix) * (i_normal_matrix * v_normal);
 
     // light direction (l) in view space
     v2f_light = vec3(light_position) - vec3(vpos_vertex);
@@ -50,7 +56,8 @@ void main()
 
     // texture coords are 2D and remain unchanged
     v2f_texcoord = v_texcoord;
+    v2f_layer = i_layer;
 
     //final position
-    gl_Position = modelview_projection_matrix * v_position;
+    gl_Position = projection_matrix * vpos_vertex;
 }
@@ -0,0 +1,38 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#version 140
+
+// Feedback pass of a virtual texture (see VirtualTexture): writes the page
+// and mip level that vt_sample() in earth.frag reads at each pixel, as
+// (page x, page y, level) / 255 with alpha 1.
+
+in vec2 v2f_texcoord;
+
+out vec4 f_color;
+
+uniform vec3 vt_size;       // width and height of level 0, number of levels
+uniform float vt_lod_bias;  // compensates the lower resolution of the pass
+
+const float VT_PAGE = 128.0;
+
+void main()
+{
+    // same level selection as vt_sample()
+    vec2 texel = v2f_texcoord * vt_size.xy;
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + vt_lod_bias;
+    int level = int(clamp(floor(lod), 0.0, vt_size.z - 1.0));
+
+    vec2 st = vec2(fract(v2f_texcoord.x), clamp(v2f_texcoord.y, 0.0, 0.99999));
+    vec2 size = max(floor(vt_size.xy / exp2(float(level))), 1.0);
+    vec2 page = floor(st * size / VT_PAGE);
+
+    f_color = vec4(page, float(level), 255.0) / 255.0;
+}
@@ -0,0 +1,180 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "allocation_tracker.hh"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#ifdef _WIN32
+#  include <malloc.h>
+#endif
+
+//=============================================================================
+
+namespace {
+
+// constant-initialized, so they are valid before any static constructor runs
+thread_local AllocationCounts thread_counts;
+std::atomic<uint64_t> total_allocations{0};
+std::atomic<uint64_t> total_bytes{0};
+
+inline void count(std::size_t size)
+{
+    ++thread_counts.allocations;
+    thread_counts.bytes += size;
+    total_allocations.fetch_add(1, std::memory_order_relaxed);
+    total_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void* allocate(std::size_t size)
+{
+    count(size);
+    for (;;) {
+        if (void* p = std::malloc(size ? size : 1)) return p;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* allocate_aligned(std::size_t size, std::align_val_t al)
+{
+    count(size);
+    std::size_t align = static_cast<std::size_t>(al);
+    for (;;) {
+#ifdef _WIN32
+        if (void* p = _aligned_malloc(size ? size : 1, align)) return p;
+#else
+        void* p = nullptr;
+        if (posix_memalign(&p, std::max(align, sizeof(void*)), size ? size : 1) == 0) return p;
+#endif
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void deallocate_aligned(void* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+}
+
+
+//=============================================================================
+
+
+AllocationCounts AllocationTracker::thread()
+{
+    return thread_counts;
+}
+
+
+AllocationCounts AllocationTracker::total()
+{
+    AllocationCounts c;
+    c.allocations = total_allocations.load(std::memory_order_relaxed);
+    c.bytes = total_bytes.load(std::memory_order_relaxed);
+    return c;
+}
+
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+/// a "Vm...:  <n> kB" line of /proc/self/status in bytes
+size_t proc_status_bytes(const char* key)
+{
+    size_t kb = 0;
+#ifdef __linux__
+    if (FILE* f = std::fopen("/proc/self/status", "r")) {
+        char line[256];
+        const size_t n = std::strlen(key);
+        while (std::fgets(line, sizeof(line), f)) {
+            if (std::strncmp(line, key, n) == 0 && line[n] == ':') {
+                std::sscanf(line + n + 1, "%zu", &kb);
+                break;
+            }
+        }
+        std::fclose(f);
+    }
+#else
+    (void)key;
+#endif
+    return kb * 1024;
+}
+
+}
+
+
+size_t AllocationTracker::resident_bytes()
+{
+    return proc_status_bytes("VmRSS");
+}
+
+
+size_t AllocationTracker::peak_resident_bytes()
+{
+    return proc_status_bytes("VmHWM");
+}
+
+
+//=============================================================================
+// replacements of the global allocation functions
+
+
+void* operator new  (std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+
+void* operator new  (std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return allocate(size); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return allocate(size); } catch (...) { return nullptr; }
+}
+
+void* operator new  (std::size_t size, std::align_val_t al) { return allocate_aligned(size, al); }
+void* operator new[](std::size_t size, std::align_val_t al) { return allocate_aligned(size, al); }
+
+void* operator new  (std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept
+{
+    try { return allocate_aligned(size, al); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept
+{
+    try { return allocate_aligned(size, al); } catch (...) { return nullptr; }
+}
+
+void operator delete  (void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete  (void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete  (void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+void operator delete  (void* p, std::align_val_t) noexcept { deallocate_aligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { deallocate_aligned(p); }
+void operator delete  (void* p, std::size_t, std::align_val_t) noexcept { deallocate_aligned(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { deallocate_aligned(p); }
+void operator delete  (void* p, std::align_val_t, const std::nothrow_t&) noexcept { deallocate_aligned(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { deallocate_aligned(p); }
+
+
+//=============================================================================
@@ -0,0 +1,65 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include <cstddef>
+#include <cstdint>
+
+//=============================================================================
+
+
+/// number of allocations through the global operator new and their bytes
+struct AllocationCounts
+{
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+inline AllocationCounts operator-(const AllocationCounts& a, const AllocationCounts& b)
+{
+    AllocationCounts d;
+    d.allocations = a.allocations - b.allocations;
+    d.bytes = a.bytes - b.bytes;
+    return d;
+}
+
+
+/// Counters of the replaced global operator new (allocation_tracker.cpp).
+/// Every thread counts its own allocations; the totals over all threads are
+/// kept as well. Allocations that bypass operator new (malloc in C
+/// libraries such as the GL driver) are not counted.
+class AllocationTracker
+{
+public:
+
+    /// allocations of the calling thread since it started
+    static AllocationCounts thread();
+
+    /// allocations of all threads since program start
+    static AllocationCounts total();
+
+    /// current and peak resident set size of the process in bytes (all
+    /// memory, not only operator new; read from /proc on Linux, 0 elsewhere)
+    static size_t resident_bytes();
+    static size_t peak_resident_bytes();
+};
+
+
+/// counts the allocations of the calling thread since its construction
+class AllocationScope
+{
+public:
+    AllocationScope() : start_(AllocationTracker::thread()) {}
+    AllocationCounts counts() const { return AllocationTracker::thread() - start_; }
+private:
+    AllocationCounts start_;
+};
+
+
+//=============================================================================
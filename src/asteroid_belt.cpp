@@ -0,0 +1,392 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "asteroid_belt.hh"
+#include "thread_pool.hh"
+#include <map>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+//=============================================================================
+
+namespace {
+
+/// Radius of the rock surface in direction d. A smooth function of the
+/// direction only, so that all levels of detail describe the same shape.
+float rock_radius(const vec3& d)
+{
+    static const float waves[][5] = {
+        // frequency vector, phase, amplitude
+        { 1.3f,  2.1f, -0.7f, 0.3f, 0.16f},
+        {-2.9f,  0.8f,  1.7f, 1.9f, 0.09f},
+        { 0.6f, -3.8f,  2.4f, 4.2f, 0.07f},
+        { 5.1f,  1.2f, -4.4f, 2.6f, 0.04f},
+    };
+    float r = 1.0f;
+    for (const auto& w : waves)
+        r += w[4] * std::sin(w[0]*d.x + w[1]*d.y + w[2]*d.z + w[3]);
+    return r;
+}
+
+
+/// generate a perturbed icosphere with the given number of subdivisions
+void rock_mesh(int subdivisions, std::vector<vec3>& positions,
+               std::vector<vec3>& normals, std::vector<GLuint>& indices)
+{
+    const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+    positions = {
+        {-1,  t,  0}, { 1,  t,  0}, {-1, -t,  0}, { 1, -t,  0},
+        { 0, -1,  t}, { 0,  1,  t}, { 0, -1, -t}, { 0,  1, -t},
+        { t,  0, -1}, { t,  0,  1}, {-t,  0, -1}, {-t,  0,  1}
+    };
+    indices = {
+        0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+        1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+        3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+        4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1
+    };
+    for (auto& p : positions) p = normalize(p);
+
+    // split every triangle into four, sharing edge midpoints
+    for (int s = 0; s < subdivisions; ++s) {
+        std::map<std::pair<GLuint, GLuint>, GLuint> midpoints;
+        auto midpoint = [&](GLuint a, GLuint b) {
+            auto key = std::make_pair(std::min(a, b), std::max(a, b));
+            auto it = midpoints.find(key);
+            if (it != midpoints.end()) return it->second;
+            positions.push_back(normalize(positions[a] + positions[b]));
+            GLuint m = positions.size() - 1;
+            midpoints[key] = m;
+            return m;
+        };
+
+        std::vector<GLuint> refined;
+        for (size_t f = 0; f < indices.size(); f += 3) {
+            GLuint a = indices[f], b = indices[f+1], c = indices[f+2];
+            GLuint ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            refined.insert(refined.end(), { a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca });
+        }
+        indices.swap(refined);
+    }
+
+    // displace the unit sphere into a rock
+    for (auto& p : positions) p = rock_radius(p) * p;
+
+    // area-weighted vertex normals
+    normals.assign(positions.size(), vec3(0, 0, 0));
+    for (size_t f = 0; f < indices.size(); f += 3) {
+        vec3 n = cross(positions[indices[f+1]] - positions[indices[f]],
+                       positions[indices[f+2]] - positions[indices[f]]);
+        for (int k = 0; k < 3; ++k) normals[indices[f+k]] += n;
+    }
+    for (auto& n : normals) n = normalize(n);
+}
+
+
+/// Advance the mean anomalies and spin angles of [begin, end). Both are
+/// non-negative, so truncation wraps them to [0, 2pi) without a branch and
+/// the loop is vectorized by the compiler.
+void advance_angles(size_t begin, size_t end, float days,
+                    float* __restrict M, float* __restrict spin,
+                    const float* __restrict mean_motion, const float* __restrict spin_rate)
+{
+    const float two_pi = 2.0f * (float)M_PI, inv_two_pi = 1.0f / two_pi;
+
+    for (size_t i = begin; i < end; ++i) {
+        float m = M[i] + mean_motion[i] * days;
+        M[i] = m - two_pi * float(int(m * inv_two_pi));
+
+        float sp = spin[i] + spin_rate[i] * days;
+        spin[i] = sp - two_pi * float(int(sp * inv_two_pi));
+    }
+}
+
+}
+
+
+//=============================================================================
+
+
+AsteroidBelt::AsteroidBelt(float inner_radius, float outer_radius)
+    : inner_radius_(inner_radius), outer_radius_(outer_radius)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+AsteroidBelt::~AsteroidBelt()
+{
+    for (int l = 0; l < LODS; ++l) {
+        if (vbo_[l])          glDeleteBuffers(1, &vbo_[l]);
+        if (nbo_[l])          glDeleteBuffers(1, &nbo_[l]);
+        if (ibo_[l])          glDeleteBuffers(1, &ibo_[l]);
+        if (instance_vbo_[l]) glDeleteBuffers(1, &instance_vbo_[l]);
+        if (vao_[l])          glDeleteVertexArrays(1, &vao_[l]);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void AsteroidBelt::resize(size_t n)
+{
+    n = std::min(n, MAX_ROCKS);
+
+    orbits_.resize(n);
+    const size_t padded = orbits_.padded_size();
+    for (auto* v : { &mean_motion_, &spin_, &spin_rate_, &x_, &y_, &z_ })
+        v->assign(padded, 0.0f);
+    for (auto* v : { &scale_, &tilt_, &albedo_ })
+        v->resize(n);
+    std::fill(visible_, visible_ + LODS, 0); // nothing binned until the next cull()
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+
+    for (size_t i = 0; i < n; ++i) {
+        KeplerElements el;
+
+        // semi-major axis: denser in the middle of the belt
+        float u = std::min(1.0f, std::max(0.0f, 0.5f + 0.2f * gauss(rng)));
+        el.a = inner_radius_ + u * (outer_radius_ - inner_radius_);
+
+        // Rayleigh distributed eccentricities (mode 0.07) and small
+        // inclinations, like the main belt
+        el.e    = std::min(0.3f, 0.07f * std::sqrt(-2.0f * std::log(1.0f - uniform(rng))));
+        el.i    = 0.05f * gauss(rng);
+        el.node = 2.0f * (float)M_PI * uniform(rng);
+        el.peri = 2.0f * (float)M_PI * uniform(rng);
+        el.M    = 2.0f * (float)M_PI * uniform(rng);
+        orbits_.set(i, el);
+
+        // Kepler's third law, calibrated to the earth (distance 3.3, one year)
+        mean_motion_[i] = 2.0f * (float)M_PI / 365.0f * std::pow(el.a / 3.3f, -1.5f);
+
+        spin_[i]      = 2.0f * (float)M_PI * uniform(rng);
+        spin_rate_[i] = 2.0f * (float)M_PI * (0.2f + 2.0f * uniform(rng));
+        tilt_[i]      = (float)M_PI * uniform(rng);
+        scale_[i]     = 0.002f + 0.006f * std::pow(uniform(rng), 3.0f);
+        albedo_[i]    = 0.5f + 0.5f * uniform(rng);
+    }
+
+    time_step(0.0f);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void AsteroidBelt::time_step(float days)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // advance the orbits in parallel chunks of whole lane groups
+    const size_t lanes  = KeplerOrbits::LANES;
+    const size_t groups = orbits_.padded_size() / lanes;
+    ThreadPool::instance().parallel_for(groups, 512, [&](size_t g0, size_t g1) {
+        size_t begin = g0 * lanes, end = g1 * lanes;
+        advance_angles(begin, end, days, orbits_.mean_anomaly(), spin_.data(),
+                       mean_motion_.data(), spin_rate_.data());
+        if (kepler_) orbits_.positions(begin, end, x_.data(), y_.data(), z_.data());
+    });
+
+    stats_.update_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void AsteroidBelt::velocities(std::vector<float>& vx, std::vector<float>& vy, std::vector<float>& vz) const
+{
+    const size_t padded = orbits_.padded_size();
+    vx.resize(padded);
+    vy.resize(padded);
+    vz.resize(padded);
+    orbits_.velocities(0, size(), mean_motion_.data(), vx.data(), vy.data(), vz.data());
+    vx.resize(size());
+    vy.resize(size());
+    vz.resize(size());
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void AsteroidBelt::set_positions(const float* x, const float* y, const float* z)
+{
+    kepler_ = !x;
+    if (kepler_) {
+        orbits_.positions(0, size(), x_.data(), y_.data(), z_.data());
+        return;
+    }
+    std::copy(x, x + size(), x_.begin());
+    std::copy(y, y + size(), y_.begin());
+    std::copy(z, z + size(), z_.begin());
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void AsteroidBelt::initialize()
+{
+    for (int l = 0; l < LODS; ++l) {
+        std::vector<vec3> positions, normals;
+        std::vector<GLuint> indices;
+        rock_mesh(LODS - 1 - l, positions, normals, indices);
+        n_indices_[l] = indices.size();
+
+        // generate vertex array object
+        glGenVertexArrays(1, &vao_[l]);
+        glBindVertexArray(vao_[l]);
+
+        // vertex positions -> attribute 0
+        glGenBuffers(1, &vbo_[l]);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo_[l]);
+        glBufferData(GL_ARRAY_BUFFER, positions.size()*sizeof(vec3), positions[0].data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(0);
+
+        // normal vectors -> attribute 1
+        glGenBuffers(1, &nbo_[l]);
+        glBindBuffer(GL_ARRAY_BUFFER, nbo_[l]);
+        glBufferData(GL_ARRAY_BUFFER, normals.size()*sizeof(vec3), normals[0].data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(1);
+
+        // per-instance data -> attributes 3 and 4
+        glGenBuffers(1, &instance_vbo_[l]);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo_[l]);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(RockInstance), (const void*)offsetof(RockInstance, pos_scale));
+        glVertexAttribDivisor(3, 1);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(RockInstance), (const void*)offsetof(RockInstance, spin_tilt_albedo));
+        glVertexAttribDivisor(4, 1);
+        glEnableVertexAttribArray(4);
+
+        // triangle indices
+        glGenBuffers(1, &ibo_[l]);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_[l]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+
+        glBindVertexArray(0);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void AsteroidBelt::cull(const vec3& eye, FrameArena& arena)
+{
+    auto start = std::chrono::steady_clock::now();
+    const size_t n = size();
+
+    // Bin the rocks by LOD in two parallel passes over fixed blocks: count per
+    // block, then scatter to the prefix-summed offsets. Projected size is
+    // radius / distance; thresholds correspond to roughly 20 and 4 pixels.
+    ThreadPool& pool = ThreadPool::instance();
+    const size_t n_blocks = std::min<size_t>(4 * pool.concurrency(), std::max<size_t>(1, n / 4096));
+    const size_t block = (n + n_blocks - 1) / n_blocks;
+    size_t* counts = arena.allocate_array<size_t>(n_blocks * LODS);
+    uint8_t* lod_of = arena.allocate_array<uint8_t>(n);
+    std::fill(counts, counts + n_blocks * LODS, 0);
+
+    pool.parallel_for(n_blocks, 1, [&](size_t b0, size_t b1) {
+        for (size_t b = b0; b < b1; ++b) {
+            size_t* count = &counts[b * LODS];
+            for (size_t i = b * block, end = std::min(n, (b + 1) * block); i < end; ++i) {
+                float dx = x_[i] - eye.x, dy = y_[i] - eye.y, dz = z_[i] - eye.z;
+                float size2 = scale_[i] * scale_[i];
+                float dist2 = dx * dx + dy * dy + dz * dz;
+                uint8_t lod = (size2 > 0.034f * 0.034f * dist2) ? 0 :
+                              (size2 > 0.007f * 0.007f * dist2) ? 1 : 2;
+                lod_of[i] = lod;
+                ++count[lod];
+            }
+        }
+    });
+
+    size_t* total = visible_;
+    std::fill(total, total + LODS, 0);
+    for (size_t b = 0; b < n_blocks; ++b) {
+        for (int l = 0; l < LODS; ++l) {
+            size_t c = counts[b * LODS + l];
+            counts[b * LODS + l] = total[l];
+            total[l] += c;
+        }
+    }
+
+    // all LODs share one array of the frame arena
+    RockInstance* instances = arena.allocate_array<RockInstance>(std::max<size_t>(n, 1));
+    for (int l = 0; l < LODS; ++l) {
+        instances_[l] = instances;
+        instances += total[l];
+    }
+
+    pool.parallel_for(n_blocks, 1, [&](size_t b0, size_t b1) {
+        for (size_t b = b0; b < b1; ++b) {
+            size_t* offset = &counts[b * LODS];
+            for (size_t i = b * block, end = std::min(n, (b + 1) * block); i < end; ++i) {
+                RockInstance& r = instances_[lod_of[i]][offset[lod_of[i]]++];
+                r.pos_scale[0] = x_[i];
+                r.pos_scale[1] = y_[i];
+                r.pos_scale[2] = z_[i];
+                r.pos_scale[3] = scale_[i];
+                r.spin_tilt_albedo[0] = spin_[i];
+                r.spin_tilt_albedo[1] = tilt_[i];
+                r.spin_tilt_albedo[2] = albedo_[i];
+                r.spin_tilt_albedo[3] = 0.0f;
+            }
+        }
+    });
+
+    stats_.cull_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void AsteroidBelt::draw()
+{
+    if (n_indices_[0] == 0) initialize();
+
+    auto start = std::chrono::steady_clock::now();
+    const size_t* total = visible_;
+
+    // upload (orphaning the previous frame's storage) and draw
+    for (int l = 0; l < LODS; ++l) {
+        stats_.drawn[l] += total[l];
+        if (total[l] == 0) continue;
+
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo_[l]);
+        glBufferData(GL_ARRAY_BUFFER, total[l] * sizeof(RockInstance), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, total[l] * sizeof(RockInstance), instances_[l]);
+
+        glBindVertexArray(vao_[l]);
+        glDrawElementsInstanced(GL_TRIANGLES, n_indices_[l], GL_UNSIGNED_INT, NULL, total[l]);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    ++stats_.frames;
+    stats_.draw_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+//=============================================================================
@@ -0,0 +1,139 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "gl.hh"
+#include "glmath.hh"
+#include "kepler.hh"
+#include "frame_arena.hh"
+#include <vector>
+#include <cstdint>
+
+//=============================================================================
+
+/// per-instance data of a rock (tightly packed, uploaded as is)
+struct RockInstance
+{
+    /// world position (xyz) and radius (w) -> attribute 3
+    float pos_scale[4];
+    /// spin angle, tilt angle (radians), albedo, unused -> attribute 4
+    float spin_tilt_albedo[4];
+};
+
+
+/// Procedural asteroid belt: N rocks on eccentric Keplerian orbits, stored as
+/// structure of arrays and evaluated by the vectorized Kepler solver on the
+/// thread pool. Rocks are rendered as instanced
+/// low-poly meshes (perturbed icospheres) with a level of detail per instance.
+class AsteroidBelt
+{
+public:
+
+    /// number of mesh levels of detail (icosphere subdivisions 0..LODS-1,
+    /// level 0 being the most detailed one)
+    static const int LODS = 3;
+
+    /// largest number of rocks the belt supports
+    static constexpr size_t MAX_ROCKS = 1 << 20;
+
+    /// constructor
+    /// \param inner_radius the smallest orbit radius of the belt
+    /// \param outer_radius the largest orbit radius of the belt
+    AsteroidBelt(float inner_radius, float outer_radius);
+
+    /// destructor
+    ~AsteroidBelt();
+
+    AsteroidBelt(const AsteroidBelt&) = delete;
+    AsteroidBelt& operator=(const AsteroidBelt&) = delete;
+
+    /// (re-)generate the belt with \c n rocks (deterministic for a given n)
+    void resize(size_t n);
+
+    /// number of rocks
+    size_t size() const { return orbits_.size(); }
+
+    /// advance all rocks along their orbits by the given time (in days)
+    void time_step(float days);
+
+    /// position of rock i
+    vec3 position(size_t i) const { return vec3(x_[i], y_[i], z_[i]); }
+
+    /// orbital velocities of all rocks (in units per day)
+    void velocities(std::vector<float>& vx, std::vector<float>& vy, std::vector<float>& vz) const;
+
+    /// Place the rocks at externally simulated positions (e.g. of an N-body
+    /// system) instead of on their Kepler orbits until called with nullptr;
+    /// time_step() then only spins the rocks.
+    void set_positions(const float* x, const float* y, const float* z);
+
+    /// choose a LOD per rock for the given eye position and bin the rocks'
+    /// instances by LOD (CPU only) into memory of the frame arena
+    void cull(const vec3& eye, FrameArena& arena);
+
+    /// upload the instances binned by the last cull(), which has to be from
+    /// the current frame of the arena, and render each LOD
+    /// mesh with one instanced draw call; the caller has to set up the
+    /// shader (view/projection matrices, light)
+    void draw();
+
+    /// accumulated CPU timings since the last reset_stats()
+    struct Stats {
+        unsigned frames = 0;
+        double update_seconds = 0.0;
+        double cull_seconds = 0.0;
+        double draw_seconds = 0.0;
+        size_t drawn[LODS] = {};
+    };
+    const Stats& stats() const { return stats_; }
+    void reset_stats() { stats_ = Stats(); }
+
+private:
+
+    /// generate the rock meshes and OpenGL buffers
+    void initialize();
+
+private:
+
+    /// belt extent
+    float inner_radius_, outer_radius_;
+
+    // --- per-rock state (structure of arrays) -------------------------------
+
+    /// orbital elements
+    KeplerOrbits orbits_;
+    /// mean motion (radians per day)
+    std::vector<float> mean_motion_;
+    /// rotation around the rock's own axis and its speed (radians per day)
+    std::vector<float> spin_, spin_rate_;
+    /// rock radius, axis tilt, and albedo
+    std::vector<float> scale_, tilt_, albedo_;
+    /// current position (padded like the orbits)
+    std::vector<float> x_, y_, z_;
+    /// whether the positions follow the Kepler orbits
+    bool kepler_ = true;
+
+    // --- rendering ----------------------------------------------------------
+
+    /// instances of the current frame per LOD (in the frame arena)
+    RockInstance* instances_[LODS] = {};
+    /// number of instances per LOD binned by the last cull()
+    size_t visible_[LODS] = {};
+
+    /// mesh and instance buffers per LOD
+    GLuint vao_[LODS] = {};
+    GLuint vbo_[LODS] = {};
+    GLuint nbo_[LODS] = {};
+    GLuint ibo_[LODS] = {};
+    GLuint instance_vbo_[LODS] = {};
+    unsigned int n_indices_[LODS] = {};
+
+    /// timings
+    Stats stats_;
+};
@@ -0,0 +1,366 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "baked_texture.hh"
+#include "thread_pool.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+//=============================================================================
+
+namespace {
+
+/// sRGB transfer functions
+float srgb_to_linear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float linear_to_srgb(float c)
+{
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+/// zeroth order modified Bessel function of the first kind
+double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < 1e-12 * sum) break;
+    }
+    return sum;
+}
+
+/// Kaiser-windowed sinc with the given radius (in destination pixels)
+double kaiser_sinc(double x, double radius, double alpha)
+{
+    if (std::fabs(x) >= radius) return 0.0;
+    double sinc = (x == 0.0) ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+    double r = x / radius;
+    return sinc * bessel_i0(alpha * std::sqrt(1.0 - r * r)) / bessel_i0(alpha);
+}
+
+/// Filter taps for resampling one dimension from src to dst pixels: for
+/// every destination pixel a range of (source index, weight) pairs.
+struct Kernel
+{
+    std::vector<unsigned> first, count;
+    std::vector<unsigned> index;
+    std::vector<float> weight;
+
+    Kernel(unsigned src, unsigned dst, bool wrap)
+    {
+        const double radius = 3.0, alpha = 4.0;
+        const double scale = double(src) / dst;
+        first.resize(dst);
+        count.resize(dst);
+        for (unsigned int i = 0; i < dst; ++i) {
+            // pixel centers; the filter is stretched over scale source pixels
+            double center = (i + 0.5) * scale - 0.5;
+            int lo = int(std::floor(center - radius * scale)) + 1;
+            int hi = int(std::ceil(center + radius * scale)) - 1;
+
+            first[i] = index.size();
+            double sum = 0.0;
+            for (int j = lo; j <= hi; ++j) {
+                double w = kaiser_sinc((j - center) / scale, radius, alpha);
+                if (w == 0.0) continue;
+                int k = wrap ? ((j % int(src)) + int(src)) % int(src)
+                             : std::min(std::max(j, 0), int(src) - 1);
+                index.push_back(k);
+                weight.push_back(float(w));
+                sum += w;
+            }
+            count[i] = index.size() - first[i];
+            for (unsigned int t = first[i]; t < index.size(); ++t)
+                weight[t] = float(weight[t] / sum);
+        }
+    }
+};
+
+/// Resample an RGBA level to half its size (rounded down, at least 1) in
+/// linear light: vertical taps into a row of floats, then horizontal taps.
+void downsample_level(const std::vector<uint8_t>& src, unsigned sw, unsigned sh,
+                      std::vector<uint8_t>& dst, unsigned dw, unsigned dh,
+                      const float* to_linear, const std::vector<uint8_t>& to_srgb, bool srgb)
+{
+    const Kernel kx(sw, dw, true), ky(sh, dh, false);
+    const size_t to_srgb_max = to_srgb.size() - 1;
+    dst.resize(size_t(dw) * dh * 4);
+
+    ThreadPool::instance().parallel_for(dh, 4, [&](size_t begin, size_t end) {
+        std::vector<float> column(size_t(sw) * 4);
+        for (size_t y = begin; y < end; ++y) {
+            // vertical pass over the full source row width
+            std::fill(column.begin(), column.end(), 0.0f);
+            for (unsigned int t = ky.first[y]; t < ky.first[y] + ky.count[y]; ++t) {
+                const uint8_t* row = &src[size_t(ky.index[t]) * sw * 4];
+                const float w = ky.weight[t];
+                for (size_t x = 0; x < size_t(sw) * 4; x += 4) {
+                    column[x + 0] += w * to_linear[row[x + 0]];
+                    column[x + 1] += w * to_linear[row[x + 1]];
+                    column[x + 2] += w * to_linear[row[x + 2]];
+                    column[x + 3] += w * row[x + 3] * (1.0f / 255.0f);
+                }
+            }
+
+            // horizontal pass, back to 8 bits
+            uint8_t* out = &dst[y * dw * 4];
+            for (unsigned int x = 0; x < dw; ++x) {
+                float rgba[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                for (unsigned int t = kx.first[x]; t < kx.first[x] + kx.count[x]; ++t) {
+                    const float* c = &column[size_t(kx.index[t]) * 4];
+                    const float w = kx.weight[t];
+                    for (int i = 0; i < 4; ++i) rgba[i] += w * c[i];
+                }
+                for (int i = 0; i < 4; ++i) {
+                    float v = std::min(std::max(rgba[i], 0.0f), 1.0f);
+                    out[x * 4 + i] = (srgb && i < 3) ? to_srgb[size_t(v * to_srgb_max + 0.5f)]
+                                                     : uint8_t(v * 255.0f + 0.5f);
+                }
+            }
+        }
+    });
+}
+
+}
+
+
+//=============================================================================
+
+
+bool BakedTexture::open(const std::string& filename)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) { CloseHandle(file); return false; }
+    data_ = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    file_ = file;
+    mapping_ = mapping;
+    size_ = size_t(size.QuadPart);
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            data_ = (const uint8_t*)data;
+            size_ = st.st_size;
+        }
+    }
+    ::close(fd);
+#endif
+    if (!data_) {
+        close();
+        return false;
+    }
+
+    // validate the header and the level index against the file size
+    const BakedTextureHeader& h = header();
+    bool ok = size_ >= sizeof(BakedTextureHeader)
+           && std::memcmp(h.identifier, BAKED_TEXTURE_IDENTIFIER, sizeof(h.identifier)) == 0
+           && h.version == BAKED_TEXTURE_VERSION
+           && h.width > 0 && h.height > 0 && h.levels > 0 && h.levels <= 32
+           && size_ >= sizeof(BakedTextureHeader) + h.levels * sizeof(BakedLevel);
+    for (unsigned int l = 0; ok && l < h.levels; ++l)
+        ok = index()[l].offset <= size_ && index()[l].size <= size_ - index()[l].offset;
+    if (!ok) close();
+    return ok;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void BakedTexture::close()
+{
+#ifdef _WIN32
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_) CloseHandle(file_);
+    file_ = mapping_ = nullptr;
+#else
+    if (data_) munmap((void*)data_, size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+
+//=============================================================================
+
+
+void bake_mip_chain(const std::vector<uint8_t>& img, unsigned width, unsigned height, bool srgb,
+                    std::vector<std::vector<uint8_t>>& levels)
+{
+    // full chain down to 1x1
+    unsigned n = 1;
+    while ((std::max(width, height) >> n) > 0) ++n;
+    levels.resize(n);
+
+    // level 0: the image in OpenGL's row order
+    const size_t row_bytes = size_t(width) * 4;
+    levels[0].resize(row_bytes * height);
+    for (unsigned int y = 0; y < height; ++y)
+        std::memcpy(&levels[0][y * row_bytes], &img[(height - 1 - y) * row_bytes], row_bytes);
+
+    // decoding table for 8 bit values, and a fine encoding table so that
+    // dark values keep their precision
+    float to_linear[256];
+    for (int i = 0; i < 256; ++i)
+        to_linear[i] = srgb ? srgb_to_linear(i / 255.0f) : i / 255.0f;
+    std::vector<uint8_t> to_srgb(1 << 16);
+    for (size_t i = 0; i < to_srgb.size(); ++i)
+        to_srgb[i] = uint8_t(linear_to_srgb(float(i) / (to_srgb.size() - 1)) * 255.0f + 0.5f);
+
+    for (unsigned int l = 1; l < n; ++l) {
+        unsigned sw = std::max(1u, width >> (l - 1)), sh = std::max(1u, height >> (l - 1));
+        unsigned dw = std::max(1u, width >> l),       dh = std::max(1u, height >> l);
+        downsample_level(levels[l - 1], sw, sh, levels[l], dw, dh, to_linear, to_srgb, srgb);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void pack_channels(const std::vector<std::vector<uint8_t>>& images,
+                   const std::vector<unsigned>& widths, const std::vector<unsigned>& heights,
+                   std::vector<uint8_t>& packed, unsigned& width, unsigned& height)
+{
+    assert(images.size() <= 4 && widths.size() == images.size() && heights.size() == images.size());
+    width  = *std::max_element(widths.begin(), widths.end());
+    height = *std::max_element(heights.begin(), heights.end());
+    packed.assign(size_t(width) * height * 4, 0);
+
+    ThreadPool::instance().parallel_for(height, 16, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            uint8_t* out = &packed[y * width * 4];
+            for (unsigned int x = 0; x < width; ++x) out[x * 4 + 3] = 255;
+
+            for (size_t c = 0; c < images.size(); ++c) {
+                const std::vector<uint8_t>& src = images[c];
+                const unsigned sw = widths[c], sh = heights[c];
+                if (sw == width && sh == height) {
+                    const uint8_t* row = &src[y * sw * 4];
+                    for (unsigned int x = 0; x < width; ++x) out[x * 4 + c] = row[x * 4];
+                    continue;
+                }
+
+                // bilinear at pixel centers
+                float sy = std::min(std::max((y + 0.5f) * sh / height - 0.5f, 0.0f), float(sh - 1));
+                unsigned y0 = unsigned(sy), y1 = std::min(y0 + 1, sh - 1);
+                float ty = sy - y0;
+                const uint8_t* row0 = &src[size_t(y0) * sw * 4];
+                const uint8_t* row1 = &src[size_t(y1) * sw * 4];
+                for (unsigned int x = 0; x < width; ++x) {
+                    float sx = (x + 0.5f) * sw / width - 0.5f;
+                    if (sx < 0.0f) sx += sw;
+                    unsigned x0 = unsigned(sx) % sw, x1 = (x0 + 1) % sw;
+                    float tx = sx - std::floor(sx);
+                    float top = (1 - tx) * row0[x0 * 4] + tx * row0[x1 * 4];
+                    float bot = (1 - tx) * row1[x0 * 4] + tx * row1[x1 * 4];
+                    out[x * 4 + c] = uint8_t((1 - ty) * top + ty * bot + 0.5f);
+                }
+            }
+        }
+    });
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void cut_pages(const std::vector<uint8_t>& level, unsigned width, unsigned height,
+               std::vector<uint8_t>& pages)
+{
+    const unsigned pages_x = baked_pages(width), pages_y = baked_pages(height);
+    const size_t page_row_bytes = size_t(BAKED_PAGE_STRIDE) * 4;
+    pages.resize(size_t(pages_x) * pages_y * BAKED_PAGE_STRIDE * page_row_bytes);
+
+    ThreadPool::instance().parallel_for(size_t(pages_x) * pages_y, 1, [&](size_t begin, size_t end) {
+        for (size_t page = begin; page < end; ++page) {
+            const int x0 = int(page % pages_x) * BAKED_PAGE_SIZE - BAKED_PAGE_BORDER;
+            const int y0 = int(page / pages_x) * BAKED_PAGE_SIZE - BAKED_PAGE_BORDER;
+            uint8_t* out = &pages[page * BAKED_PAGE_STRIDE * page_row_bytes];
+            for (unsigned int y = 0; y < BAKED_PAGE_STRIDE; ++y) {
+                int sy = std::min(std::max(y0 + int(y), 0), int(height) - 1);
+                const uint8_t* row = &level[size_t(sy) * width * 4];
+                for (unsigned int x = 0; x < BAKED_PAGE_STRIDE; ++x) {
+                    int sx = ((x0 + int(x)) % int(width) + int(width)) % int(width);
+                    std::memcpy(out + y * page_row_bytes + x * 4, row + sx * 4, 4);
+                }
+            }
+        }
+    });
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool write_baked_texture(const std::string& filename, BakedFormat format, uint32_t flags,
+                         unsigned width, unsigned height,
+                         const std::vector<std::vector<uint8_t>>& levels)
+{
+    BakedTextureHeader header;
+    std::memcpy(header.identifier, BAKED_TEXTURE_IDENTIFIER, sizeof(header.identifier));
+    header.version = BAKED_TEXTURE_VERSION;
+    header.format  = format;
+    header.flags   = flags;
+    header.width   = width;
+    header.height  = height;
+    header.levels  = levels.size();
+
+    // levels follow the index, each aligned to 16 bytes
+    auto align = [](uint64_t offset) { return (offset + 15) & ~uint64_t(15); };
+    std::vector<BakedLevel> index(levels.size());
+    uint64_t offset = align(sizeof(header) + index.size() * sizeof(BakedLevel));
+    for (size_t l = 0; l < levels.size(); ++l) {
+        index[l].offset = offset;
+        index[l].size   = levels[l].size();
+        offset = align(offset + levels[l].size());
+    }
+
+    std::ofstream ofs(filename, std::ios::binary);
+    ofs.write((const char*)&header, sizeof(header));
+    ofs.write((const char*)index.data(), index.size() * sizeof(BakedLevel));
+    const char padding[16] = {};
+    for (size_t l = 0; l < levels.size(); ++l) {
+        ofs.write(padding, index[l].offset - uint64_t(ofs.tellp()));
+        ofs.write((const char*)levels[l].data(), levels[l].size());
+    }
+    return bool(ofs);
+}
+
+
+//=============================================================================
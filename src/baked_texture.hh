@@ -0,0 +1,189 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//=============================================================================
+
+
+/// Texel formats of a baked texture
+enum BakedFormat : uint32_t {
+    BAKED_RGBA8 = 1,   ///< 8 bit RGBA, rows bottom to top
+    BAKED_BC1   = 2,   ///< S3TC DXT1 blocks, opaque RGB (4 bits per texel)
+    BAKED_BC3   = 3,   ///< S3TC DXT5 blocks, RGBA (8 bits per texel)
+    BAKED_BC4   = 4,   ///< RGTC1 blocks, single channel (4 bits per texel)
+    BAKED_BC5   = 5,   ///< RGTC2 blocks, two channels (8 bits per texel)
+};
+
+/// width and height of the blocks of a format (1 for uncompressed texels)
+inline unsigned baked_block_size(uint32_t format) { return format == BAKED_RGBA8 ? 1 : 4; }
+
+/// bytes per block (or texel) of a format
+inline unsigned baked_block_bytes(uint32_t format)
+{
+    switch (format) {
+        case BAKED_BC1: case BAKED_BC4: return 8;
+        case BAKED_BC3: case BAKED_BC5: return 16;
+        default:                        return 4;
+    }
+}
+
+/// bytes of a row of blocks (or texels) of an image of the given width
+inline size_t baked_row_bytes(uint32_t format, unsigned width)
+{
+    const unsigned b = baked_block_size(format);
+    return size_t((width + b - 1) / b) * baked_block_bytes(format);
+}
+
+/// Flags of a baked texture
+enum BakedFlags : uint32_t {
+    BAKED_SRGB  = 1,   ///< color channels are sRGB encoded (mip levels were filtered in linear light)
+    BAKED_PAGED = 2,   ///< levels are cut into pages for virtual texturing (see cut_pages())
+};
+
+/// Pages of a paged baked texture: BAKED_PAGE_SIZE^2 texels of a level plus
+/// a border of BAKED_PAGE_BORDER texels on each side, so that a page can be
+/// filtered on its own; BAKED_PAGE_STRIDE is the resulting side length (a
+/// multiple of the block size).
+static const unsigned BAKED_PAGE_SIZE   = 128;
+static const unsigned BAKED_PAGE_BORDER = 4;
+static const unsigned BAKED_PAGE_STRIDE = BAKED_PAGE_SIZE + 2 * BAKED_PAGE_BORDER;
+
+/// number of pages along a side of the given number of texels
+inline unsigned baked_pages(unsigned texels) { return (texels + BAKED_PAGE_SIZE - 1) / BAKED_PAGE_SIZE; }
+
+/// bytes of a page in a format
+inline size_t baked_page_bytes(uint32_t format)
+{
+    return baked_row_bytes(format, BAKED_PAGE_STRIDE) * (BAKED_PAGE_STRIDE / baked_block_size(format));
+}
+
+
+/// On-disk layout of a baked texture, modeled after KTX2: a fixed header, an
+/// index of the mip levels (largest first) and the level data, each level
+/// starting at a multiple of 16 bytes. Everything is little endian and
+/// naturally aligned, so that a memory mapped file can be used in place.
+struct BakedTextureHeader {
+    /// BAKED_TEXTURE_IDENTIFIER
+    char identifier[8];
+    uint32_t version;
+    /// BakedFormat of all levels
+    uint32_t format;
+    /// BakedFlags
+    uint32_t flags;
+    /// size of level 0
+    uint32_t width, height;
+    /// number of mip levels
+    uint32_t levels;
+};
+
+/// entry of the level index following the header
+struct BakedLevel {
+    uint64_t offset, size;
+};
+
+/// magic bytes and version at the start of a baked texture
+static const char BAKED_TEXTURE_IDENTIFIER[8] = { '\xAB', 'S', 'T', 'X', '1', '\xBB', '\r', '\n' };
+static const uint32_t BAKED_TEXTURE_VERSION = 1;
+
+
+//=============================================================================
+
+
+/// A baked texture mapped into memory. The levels are used in place (e.g.
+/// copied into upload buffers); pages are only read when touched.
+class BakedTexture
+{
+public:
+
+    BakedTexture() {}
+    ~BakedTexture() { close(); }
+
+    BakedTexture(const BakedTexture&) = delete;
+    BakedTexture& operator=(const BakedTexture&) = delete;
+
+    /// map a baked texture file; false if it cannot be read or is invalid
+    bool open(const std::string& filename);
+
+    /// unmap the file
+    void close();
+
+    /// header fields
+    uint32_t format() const { return header().format; }
+    uint32_t flags()  const { return header().flags; }
+    unsigned width()  const { return header().width; }
+    unsigned height() const { return header().height; }
+    unsigned levels() const { return header().levels; }
+
+    /// size of a mip level
+    unsigned width(unsigned level)  const { unsigned w = width()  >> level; return w ? w : 1; }
+    unsigned height(unsigned level) const { unsigned h = height() >> level; return h ? h : 1; }
+
+    /// data of a mip level and its size in bytes
+    const uint8_t* level(unsigned level) const { return data_ + index()[level].offset; }
+    size_t level_size(unsigned level) const { return index()[level].size; }
+
+private:
+
+    const BakedTextureHeader& header() const { return *reinterpret_cast<const BakedTextureHeader*>(data_); }
+    const BakedLevel* index() const { return reinterpret_cast<const BakedLevel*>(data_ + sizeof(BakedTextureHeader)); }
+
+private:
+
+    /// mapped file
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+
+//=============================================================================
+
+
+/// Build the mip chain of an RGBA image for baking: level 0 is the image
+/// flipped to OpenGL's bottom-up row order, every further level halves the
+/// previous one (rounding down, as OpenGL does) with a Kaiser-windowed sinc
+/// filter, wrapping horizontally and clamping vertically. With \c srgb the
+/// color channels are filtered in linear light. Runs on the thread pool.
+void bake_mip_chain(const std::vector<uint8_t>& img, unsigned width, unsigned height, bool srgb,
+                    std::vector<std::vector<uint8_t>>& levels);
+
+/// Pack the red channels of up to four RGBA images, in the order of their
+/// rows, into the channels of one image of the largest width and height
+/// among them; smaller images are resampled bilinearly (wrapping
+/// horizontally). Channels without an image are 0, alpha 255. Runs on the
+/// thread pool.
+void pack_channels(const std::vector<std::vector<uint8_t>>& images,
+                   const std::vector<unsigned>& widths, const std::vector<unsigned>& heights,
+                   std::vector<uint8_t>& packed, unsigned& width, unsigned& height);
+
+/// Cut a level (RGBA, in OpenGL's row order) into pages with borders for
+/// virtual texturing. The pages are returned as one RGBA image of
+/// BAKED_PAGE_STRIDE columns, the pages stacked on top of each other in
+/// row-major order of the page grid, bottom row of pages first; it can be
+/// block compressed as a whole. Texels beyond the level wrap horizontally
+/// and clamp vertically, like the sampling of the full texture would.
+void cut_pages(const std::vector<uint8_t>& level, unsigned width, unsigned height,
+               std::vector<uint8_t>& pages);
+
+/// Write a mip chain in the given BakedFormat (each level a sequence of
+/// block rows, see baked_row_bytes()) as baked texture; false on errors.
+bool write_baked_texture(const std::string& filename, BakedFormat format, uint32_t flags,
+                         unsigned width, unsigned height,
+                         const std::vector<std::vector<uint8_t>>& levels);
+
+
+//=============================================================================
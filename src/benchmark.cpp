@@ -0,0 +1,247 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "benchmark.hh"
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+
+//=============================================================================
+
+namespace {
+
+/// write s as a JSON string
+void json_string(std::ostream& os, const std::string& s)
+{
+    os << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') os << '\\' << c;
+        else if ((unsigned char)c < 0x20) os << ' ';
+        else os << c;
+    }
+    os << '"';
+}
+
+
+/// write count, mean, percentiles and maximum of the non-negative values as
+/// a JSON object (null if there are none)
+void json_stats(std::ostream& os, const std::vector<double>& values)
+{
+    std::vector<double> v;
+    for (double x : values)
+        if (x >= 0.0) v.push_back(x);
+    if (v.empty()) {
+        os << "null";
+        return;
+    }
+    std::sort(v.begin(), v.end());
+
+    // nearest-rank percentile
+    auto percentile = [&](double p) {
+        size_t rank = (size_t)std::ceil(p / 100.0 * v.size());
+        return v[std::min(v.size(), std::max<size_t>(rank, 1)) - 1];
+    };
+    double sum = 0.0;
+    for (double x : v) sum += x;
+
+    os << "{\"count\": " << v.size()
+       << ", \"mean\": " << sum / v.size()
+       << ", \"p50\": " << percentile(50)
+       << ", \"p95\": " << percentile(95)
+       << ", \"p99\": " << percentile(99)
+       << ", \"max\": " << v.back() << "}";
+}
+
+}
+
+
+//=============================================================================
+
+
+Benchmark::Benchmark(const std::string& scenario, unsigned int frames, unsigned int warmup)
+    : scenario_(scenario), frames_(frames), warmup_(warmup)
+{
+    frame_ms_.assign(frames_, 0.0);
+    for (auto& s : stage_ms_) s.assign(frames_, 0.0);
+    gpu_ms_.assign(frames_, -1.0);
+    allocations_.assign(frames_, 0.0);
+    allocated_bytes_.assign(frames_, 0.0);
+    all_thread_allocations_.assign(frames_, 0.0);
+
+    gpu_timing_ = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if (gpu_timing_) glGenQueries(QUERY_RING, queries_);
+    std::fill(query_frame_, query_frame_ + QUERY_RING, -1);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+Benchmark::~Benchmark()
+{
+    if (gpu_timing_) glDeleteQueries(QUERY_RING, queries_);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+float Benchmark::progress() const
+{
+    if (frame_ < warmup_) return 0.0f;
+    return std::min(1.0f, float(frame_ - warmup_) / float(std::max(1u, frames_ - 1)));
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Benchmark::begin_frame()
+{
+    frame_start_ = Clock::now();
+    thread_alloc_start_ = AllocationTracker::thread();
+    total_alloc_start_ = AllocationTracker::total();
+}
+
+
+void Benchmark::end_frame()
+{
+    if (measured()) {
+        const unsigned int i = frame_ - warmup_;
+        frame_ms_[i] = std::chrono::duration<double, std::milli>(Clock::now() - frame_start_).count();
+
+        AllocationCounts thread = AllocationTracker::thread() - thread_alloc_start_;
+        allocations_[i]     = double(thread.allocations);
+        allocated_bytes_[i] = double(thread.bytes);
+        all_thread_allocations_[i] = double((AllocationTracker::total() - total_alloc_start_).allocations);
+        for (int slot = 0; slot < QUERY_RING; ++slot) read_query(slot, false);
+    }
+    ++frame_;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Benchmark::begin_stage(Stage stage)
+{
+    stage_start_[stage] = Clock::now();
+}
+
+
+void Benchmark::end_stage(Stage stage)
+{
+    if (measured())
+        stage_ms_[stage][frame_ - warmup_] += std::chrono::duration<double, std::milli>(Clock::now() - stage_start_[stage]).count();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Benchmark::begin_gpu()
+{
+    if (!gpu_timing_ || !measured()) return;
+
+    // if the ring is full, the oldest query has to finish first
+    read_query(query_next_, true);
+    query_frame_[query_next_] = frame_ - warmup_;
+    glBeginQuery(GL_TIME_ELAPSED, queries_[query_next_]);
+}
+
+
+void Benchmark::end_gpu()
+{
+    if (!gpu_timing_ || !measured()) return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    query_next_ = (query_next_ + 1) % QUERY_RING;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Benchmark::read_query(int slot, bool wait)
+{
+    if (query_frame_[slot] < 0) return;
+
+    if (!wait) {
+        GLint available = 0;
+        glGetQueryObjectiv(queries_[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return;
+    }
+
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(queries_[slot], GL_QUERY_RESULT, &ns);
+    gpu_ms_[query_frame_[slot]] = 1e-6 * ns;
+    query_frame_[slot] = -1;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Benchmark::write_json(std::ostream& os,
+                           const std::vector<std::pair<std::string, std::string>>& text,
+                           const std::vector<std::pair<std::string, double>>& numbers,
+                           const std::vector<std::pair<std::string, double>>& gpu_passes)
+{
+    for (int slot = 0; slot < QUERY_RING; ++slot) read_query(slot, true);
+
+    static const char* stage_names[N_STAGES] = { "timer", "cull", "draw_scene", "capture" };
+
+    os << "{\n  \"scenario\": ";
+    json_string(os, scenario_);
+    os << ",\n  \"frames\": " << frames_
+       << ",\n  \"warmup_frames\": " << warmup_;
+    for (const auto& kv : text) {
+        os << ",\n  ";
+        json_string(os, kv.first);
+        os << ": ";
+        json_string(os, kv.second);
+    }
+    for (const auto& kv : numbers) {
+        os << ",\n  ";
+        json_string(os, kv.first);
+        os << ": " << kv.second;
+    }
+
+    os << ",\n  \"cpu_frame_ms\": ";
+    json_stats(os, frame_ms_);
+
+    os << ",\n  \"cpu_stage_ms\": {";
+    for (int s = 0; s < N_STAGES; ++s) {
+        os << (s ? ",\n    " : "\n    ") << '"' << stage_names[s] << "\": ";
+        json_stats(os, stage_ms_[s]);
+    }
+    os << "\n  }";
+
+    os << ",\n  \"gpu_frame_ms\": ";
+    json_stats(os, gpu_ms_);
+
+    os << ",\n  \"allocations_per_frame\": ";
+    json_stats(os, allocations_);
+    os << ",\n  \"allocated_bytes_per_frame\": ";
+    json_stats(os, allocated_bytes_);
+    os << ",\n  \"allocations_per_frame_all_threads\": ";
+    json_stats(os, all_thread_allocations_);
+
+    os << ",\n  \"gpu_pass_ms\": {";
+    for (size_t i = 0; i < gpu_passes.size(); ++i) {
+        os << (i ? ",\n    " : "\n    ");
+        json_string(os, gpu_passes[i].first);
+        os << ": " << gpu_passes[i].second;
+    }
+    os << (gpu_passes.empty() ? "}" : "\n  }");
+    os << "\n}\n";
+}
+
+
+//=============================================================================
@@ -0,0 +1,114 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "gl.hh"
+#include "allocation_tracker.hh"
+#include <chrono>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+//=============================================================================
+
+
+/// Frame-time recorder of the benchmark mode. For a fixed number of frames
+/// (after some warm-up frames) it records the CPU time of every frame and of
+/// its stages, and the GPU time of the frame's rendering, measured with
+/// GL_TIME_ELAPSED queries from a small ring so that reading the results
+/// never stalls the pipeline, and the number and size of the heap
+/// allocations of each frame. The statistics are written as JSON.
+class Benchmark
+{
+public:
+
+    /// CPU stages of a frame
+    enum Stage { STAGE_TIMER, STAGE_CULL, STAGE_DRAW_SCENE, STAGE_CAPTURE, N_STAGES };
+
+    /// \param scenario name of the scripted scenario (reported only)
+    /// \param frames number of measured frames
+    /// \param warmup number of unmeasured frames before them
+    Benchmark(const std::string& scenario, unsigned int frames, unsigned int warmup);
+    ~Benchmark();
+
+    Benchmark(const Benchmark&) = delete;
+    Benchmark& operator=(const Benchmark&) = delete;
+
+    /// name of the scenario
+    const std::string& scenario() const { return scenario_; }
+
+    /// index of the current frame, counting the warm-up frames
+    unsigned int frame() const { return frame_; }
+
+    /// progress through the measured frames in [0, 1] (0 during warm-up)
+    float progress() const;
+
+    /// true after the last measured frame
+    bool done() const { return frame_ >= warmup_ + frames_; }
+
+    /// mark the start and the end (after the buffer swap) of a frame
+    void begin_frame();
+    void end_frame();
+
+    /// mark the start and the end of a stage of the current frame
+    void begin_stage(Stage stage);
+    void end_stage(Stage stage);
+
+    /// enclose the GL commands of the frame to be timed on the GPU
+    void begin_gpu();
+    void end_gpu();
+
+    /// Wait for all pending GPU timings and write the statistics together
+    /// with some text and numeric key-value pairs describing the run and
+    /// the average GPU time (ms) of the profiled passes.
+    void write_json(std::ostream& os,
+                    const std::vector<std::pair<std::string, std::string>>& text,
+                    const std::vector<std::pair<std::string, double>>& numbers,
+                    const std::vector<std::pair<std::string, double>>& gpu_passes);
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    /// read the result of a timer query if it is available (or wait for it)
+    void read_query(int slot, bool wait);
+
+    /// whether the current frame is measured
+    bool measured() const { return frame_ >= warmup_ && frame_ < warmup_ + frames_; }
+
+private:
+
+    std::string scenario_;
+    unsigned int frames_, warmup_;
+    unsigned int frame_ = 0;
+
+    Clock::time_point frame_start_;
+    Clock::time_point stage_start_[N_STAGES];
+    AllocationCounts thread_alloc_start_, total_alloc_start_;
+
+    /// per measured frame: CPU frame time and stage times (ms)
+    std::vector<double> frame_ms_;
+    std::vector<double> stage_ms_[N_STAGES];
+    /// per measured frame: GPU time (ms), negative if not (yet) available
+    std::vector<double> gpu_ms_;
+    /// per measured frame: allocations and bytes of the rendering thread,
+    /// and allocations of all threads
+    std::vector<double> allocations_, allocated_bytes_, all_thread_allocations_;
+
+    /// ring of timer queries and the (measured) frame each one belongs to
+    static const int QUERY_RING = 4;
+    GLuint queries_[QUERY_RING] = {};
+    int query_frame_[QUERY_RING];
+    int query_next_ = 0;
+    bool gpu_timing_ = false;
+};
+
+
+//=============================================================================
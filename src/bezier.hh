@@ -25,7 +25,7 @@ public:
         return control_polygon_.size() - 3;
     }
 
-    const std::vector<vec3> bezier_control_points() const { return bezier_control_points_; }
+    const std::vector<vec3>& bezier_control_points() const { return bezier_control_points_; }
 
 private:
     vec3 eval_piecewise_bezier_curve(       float t) const;
@@ -0,0 +1,428 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "block_compression.hh"
+#include "thread_pool.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+//=============================================================================
+
+namespace {
+
+/// the 16 RGBA texels of a 4x4 block, row by row
+struct Block {
+    uint8_t p[16][4];
+};
+
+/// gather a block, repeating the last row/column at the image border
+void load_block(const uint8_t* rgba, unsigned w, unsigned h, unsigned bx, unsigned by, Block& b)
+{
+    for (unsigned int y = 0; y < 4; ++y) {
+        const unsigned sy = std::min(by * 4 + y, h - 1);
+        for (unsigned int x = 0; x < 4; ++x) {
+            const unsigned sx = std::min(bx * 4 + x, w - 1);
+            const uint8_t* src = rgba + (size_t(sy) * w + sx) * 4;
+            for (int c = 0; c < 4; ++c) b.p[y * 4 + x][c] = src[c];
+        }
+    }
+}
+
+/// scatter a decoded block, skipping texels outside the image
+void store_block(const Block& b, unsigned w, unsigned h, unsigned bx, unsigned by, uint8_t* rgba)
+{
+    for (unsigned int y = 0; y < 4 && by * 4 + y < h; ++y)
+        for (unsigned int x = 0; x < 4 && bx * 4 + x < w; ++x)
+            for (int c = 0; c < 4; ++c)
+                rgba[(size_t(by * 4 + y) * w + bx * 4 + x) * 4 + c] = b.p[y * 4 + x][c];
+}
+
+
+//== BC4: one channel, two 8 bit endpoints and 3 bit indices =================
+
+
+/// the eight values a BC4 block with endpoints r0, r1 can represent
+void bc4_palette(int r0, int r1, int pal[8])
+{
+    pal[0] = r0;
+    pal[1] = r1;
+    if (r0 > r1) {
+        for (int i = 2; i < 8; ++i) pal[i] = ((8 - i) * r0 + (i - 1) * r1 + 3) / 7;
+    }
+    else {
+        for (int i = 2; i < 6; ++i) pal[i] = ((6 - i) * r0 + (i - 1) * r1 + 2) / 5;
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+}
+
+/// choose the closest palette entry for every value; returns the squared error
+int bc4_fit(const int v[16], int r0, int r1, uint8_t idx[16])
+{
+    int pal[8];
+    bc4_palette(r0, r1, pal);
+    int error = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, best_d = std::numeric_limits<int>::max();
+        for (int k = 0; k < 8; ++k) {
+            int d = (v[i] - pal[k]) * (v[i] - pal[k]);
+            if (d < best_d) { best_d = d; best = k; }
+        }
+        idx[i] = uint8_t(best);
+        error += best_d;
+    }
+    return error;
+}
+
+/// encode 16 values of one channel into 8 bytes
+void encode_bc4(const int v[16], int quality, uint8_t out[8])
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; ++i) { lo = std::min(lo, v[i]); hi = std::max(hi, v[i]); }
+
+    int r0 = hi, r1 = lo;
+    uint8_t idx[16];
+    if (quality == 0 || hi == lo) {
+        // eight-value mode over the range
+        bc4_fit(v, r0, r1, idx);
+    }
+    else {
+        // the rounded palette may fit better with slightly inset endpoints
+        const int inset = (quality >= 2) ? 4 : 3;
+        int best = std::numeric_limits<int>::max();
+        uint8_t trial[16];
+        for (int d0 = 0; d0 < inset; ++d0) {
+            for (int d1 = 0; d1 < inset; ++d1) {
+                int a = hi - d0, b = lo + d1;
+                if (a <= b) continue;
+                int error = bc4_fit(v, a, b, trial);
+                if (error < best) { best = error; r0 = a; r1 = b; std::copy(trial, trial + 16, idx); }
+            }
+        }
+
+        // blocks touching 0 or 255: six-value mode over the other values
+        if (quality >= 2 && (lo == 0 || hi == 255)) {
+            int lo6 = 255, hi6 = 0;
+            for (int i = 0; i < 16; ++i) {
+                if (v[i] == 0 || v[i] == 255) continue;
+                lo6 = std::min(lo6, v[i]);
+                hi6 = std::max(hi6, v[i]);
+            }
+            if (lo6 > hi6) lo6 = hi6 = 0;
+            int error = bc4_fit(v, lo6, hi6, trial);
+            if (error < best) { r0 = lo6; r1 = hi6; std::copy(trial, trial + 16, idx); }
+        }
+    }
+    out[0] = uint8_t(r0);
+    out[1] = uint8_t(r1);
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; ++i) bits |= uint64_t(idx[i]) << (3 * i);
+    for (int i = 0; i < 6; ++i) out[2 + i] = uint8_t(bits >> (8 * i));
+}
+
+/// decode a BC4 block into 16 values
+void decode_bc4(const uint8_t in[8], uint8_t v[16])
+{
+    int pal[8];
+    bc4_palette(in[0], in[1], pal);
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i) bits |= uint64_t(in[2 + i]) << (8 * i);
+    for (int i = 0; i < 16; ++i) v[i] = uint8_t(pal[(bits >> (3 * i)) & 7]);
+}
+
+
+//== BC1: RGB565 endpoints and 2 bit indices =================================
+
+
+uint16_t to_565(const float c[3])
+{
+    auto q = [](float v, int max) { return std::min(max, std::max(0, int(v * max / 255.0f + 0.5f))); };
+    return uint16_t((q(c[0], 31) << 11) | (q(c[1], 63) << 5) | q(c[2], 31));
+}
+
+void from_565(uint16_t c, int rgb[3])
+{
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+/// the colors of a BC1 block: four-color mode if c0 > c1 (always in BC3),
+/// otherwise three colors and transparent black
+void bc1_palette(uint16_t c0, uint16_t c1, bool four, int pal[4][4])
+{
+    from_565(c0, pal[0]);
+    from_565(c1, pal[1]);
+    pal[0][3] = pal[1][3] = 255;
+    for (int c = 0; c < 3; ++c) {
+        if (four || c0 > c1) {
+            pal[2][c] = (2 * pal[0][c] + pal[1][c] + 1) / 3;
+            pal[3][c] = (pal[0][c] + 2 * pal[1][c] + 1) / 3;
+        }
+        else {
+            pal[2][c] = (pal[0][c] + pal[1][c] + 1) / 2;
+            pal[3][c] = 0;
+        }
+    }
+    pal[2][3] = 255;
+    pal[3][3] = (four || c0 > c1) ? 255 : 0;
+}
+
+/// choose the closest of the four-color palette for every texel; returns the
+/// squared RGB error
+int bc1_fit(const Block& b, uint16_t c0, uint16_t c1, uint8_t idx[16])
+{
+    int pal[4][4];
+    bc1_palette(c0, c1, true, pal);
+    int error = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, best_d = std::numeric_limits<int>::max();
+        for (int k = 0; k < 4; ++k) {
+            int dr = b.p[i][0] - pal[k][0], dg = b.p[i][1] - pal[k][1], db = b.p[i][2] - pal[k][2];
+            int d = dr * dr + dg * dg + db * db;
+            if (d < best_d) { best_d = d; best = k; }
+        }
+        idx[i] = uint8_t(best);
+        error += best_d;
+    }
+    return error;
+}
+
+/// least-squares endpoints for given indices (four-color mode weights)
+bool bc1_refine(const Block& b, const uint8_t idx[16], float e0[3], float e1[3])
+{
+    static const float w0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0, ab = 0, bb = 0, ax[3] = {}, bx[3] = {};
+    for (int i = 0; i < 16; ++i) {
+        float a = w0[idx[i]], c = 1.0f - a;
+        aa += a * a; ab += a * c; bb += c * c;
+        for (int k = 0; k < 3; ++k) { ax[k] += a * b.p[i][k]; bx[k] += c * b.p[i][k]; }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f) return false;
+    for (int k = 0; k < 3; ++k) {
+        e0[k] = (ax[k] * bb - bx[k] * ab) / det;
+        e1[k] = (bx[k] * aa - ax[k] * ab) / det;
+    }
+    return true;
+}
+
+/// encode the colors of a block into 8 bytes (always four-color mode)
+void encode_bc1(const Block& b, int quality, uint8_t out[8])
+{
+    float lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            lo[k] = std::min(lo[k], float(b.p[i][k]));
+            hi[k] = std::max(hi[k], float(b.p[i][k]));
+            mean[k] += b.p[i][k] / 16.0f;
+        }
+    }
+
+    float e0[3] = { hi[0], hi[1], hi[2] }, e1[3] = { lo[0], lo[1], lo[2] };
+    if (quality >= 1) {
+        // principal axis of the colors by power iteration on the covariance
+        float cov[6] = {};
+        for (int i = 0; i < 16; ++i) {
+            float d[3] = { b.p[i][0] - mean[0], b.p[i][1] - mean[1], b.p[i][2] - mean[2] };
+            cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+            cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+        }
+        float axis[3] = { hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2] };
+        for (int it = 0; it < 8; ++it) {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float n = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+            if (n < 1e-6f) break;
+            axis[0] = x / n; axis[1] = y / n; axis[2] = z / n;
+        }
+        float len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        if (len2 > 1e-6f) {
+            // extent of the colors along the axis
+            float tmin = 1e30f, tmax = -1e30f;
+            for (int i = 0; i < 16; ++i) {
+                float t = ((b.p[i][0] - mean[0]) * axis[0] + (b.p[i][1] - mean[1]) * axis[1] +
+                           (b.p[i][2] - mean[2]) * axis[2]) / len2;
+                tmin = std::min(tmin, t);
+                tmax = std::max(tmax, t);
+            }
+            for (int k = 0; k < 3; ++k) {
+                e0[k] = mean[k] + tmax * axis[k];
+                e1[k] = mean[k] + tmin * axis[k];
+            }
+        }
+    }
+
+    uint16_t c0 = to_565(e0), c1 = to_565(e1);
+    uint8_t idx[16];
+    int error = bc1_fit(b, c0, c1, idx);
+
+    if (quality >= 2) {
+        // alternate between index fitting and least-squares endpoints
+        for (int it = 0; it < 2 && error > 0; ++it) {
+            float r0[3], r1[3];
+            if (!bc1_refine(b, idx, r0, r1)) break;
+            uint16_t n0 = to_565(r0), n1 = to_565(r1);
+            uint8_t trial[16];
+            int e = bc1_fit(b, n0, n1, trial);
+            if (e >= error) break;
+            error = e; c0 = n0; c1 = n1;
+            std::copy(trial, trial + 16, idx);
+        }
+    }
+
+    // four-color mode needs c0 > c1: swap the endpoints (and indices 0/1, 2/3)
+    if (c0 < c1) {
+        std::swap(c0, c1);
+        for (int i = 0; i < 16; ++i) idx[i] ^= 1;
+    }
+    else if (c0 == c1) {
+        std::fill(idx, idx + 16, 0);
+    }
+
+    out[0] = uint8_t(c0); out[1] = uint8_t(c0 >> 8);
+    out[2] = uint8_t(c1); out[3] = uint8_t(c1 >> 8);
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; ++i) bits |= uint32_t(idx[i]) << (2 * i);
+    for (int i = 0; i < 4; ++i) out[4 + i] = uint8_t(bits >> (8 * i));
+}
+
+/// decode the colors of a BC1 block
+void decode_bc1(const uint8_t in[8], bool four, Block& b)
+{
+    uint16_t c0 = uint16_t(in[0] | (in[1] << 8)), c1 = uint16_t(in[2] | (in[3] << 8));
+    int pal[4][4];
+    bc1_palette(c0, c1, four, pal);
+    uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | (uint32_t(in[7]) << 24);
+    for (int i = 0; i < 16; ++i)
+        for (int k = 0; k < 4; ++k) b.p[i][k] = uint8_t(pal[(bits >> (2 * i)) & 3][k]);
+}
+
+}
+
+
+//=============================================================================
+
+
+void compress_image(const std::vector<uint8_t>& rgba, unsigned width, unsigned height,
+                    BakedFormat format, int quality, std::vector<uint8_t>& blocks)
+{
+    assert(baked_block_size(format) == 4);
+    const unsigned bw = (width + 3) / 4, bh = (height + 3) / 4;
+    const unsigned bytes = baked_block_bytes(format);
+    blocks.resize(size_t(bw) * bh * bytes);
+
+    ThreadPool::instance().parallel_for(bh, 1, [&](size_t begin, size_t end) {
+        Block b;
+        int v[16];
+        for (size_t by = begin; by < end; ++by) {
+            for (unsigned int bx = 0; bx < bw; ++bx) {
+                load_block(rgba.data(), width, height, bx, by, b);
+                uint8_t* out = &blocks[(by * bw + bx) * bytes];
+                switch (format) {
+                    case BAKED_BC1:
+                        encode_bc1(b, quality, out);
+                        break;
+                    case BAKED_BC3:
+                        for (int i = 0; i < 16; ++i) v[i] = b.p[i][3];
+                        encode_bc4(v, quality, out);
+                        encode_bc1(b, quality, out + 8);
+                        break;
+                    case BAKED_BC4:
+                    case BAKED_BC5:
+                        for (int c = 0; c < (format == BAKED_BC5 ? 2 : 1); ++c) {
+                            for (int i = 0; i < 16; ++i) v[i] = b.p[i][c];
+                            encode_bc4(v, quality, out + 8 * c);
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    });
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void decompress_image(const std::vector<uint8_t>& blocks, unsigned width, unsigned height,
+                      BakedFormat format, std::vector<uint8_t>& rgba)
+{
+    const unsigned bw = (width + 3) / 4, bh = (height + 3) / 4;
+    const unsigned bytes = baked_block_bytes(format);
+    rgba.resize(size_t(width) * height * 4);
+
+    for (unsigned int by = 0; by < bh; ++by) {
+        for (unsigned int bx = 0; bx < bw; ++bx) {
+            const uint8_t* in = &blocks[(size_t(by) * bw + bx) * bytes];
+            Block b;
+            uint8_t v[16];
+            switch (format) {
+                case BAKED_BC1:
+                    decode_bc1(in, false, b);
+                    break;
+                case BAKED_BC3:
+                    decode_bc1(in + 8, true, b);
+                    decode_bc4(in, v);
+                    for (int i = 0; i < 16; ++i) b.p[i][3] = v[i];
+                    break;
+                case BAKED_BC4:
+                    decode_bc4(in, v);
+                    for (int i = 0; i < 16; ++i) { b.p[i][0] = b.p[i][1] = b.p[i][2] = v[i]; b.p[i][3] = 255; }
+                    break;
+                case BAKED_BC5:
+                    decode_bc4(in, v);
+                    for (int i = 0; i < 16; ++i) { b.p[i][0] = v[i]; b.p[i][2] = 0; b.p[i][3] = 255; }
+                    decode_bc4(in + 8, v);
+                    for (int i = 0; i < 16; ++i) b.p[i][1] = v[i];
+                    break;
+                default:
+                    return;
+            }
+            store_block(b, width, height, bx, by, rgba.data());
+        }
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+double compression_psnr(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, BakedFormat format)
+{
+    assert(a.size() == b.size());
+    int first = 0, last = 3;
+    switch (format) {
+        case BAKED_BC1: last = 2; break;
+        case BAKED_BC4: last = 0; break;
+        case BAKED_BC5: last = 1; break;
+        default: break;
+    }
+
+    double sum = 0.0;
+    size_t n = 0;
+    for (size_t i = 0; i < a.size(); i += 4) {
+        for (int c = first; c <= last; ++c) {
+            double d = double(a[i + c]) - double(b[i + c]);
+            sum += d * d;
+        }
+        n += last - first + 1;
+    }
+    if (sum == 0.0) return std::numeric_limits<double>::infinity();
+    return 10.0 * std::log10(255.0 * 255.0 / (sum / n));
+}
+
+
+//=============================================================================
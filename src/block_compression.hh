@@ -0,0 +1,44 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "baked_texture.hh"
+#include <cstdint>
+#include <vector>
+
+//=============================================================================
+
+
+/// Encoder (and reference decoder) for the BC1, BC3, BC4 and BC5 block
+/// compression formats (S3TC/DXT1, DXT5 and RGTC1/2). An image is cut into
+/// 4x4 blocks, partial blocks at the borders repeat the last row/column,
+/// and the blocks are stored row by row in the order of the image rows.
+/// Block rows are encoded in parallel on the thread pool.
+///
+/// Quality levels trade speed for precision:
+///  - 0: endpoints from the bounding box of the block
+///  - 1: endpoints along the principal axis of the colors (BC1/BC3), exact
+///       endpoint search around the range (BC4/BC5)
+///  - 2: additionally least-squares refinement of the color endpoints and
+///       the 6-value mode of BC4 for blocks touching 0 or 255
+void compress_image(const std::vector<uint8_t>& rgba, unsigned width, unsigned height,
+                    BakedFormat format, int quality, std::vector<uint8_t>& blocks);
+
+/// Decode blocks back to RGBA (BC4 as r,r,r,255, BC5 as r,g,0,255), e.g. to
+/// measure the error of the compression.
+void decompress_image(const std::vector<uint8_t>& blocks, unsigned width, unsigned height,
+                      BakedFormat format, std::vector<uint8_t>& rgba);
+
+/// Peak signal-to-noise ratio (dB) between two RGBA images over the
+/// channels a format stores (RGB for BC1, RGBA for BC3 and RGBA8, R for BC4,
+/// RG for BC5); infinite for identical images.
+double compression_psnr(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, BakedFormat format);
+
+
+//=============================================================================
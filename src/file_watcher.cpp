@@ -0,0 +1,79 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "file_watcher.hh"
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#  include <sys/inotify.h>
+#  include <unistd.h>
+#endif
+
+//=============================================================================
+
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+    if (fd_ >= 0) close(fd_);
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool FileWatcher::watch(const std::filesystem::path& directory)
+{
+#ifdef __linux__
+    if (fd_ < 0) fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0 || inotify_add_watch(fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cerr << "FileWatcher: Cannot watch " << directory << std::endl;
+        return false;
+    }
+    directory_ = directory;
+    return true;
+#else
+    (void)directory;
+    return false;
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool FileWatcher::poll(std::vector<std::filesystem::path>& changed)
+{
+    changed.clear();
+
+#ifdef __linux__
+    if (fd_ < 0) return false;
+
+    alignas(inotify_event) char buffer[4096];
+    ssize_t n;
+    while ((n = read(fd_, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + n; ) {
+            const inotify_event* event = (const inotify_event*)p;
+            if (event->len > 0) {
+                std::filesystem::path file = directory_ / event->name;
+                if (std::find(changed.begin(), changed.end(), file) == changed.end())
+                    changed.push_back(file);
+            }
+            p += sizeof(inotify_event) + event->len;
+        }
+    }
+#endif
+
+    return !changed.empty();
+}
+
+
+//=============================================================================
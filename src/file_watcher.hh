@@ -0,0 +1,48 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include <filesystem>
+#include <vector>
+
+//=============================================================================
+
+
+/// Watches the files of a directory for changes with inotify, e.g. the
+/// shaders for reloading them while they are edited. poll() does not block,
+/// so it can be called every frame. Without inotify (other than Linux)
+/// nothing is ever reported.
+class FileWatcher
+{
+public:
+
+    FileWatcher() = default;
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    /// Start watching the files in a directory (not its subdirectories);
+    /// returns false if it cannot be watched.
+    bool watch(const std::filesystem::path& directory);
+
+    /// Collect the files written (or moved into the directory, as editors
+    /// save) since the last call into \c changed, each file once; returns
+    /// whether there are any. Allocates only if there are.
+    bool poll(std::vector<std::filesystem::path>& changed);
+
+private:
+
+    /// inotify instance (-1: none)
+    int fd_ = -1;
+    std::filesystem::path directory_;
+};
+
+
+//=============================================================================
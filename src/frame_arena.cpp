@@ -0,0 +1,159 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "frame_arena.hh"
+#include "allocation_tracker.hh"
+#include "glmath.hh"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+
+//=============================================================================
+
+
+FrameArena::FrameArena(size_t capacity)
+    : resource_(*this)
+{
+    for (Buffer& b : buffers_) {
+        b.data.reset(new char[capacity]);
+        b.capacity = capacity;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void FrameArena::begin_frame()
+{
+    current_ = 1 - current_;
+    Buffer& b = buffers_[current_];
+
+    // make room for everything the buffer had to hold last time
+    if (b.overflow_bytes) {
+        size_t capacity = b.capacity + b.overflow_bytes;
+        capacity += capacity / 4;
+        b.overflow.clear();
+        b.overflow_bytes = 0;
+        b.data.reset(new char[capacity]);
+        b.capacity = capacity;
+    }
+    b.used = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    assert(alignment && (alignment & (alignment - 1)) == 0);
+    Buffer& b = buffers_[current_];
+
+    uintptr_t base = reinterpret_cast<uintptr_t>(b.data.get());
+    uintptr_t p = (base + b.used + alignment - 1) & ~uintptr_t(alignment - 1);
+    if (p + bytes <= base + b.capacity) {
+        b.used = p + bytes - base;
+        return reinterpret_cast<void*>(p);
+    }
+
+    // does not fit: a heap block for this frame, remembered for resizing
+    size_t size = bytes + alignment;
+    b.overflow.emplace_back(new char[size]);
+    b.overflow_bytes += size;
+    p = (reinterpret_cast<uintptr_t>(b.overflow.back().get()) + alignment - 1) & ~uintptr_t(alignment - 1);
+    return reinterpret_cast<void*>(p);
+}
+
+
+//=============================================================================
+
+
+namespace {
+
+/// the transient data of one frame, allocated from the given resource
+float transient_frame(std::pmr::memory_resource* resource, size_t rocks)
+{
+    // draw list of the phong-shaded bodies
+    std::pmr::vector<mat4> draw_list(resource);
+    for (int i = 0; i < 8; ++i)
+        draw_list.push_back(mat4::translate(vec3(float(i), 0.0f, 0.0f)));
+
+    // sampled ship path
+    std::pmr::vector<vec3> curve(resource);
+    for (int i = 0; i < 1000; ++i)
+        curve.push_back(vec3(std::cos(0.01f * i), 0.0f, std::sin(0.01f * i)));
+
+    // culling results: visible indices per LOD
+    std::pmr::vector<uint32_t> lods[3] = { std::pmr::vector<uint32_t>(resource),
+                                           std::pmr::vector<uint32_t>(resource),
+                                           std::pmr::vector<uint32_t>(resource) };
+    for (uint32_t i = 0; i < rocks; ++i)
+        lods[i % 7 == 0 ? 0 : i % 3 == 0 ? 1 : 2].push_back(i);
+
+    return draw_list.back()(0, 3) + curve.back().x + float(lods[2].size());
+}
+
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void frame_arena_benchmark(std::ostream& os)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    os << "Transient per-frame allocations: default heap vs. frame arena\n"
+       << std::setw(10) << "rocks"
+       << std::setw(14) << "heap [ms]" << std::setw(14) << "heap allocs"
+       << std::setw(14) << "arena [ms]" << std::setw(14) << "arena allocs"
+       << std::setw(10) << "speedup" << std::endl;
+
+    FrameArena arena;
+    volatile float sink = 0.0f;
+
+    for (size_t rocks : { 1000, 10000, 100000, 1000000 }) {
+        const int frames = int(std::max<size_t>(20, 20000000 / (rocks + 1000)));
+
+        auto run = [&](bool use_arena, double& ms, double& allocs) {
+            // the first frames size the arena
+            for (int f = 0; f < 4; ++f) {
+                if (use_arena) arena.begin_frame();
+                sink = sink + transient_frame(use_arena ? arena.resource() : std::pmr::new_delete_resource(), rocks);
+            }
+
+            AllocationScope scope;
+            auto start = Clock::now();
+            for (int f = 0; f < frames; ++f) {
+                if (use_arena) arena.begin_frame();
+                sink = sink + transient_frame(use_arena ? arena.resource() : std::pmr::new_delete_resource(), rocks);
+            }
+            ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+            allocs = double(scope.counts().allocations) / frames;
+        };
+
+        double heap_ms, heap_allocs, arena_ms, arena_allocs;
+        run(false, heap_ms, heap_allocs);
+        run(true, arena_ms, arena_allocs);
+
+        os << std::setw(10) << rocks << std::fixed << std::setprecision(4)
+           << std::setw(14) << heap_ms << std::setprecision(1) << std::setw(14) << heap_allocs
+           << std::setprecision(4) << std::setw(14) << arena_ms << std::setprecision(1) << std::setw(14) << arena_allocs
+           << std::setprecision(2) << std::setw(9) << heap_ms / arena_ms << "x"
+           << std::defaultfloat << std::endl;
+    }
+}
+
+
+//=============================================================================
@@ -0,0 +1,94 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include <cstddef>
+#include <iosfwd>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+//=============================================================================
+
+
+/// Linear (bump) allocator for data that lives for one frame: draw lists,
+/// culling results, sampled curves. Allocating is a pointer increment and
+/// nothing is freed individually; begin_frame() releases a whole frame at
+/// once. There are two buffers, used in alternate frames, so the data of
+/// the previous frame stays valid during the current one. A frame that
+/// needs more than its buffer holds takes the rest from the heap, and the
+/// buffer is enlarged accordingly when it is reset, so that a steady state
+/// needs no heap allocations at all. Not thread-safe: allocate from the
+/// thread that calls begin_frame() (workers may fill the memory, though).
+class FrameArena
+{
+public:
+
+    /// \param capacity initial size of each of the two buffers (bytes)
+    explicit FrameArena(size_t capacity = 1 << 20);
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    /// switch to the other buffer and release everything allocated from it
+    /// two frames ago (enlarging it if it overflowed)
+    void begin_frame();
+
+    /// allocate bytes with the given alignment (a power of two)
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    /// uninitialized storage for n objects of type T
+    template <class T>
+    T* allocate_array(size_t n) { return static_cast<T*>(allocate(n * sizeof(T), alignof(T))); }
+
+    /// memory resource for std::pmr containers that allocates from the
+    /// arena; deallocation is a no-op
+    std::pmr::memory_resource* resource() { return &resource_; }
+
+    /// bytes allocated from the current buffer, and its capacity
+    size_t used() const { return buffers_[current_].used + buffers_[current_].overflow_bytes; }
+    size_t capacity() const { return buffers_[current_].capacity; }
+
+private:
+
+    struct Buffer {
+        std::unique_ptr<char[]> data;
+        size_t capacity = 0;
+        size_t used = 0;
+        /// heap blocks of a frame that did not fit, and their total size
+        std::vector<std::unique_ptr<char[]>> overflow;
+        size_t overflow_bytes = 0;
+    };
+
+    /// std::pmr adapter
+    class Resource : public std::pmr::memory_resource
+    {
+    public:
+        explicit Resource(FrameArena& arena) : arena_(arena) {}
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override { return arena_.allocate(bytes, alignment); }
+        void do_deallocate(void*, size_t, size_t) override {}
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+        FrameArena& arena_;
+    };
+
+    Buffer buffers_[2];
+    int current_ = 0;
+    Resource resource_;
+};
+
+
+/// Compare the transient allocations of a typical frame (draw list, sampled
+/// curve, culling results) from the frame arena with the default heap
+/// (timings and heap allocations per frame) and write a table.
+void frame_arena_benchmark(std::ostream& os);
+
+
+//=============================================================================
@@ -0,0 +1,501 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "frame_recorder.hh"
+#include "png_encoder.hh"
+#include "thread_pool.hh"
+#include "trace.hh"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+//=============================================================================
+
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double milliseconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool ends_with(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/// number of integer conversions (%d with an optional width, e.g. %05d) of
+/// a printf pattern, or -1 if it has any other conversion
+int int_conversions(const std::string& pattern)
+{
+    int n = 0;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] != '%') continue;
+        if (++i < pattern.size() && pattern[i] == '%') continue;
+        while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9') ++i;
+        if (i >= pattern.size() || pattern[i] != 'd') return -1;
+        ++n;
+    }
+    return n;
+}
+
+/// the text with every '%' doubled, so that printf writes it as is
+std::string escape_percent(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text) {
+        if (c == '%') escaped += '%';
+        escaped += c;
+    }
+    return escaped;
+}
+
+}
+
+
+//=============================================================================
+
+
+FrameRecorder::FrameRecorder(const std::string& output, bool drop_frames, unsigned int fps)
+    : output_(output), drop_frames_(drop_frames), fps_(std::max(1u, fps))
+{
+    y4m_ = output_ == "-" || ends_with(output_, ".y4m");
+
+    if (output_ == "-") {
+        file_ = stdout;
+    }
+    else if (y4m_) {
+        file_ = std::fopen(output_.c_str(), "wb");
+        if (!file_) throw std::runtime_error("Cannot write " + output_);
+    }
+    else {
+        // the file name is the pattern, with the frame number as the only
+        // conversion; without any it is the directory of the frames
+        std::filesystem::path path(output_), dir = path.parent_path();
+        std::string name = path.filename().string();
+        if (name.find('%') == std::string::npos) {
+            dir = path;
+            name = "%05d.png";
+        }
+        if (int_conversions(name) != 1)
+            throw std::runtime_error("Recording pattern " + name + " needs exactly one %d (e.g. %05d) and no other conversion");
+        pattern_ = dir.empty() ? name : (std::filesystem::path(escape_percent(dir.string())) / name).string();
+        output_ = (dir / name).string();
+
+        std::error_code error;
+        if (!dir.empty()) std::filesystem::create_directories(dir, error);
+    }
+
+    // frames of different encoders overlap, a Y4M stream is written in order
+    // anyway; leave a core for the render thread
+    const unsigned int n = std::max(1u, std::thread::hardware_concurrency() / 2);
+    for (unsigned int i = 0; i < n; ++i) {
+        encoders_.emplace_back([this, i] {
+            Tracer::instance().set_thread_name("encoder " + std::to_string(i + 1));
+            ThreadPool::set_thread_serial(true);
+            encode();
+        });
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+FrameRecorder::~FrameRecorder()
+{
+    finish();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    for (auto& e : encoders_) e.join();
+
+    if (file_ && file_ != stdout) std::fclose(file_);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void FrameRecorder::allocate(int width, int height)
+{
+    assert(slots_.empty());
+    width_  = width;
+    height_ = height;
+    persistent_ = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+
+    // a few frames in flight on the GPU plus one per encoder
+    const size_t bytes = size_t(width) * height * 4;
+    slots_.resize(3 + encoders_.size());
+    for (auto& slot : slots_) {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        if (persistent_) {
+            // the encoders read the buffers where the GPU wrote them, so
+            // they should live in client memory
+            const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_PACK_BUFFER, bytes, NULL, flags | GL_CLIENT_STORAGE_BIT);
+            slot.data = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, flags);
+        }
+        else {
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+int FrameRecorder::oldest(State state) const
+{
+    int s = -1;
+    for (size_t i = 0; i < slots_.size(); ++i)
+        if (slots_[i].state == state && (s < 0 || slots_[i].frame < slots_[s].frame))
+            s = int(i);
+    return s;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void FrameRecorder::poll(bool wait)
+{
+    for (;;) {
+        // take back the buffers the encoders are done with
+        bool free = false, encoding = false;
+        for (auto& slot : slots_) {
+            State state;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                state = slot.state;
+            }
+            if (state == DONE) {
+                if (!persistent_) {
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                    slot.data = nullptr;
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                slot.state = state = FREE;
+            }
+            free |= state == FREE;
+            encoding |= state == QUEUED || state == ENCODING;
+        }
+
+        // Hand the frames the GPU has written to the encoders, in the order
+        // of the frames (which is that of the fences), so that the encoder
+        // of a Y4M frame never waits for one that is not handed over yet.
+        for (;;) {
+            int s;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                s = oldest(READING);
+            }
+            if (s < 0) break;
+            Slot& slot = slots_[s];
+            GLenum status = glClientWaitSync(slot.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+
+            if (!persistent_) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                slot.data = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                                             size_t(width_) * height_ * 4, GL_MAP_READ_BIT);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                slot.state = QUEUED;
+            }
+            cond_.notify_one();
+            encoding = true;
+        }
+        if (!wait || free) return;
+
+        // No buffer is free: wait for an encoder to finish its frame, or if
+        // none has one, for the oldest readback (the timeout of a fence is
+        // given in nanoseconds).
+        TRACE_SCOPE("capture_wait");
+        if (encoding) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_cond_.wait(lock, [this] {
+                return std::any_of(slots_.begin(), slots_.end(), [](const Slot& slot) { return slot.state == DONE; });
+            });
+        }
+        else {
+            int s;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                s = oldest(READING);
+            }
+            assert(s >= 0);
+            while (glClientWaitSync(slots_[s].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000) == GL_TIMEOUT_EXPIRED) {}
+        }
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void FrameRecorder::capture(int width, int height)
+{
+    TRACE_SCOPE("capture");
+    Clock::time_point start = Clock::now();
+
+    if (width != width_ || height != height_) {
+        if (y4m_ && width_) {
+            // a Y4M stream has a fixed size
+            ++dropped_;
+            return;
+        }
+        finish();
+        allocate(width, height);
+    }
+
+    poll(!drop_frames_);
+    int s;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        s = oldest(FREE);
+    }
+
+    if (s < 0) {
+        ++dropped_;
+    }
+    else {
+        Slot& slot = slots_[s];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot.state = READING;
+        slot.frame = frames_++;
+    }
+
+    last_capture_ms_ = milliseconds_since(start);
+    capture_ms_ += last_capture_ms_;
+    max_capture_ms_ = std::max(max_capture_ms_, last_capture_ms_);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void FrameRecorder::finish()
+{
+    if (slots_.empty()) return;
+    TRACE_SCOPE("capture_finish");
+
+    // hand over the frames still being read and wait for all of them
+    for (auto& slot : slots_) {
+        if (slot.fence)
+            while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000) == GL_TIMEOUT_EXPIRED) {}
+    }
+    poll(false);
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cond_.wait(lock, [this] {
+            return std::all_of(slots_.begin(), slots_.end(), [](const Slot& slot) {
+                return slot.state == FREE || slot.state == DONE;
+            });
+        });
+    }
+
+    for (auto& slot : slots_) {
+        if (slot.data) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glDeleteBuffers(1, &slot.buffer);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slots_.clear();
+
+    if (file_) std::fflush(file_);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void FrameRecorder::encode()
+{
+    // scratch memory of this encoder, reused for all its frames
+    std::vector<uint8_t> pixels, png;
+
+    for (;;) {
+        Slot* slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return stop_ || oldest(QUEUED) >= 0; });
+            int s = oldest(QUEUED);
+            if (s < 0) return;
+            slot = &slots_[s];
+            slot->state = ENCODING;
+        }
+
+        Clock::time_point start = Clock::now();
+        if (y4m_) write_y4m(*slot, pixels);
+        else      write_png(*slot, pixels, png);
+        double ms = milliseconds_since(start);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            encode_ms_ += ms;
+            ++encoded_;
+            slot->state = DONE;
+        }
+        done_cond_.notify_all();
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void FrameRecorder::write_png(const Slot& slot, std::vector<uint8_t>& rgb, std::vector<uint8_t>& png)
+{
+    TRACE_SCOPE("encode_png");
+
+    // drop the alpha channel, which holds whatever blending left there
+    const size_t n = size_t(width_) * height_;
+    rgb.resize(3 * n);
+    const uint8_t* src = slot.data;
+    uint8_t* dst = rgb.data();
+    for (size_t i = 0; i < n; ++i, src += 4, dst += 3) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+    }
+
+    char filename[4096];
+    std::snprintf(filename, sizeof(filename), pattern_.c_str(), slot.frame);
+    png_encode(png, rgb.data(), width_, height_, 3, PngCompression::Fast, true);
+
+    FILE* file = std::fopen(filename, "wb");
+    bool ok = file && std::fwrite(png.data(), 1, png.size(), file) == png.size();
+    if (file) ok &= std::fclose(file) == 0;
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!write_failed_) std::cerr << "Cannot write " << filename << std::endl;
+        write_failed_ = true;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void FrameRecorder::write_y4m(const Slot& slot, std::vector<uint8_t>& yuv)
+{
+    TRACE_SCOPE("encode_y4m");
+
+    // 4:2:0 with full-range BT.601 (JPEG) coefficients, top row first;
+    // chroma is computed from the average color of 2x2 pixels
+    const int w = width_, h = height_;
+    const int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    yuv.resize(size_t(w) * h + 2 * size_t(cw) * ch);
+    uint8_t* Y = yuv.data();
+    uint8_t* U = Y + size_t(w) * h;
+    uint8_t* V = U + size_t(cw) * ch;
+
+    auto row = [&](int y) { return slot.data + size_t(h - 1 - std::min(y, h - 1)) * w * 4; };
+    for (int cy = 0; cy < ch; ++cy) {
+        const uint8_t* r0 = row(2 * cy);
+        const uint8_t* r1 = row(2 * cy + 1);
+        uint8_t* y0 = Y + size_t(2 * cy) * w;
+        uint8_t* y1 = 2 * cy + 1 < h ? y0 + w : nullptr;
+
+        for (int cx = 0; cx < cw; ++cx) {
+            int r = 0, g = 0, b = 0;
+            for (int dx = 0; dx < 2; ++dx) {
+                const int x = std::min(2 * cx + dx, w - 1);
+                const uint8_t* p0 = r0 + 4 * x;
+                const uint8_t* p1 = r1 + 4 * x;
+                y0[x] = uint8_t((77 * p0[0] + 150 * p0[1] + 29 * p0[2] + 128) >> 8);
+                if (y1) y1[x] = uint8_t((77 * p1[0] + 150 * p1[1] + 29 * p1[2] + 128) >> 8);
+                r += p0[0] + p1[0];
+                g += p0[1] + p1[1];
+                b += p0[2] + p1[2];
+            }
+            // sums of four pixels: scale by 1/1024, offset by 128
+            U[size_t(cy) * cw + cx] = uint8_t(std::min(255, (-43 * r -  85 * g + 128 * b + (128 << 10) + 512) >> 10));
+            V[size_t(cy) * cw + cx] = uint8_t(std::min(255, (128 * r - 107 * g -  21 * b + (128 << 10) + 512) >> 10));
+        }
+    }
+
+    // wait for the turn of this frame, write it without holding the lock
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cond_.wait(lock, [&] { return next_write_ == slot.frame; });
+    }
+    {
+        TRACE_SCOPE("write_y4m");
+        bool ok = true;
+        if (slot.frame == 0) {
+            ok &= std::fprintf(file_, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", w, h, fps_) > 0;
+        }
+        ok &= std::fputs("FRAME\n", file_) >= 0;
+        ok &= std::fwrite(yuv.data(), 1, yuv.size(), file_) == yuv.size();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ok && !write_failed_) std::cerr << "Cannot write the Y4M stream to " << output_ << std::endl;
+        write_failed_ |= !ok;
+        ++next_write_;
+    }
+    done_cond_.notify_all();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+double FrameRecorder::average_capture_ms() const
+{
+    return capture_ms_ / std::max(1u, frames_ + dropped_);
+}
+
+
+double FrameRecorder::average_encode_ms() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return encode_ms_ / std::max(1u, encoded_);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void FrameRecorder::report(std::ostream& os) const
+{
+    os << "Recorded " << frames_ << " frames to " << (output_ == "-" ? "stdout" : output_);
+    if (dropped_) os << " (" << dropped_ << " dropped)";
+    os << ": capture " << average_capture_ms() << " ms/frame on the render thread (max "
+       << max_capture_ms_ << " ms), encoding " << average_encode_ms() << " ms/frame on "
+       << encoders_.size() << " encoder thread(s)" << std::endl;
+}
+
+
+//=============================================================================
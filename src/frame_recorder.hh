@@ -0,0 +1,151 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "gl.hh"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//=============================================================================
+
+
+/// Records the rendered frames as numbered PNG files or as a raw Y4M video
+/// stream. capture() only issues an asynchronous glReadPixels into a ring of
+/// pixel pack buffers (PBOs) and puts a fence behind it; a later capture()
+/// finds the fence passed and hands the mapped buffer to the encoder threads,
+/// which convert, compress and write the frame. The render thread thus never
+/// waits for the GPU, for encoding or for I/O, and capturing does not
+/// allocate. When all buffers are busy a frame is dropped, unless frames must
+/// not be dropped (headless, i.e. offline, rendering): then the render thread
+/// waits for the oldest buffer, and the time it waited is reported.
+///
+/// The encoders are threads of their own instead of jobs on the ThreadPool,
+/// whose queue allocates on the render thread; their png_encode() calls do
+/// not take the pool's workers from the render thread either.
+class FrameRecorder
+{
+public:
+
+    /// \param output "-" for a Y4M stream on stdout, a file name ending in
+    /// ".y4m" for a Y4M file, or else a printf pattern of the PNG files
+    /// (e.g. "frames/%05d.png"; ".../%05d.png" is appended if it has none).
+    /// The file name must have exactly one %d conversion (with an optional
+    /// width) and no other; a '%' in the directory is taken literally.
+    /// \param drop_frames drop frames when the encoders fall behind instead
+    /// of waiting for them
+    /// \param fps frame rate written into the Y4M header
+    FrameRecorder(const std::string& output, bool drop_frames, unsigned int fps = 60);
+
+    /// finish() and stop the encoders
+    ~FrameRecorder();
+
+    FrameRecorder(const FrameRecorder&) = delete;
+    FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+    /// Read back the color buffer of the current read framebuffer (GL
+    /// thread, before the buffer swap). The buffers are (re)created when the
+    /// size changes, after the frames of the old size are written.
+    void capture(int width, int height);
+
+    /// Write all frames still in flight and release the buffers (GL thread,
+    /// while the context exists).
+    void finish();
+
+    /// CPU time (ms) of the last capture() on the render thread
+    double last_capture_ms() const { return last_capture_ms_; }
+
+    /// averages over all captured frames: CPU time of capture() on the
+    /// render thread (including waits for a free buffer) and time to encode
+    /// and write a frame on an encoder thread
+    double average_capture_ms() const;
+    double average_encode_ms() const;
+
+    /// frames captured and frames dropped because all buffers were busy
+    unsigned int frames() const { return frames_; }
+    unsigned int dropped_frames() const { return dropped_; }
+
+    /// print frame counts and overheads
+    void report(std::ostream& os) const;
+
+private:
+
+    /// state of a buffer; READING and DONE belong to the GL thread,
+    /// QUEUED and ENCODING to the encoders (all protected by mutex_)
+    enum State { FREE, READING, QUEUED, ENCODING, DONE };
+
+    struct Slot {
+        GLuint buffer = 0;
+        GLsync fence = 0;
+        const uint8_t* data = nullptr;
+        State state = FREE;
+        /// number of the frame in the output
+        unsigned int frame = 0;
+    };
+
+    /// create the buffers for frames of the given size
+    void allocate(int width, int height);
+
+    /// Hand the frames whose fences have passed to the encoders and take
+    /// back the buffers they are done with; waits for the oldest frame in
+    /// flight if \c wait is set and no buffer is free (GL thread).
+    void poll(bool wait);
+
+    /// the frame read into a slot, oldest first, or -1 if none is
+    int oldest(State state) const;
+
+    /// encoder thread main loop
+    void encode();
+
+    /// write a frame as PNG file or Y4M frame (encoder thread)
+    void write_png(const Slot& slot, std::vector<uint8_t>& rgb, std::vector<uint8_t>& png);
+    void write_y4m(const Slot& slot, std::vector<uint8_t>& yuv);
+
+private:
+
+    std::string output_;
+    /// printf pattern of the PNG files
+    std::string pattern_;
+    bool y4m_;
+    bool drop_frames_;
+    unsigned int fps_;
+
+    /// Y4M stream (stdout or a file)
+    FILE* file_ = nullptr;
+
+    /// pixel pack buffers and whether they stay mapped all the time
+    std::vector<Slot> slots_;
+    bool persistent_ = false;
+    int width_ = 0, height_ = 0;
+
+    /// encoder threads, signalled through cond_ for new frames and
+    /// through done_cond_ for finished ones (and for the turn of a Y4M frame)
+    std::vector<std::thread> encoders_;
+    mutable std::mutex mutex_;
+    std::condition_variable cond_, done_cond_;
+    bool stop_ = false;
+    /// next Y4M frame to be written, so that frames appear in order
+    unsigned int next_write_ = 0;
+    /// encoding time summed over the frames written so far (ms)
+    double encode_ms_ = 0.0;
+    unsigned int encoded_ = 0;
+    bool write_failed_ = false;
+
+    /// statistics of the render thread
+    unsigned int frames_ = 0, dropped_ = 0;
+    double capture_ms_ = 0.0, last_capture_ms_ = 0.0, max_capture_ms_ = 0.0;
+};
+
+
+//=============================================================================
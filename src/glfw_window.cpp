@@ -8,7 +8,11 @@
 //=============================================================================
 #include "gl.hh"
 #include "glfw_window.hh"
+#include "trace.hh"
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <algorithm>
 //=============================================================================
 
 
@@ -18,14 +22,18 @@ GLFW_window *GLFW_window::instance__ = NULL;
 //-----------------------------------------------------------------------------
 
 
-GLFW_window::GLFW_window(const char* _title, int _width, int _height)
+GLFW_window::GLFW_window(const char* _title, int _width, int _height, bool _headless)
+    : headless_(_headless)
 {
+    glfwSetErrorCallback(error__);
+
+    // without a display, use the null platform (no windows, no input)
+    if (headless_)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+
     // initialize glfw window
     if (!glfwInit())
-    {
-        std::cerr << "Cannot initialize GLFW!\n";
-        exit(EXIT_FAILURE);
-    }
+        throw std::runtime_error("Cannot initialize GLFW!");
 
 
     // request core profile and OpenGL version 3.2
@@ -34,23 +42,42 @@ GLFW_window::GLFW_window(const char* _title, int _width, int _height)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
 
-    // try to create window
-    window_ = glfwCreateWindow(_width, _height, _title, NULL, NULL);
-    if (!window_) {
-        std::cerr << "Window creation failed!\n";
-        std::cerr << "Attempting fall-back (for INF03 machines)" << std::endl;
-
-        // Request OpenGL version 3.1
-        // Note: below version 3.2, we must request GLFW_OPENGL_ANY_PROFILE
-        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_ANY_PROFILE);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    if (headless_)
+    {
+        // the null platform needs a context that does not need a window
+        // system: EGL with Mesa's surfaceless platform, or else OSMesa
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
         window_ = glfwCreateWindow(_width, _height, _title, NULL, NULL);
-
+        if (!window_) {
+            std::cerr << "EGL context creation failed, trying OSMesa" << std::endl;
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+            window_ = glfwCreateWindow(_width, _height, _title, NULL, NULL);
+        }
         if (!window_) {
             glfwTerminate();
+            throw std::runtime_error("Headless context creation failed!");
+        }
+    }
+    else
+    {
+        // try to create window
+        window_ = glfwCreateWindow(_width, _height, _title, NULL, NULL);
+        if (!window_) {
             std::cerr << "Window creation failed!\n";
-            exit(EXIT_FAILURE);
+            std::cerr << "Attempting fall-back (for INF03 machines)" << std::endl;
+
+            // Request OpenGL version 3.1
+            // Note: below version 3.2, we must request GLFW_OPENGL_ANY_PROFILE
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_ANY_PROFILE);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+            window_ = glfwCreateWindow(_width, _height, _title, NULL, NULL);
+
+            if (!window_) {
+                glfwTerminate();
+                throw std::runtime_error("Window creation failed!");
+            }
         }
     }
 
@@ -60,7 +87,8 @@ GLFW_window::GLFW_window(const char* _title, int _width, int _height)
 
 
     // enable vsync
-    glfwSwapInterval(1);
+    if (!headless_)
+        glfwSwapInterval(1);
 
 
     // register glfw callbacks
@@ -71,10 +99,12 @@ GLFW_window::GLFW_window(const char* _title, int _width, int _height)
     // now that we have a GL context, initialize GLEW
     glewExperimental = GL_TRUE;
     GLenum err = glewInit();
-    if(err != GLEW_OK)
+    if (err != GLEW_OK && !(headless_ && glGetString(GL_VERSION)))
     {
-        std::cerr << "Error initializing GLEW: " << glewGetErrorString(err) << std::endl;
-        exit(1);
+        // (without a GLX display, GLEW fails on the GLX extensions after
+        // it has loaded all GL functions, which is fine for headless use)
+        glfwTerminate();
+        throw std::runtime_error(std::string("Error initializing GLEW: ") + (const char*)glewGetErrorString(err));
     }
 
 
@@ -82,11 +112,40 @@ GLFW_window::GLFW_window(const char* _title, int _width, int _height)
     std::cout << "GLEW   " << glewGetString(GLEW_VERSION) << std::endl;
     std::cout << "GL     " << glGetString(GL_VERSION) << std::endl;
     std::cout << "GLSL   " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
+    std::cout << "RENDERER " << glGetString(GL_RENDERER) << std::endl;
 
 
     // call glGetError once to clear error queue
     (void)glGetError();
 
+
+    // offscreen render target, bound for all of the following rendering
+    if (headless_)
+    {
+        fbo_width_  = _width;
+        fbo_height_ = _height;
+
+        glGenRenderbuffers(1, &fbo_color_);
+        glBindRenderbuffer(GL_RENDERBUFFER, fbo_color_);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, _width, _height);
+
+        glGenRenderbuffers(1, &fbo_depth_);
+        glBindRenderbuffer(GL_RENDERBUFFER, fbo_depth_);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, _width, _height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &fbo_);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, fbo_color_);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,  GL_RENDERBUFFER, fbo_depth_);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            glfwTerminate();
+            throw std::runtime_error("Offscreen framebuffer incomplete!");
+        }
+        std::cout << "Headless: rendering into a " << _width << "x" << _height << " framebuffer object" << std::endl;
+    }
+
     instance__ = this;
 }
 
@@ -96,6 +155,9 @@ GLFW_window::GLFW_window(const char* _title, int _width, int _height)
 
 GLFW_window::~GLFW_window()
 {
+    if (fbo_)       glDeleteFramebuffers(1, &fbo_);
+    if (fbo_color_) glDeleteRenderbuffers(1, &fbo_color_);
+    if (fbo_depth_) glDeleteRenderbuffers(1, &fbo_depth_);
     glfwTerminate();
 }
 
@@ -103,7 +165,7 @@ GLFW_window::~GLFW_window()
 //-----------------------------------------------------------------------------
 
 
-int GLFW_window::run()
+int GLFW_window::run(unsigned int _frames)
 {
     // initialize OpenGL
     initialize();
@@ -111,11 +173,19 @@ int GLFW_window::run()
     // query framebuffer width and height
     // call resize to initialize viewport
     int width, height;
-    glfwGetFramebufferSize(window_, &width, &height);
+    if (headless_) {
+        width  = fbo_width_;
+        height = fbo_height_;
+    }
+    else {
+        glfwGetFramebufferSize(window_, &width, &height);
+    }
     resize(width, height);
 
     // now run the event loop
-    while (!glfwWindowShouldClose(window_))
+    double start = glfwGetTime();
+    unsigned int frames = 0;
+    while (!glfwWindowShouldClose(window_) && (!_frames || frames < _frames))
     {
         // call timer function
         timer();
@@ -123,11 +193,31 @@ int GLFW_window::run()
         // draw scene
         paint();
 
-        // swap buffers
-        glfwSwapBuffers(window_);
+        // swap buffers (offscreen: wait for the frame instead)
+        {
+            TRACE_SCOPE("swap_buffers");
+            if (headless_)
+                glFinish();
+            else
+                glfwSwapBuffers(window_);
+        }
 
         // handle events
-        glfwPollEvents();
+        {
+            TRACE_SCOPE("poll_events");
+            glfwPollEvents();
+        }
+
+        frame_finished();
+        ++frames;
+    }
+
+    finalize();
+
+    if (headless_) {
+        double seconds = glfwGetTime() - start;
+        std::cout << "Headless: " << frames << " frames in " << seconds << " s ("
+                  << 1000.0 * seconds / std::max(1u, frames) << " ms/frame)" << std::endl;
     }
 
     glfwDestroyWindow(window_);
@@ -142,6 +232,7 @@ int GLFW_window::run()
 void GLFW_window::error__(int error, const char *description)
 {
     fputs(description, stderr);
+    fputc('\n', stderr);
 }
 
 
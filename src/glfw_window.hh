@@ -29,13 +29,18 @@ class GLFW_window
 public: //------------------------------------------------------ public methods
 
     /// constructor
-    GLFW_window(const char* _title="", int _width=0, int _height=0);
+    /// \param _headless render offscreen into a framebuffer object of the
+    /// given size, using GLFW's null platform with an EGL (surfaceless) or
+    /// OSMesa context, e.g. on machines without display or GPU
+    GLFW_window(const char* _title="", int _width=0, int _height=0, bool _headless=false);
 
     /// destructor
     virtual ~GLFW_window();
 
     /// main window loop
-    int run();
+    /// \param _frames stop after this many frames (0: run until the window
+    /// is closed, which never happens for a headless window)
+    int run(unsigned int _frames=0);
 
 
 
@@ -66,12 +71,27 @@ protected: //----------------------------------- callbacks as member functions
     /// may overload: handle idle timer
     virtual void timer() {}
 
+    /// may overload: called at the end of every frame (after the buffer swap)
+    virtual void frame_finished() {}
+
+    /// may overload: called after the last frame, while the OpenGL context
+    /// still exists
+    virtual void finalize() {}
+
 
 
 protected: //----------------------------------------------------- protected data
 
     /// GLFW window pointer
     GLFWwindow *window_;
+
+    /// whether we render offscreen (see constructor)
+    bool headless_;
+    /// offscreen framebuffer object and its color and depth renderbuffers
+    GLuint fbo_ = 0;
+    GLuint fbo_color_ = 0, fbo_depth_ = 0;
+    /// size of the offscreen framebuffer
+    int fbo_width_ = 0, fbo_height_ = 0;
 };
 
 
@@ -0,0 +1,216 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "gpu_profiler.hh"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+
+//=============================================================================
+
+
+GpuProfiler::~GpuProfiler()
+{
+    for (Frame& frame : frames_)
+        if (!frame.queries.empty())
+            glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void GpuProfiler::begin_frame()
+{
+    if (!initialized_) {
+        initialized_ = true;
+        available_ = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+        if (available_) {
+            GLint64 now = 0;
+            glGetInteger64v(GL_TIMESTAMP, &now);
+            gpu_epoch_ = now;
+            cpu_epoch_ = Tracer::now();
+        }
+    }
+    if (!available_) return;
+
+    assert(open_ < 0 && "unbalanced GpuProfiler::push()");
+    open_ = -1;
+
+    current_ = (current_ + 1) % FRAMES_IN_FLIGHT;
+    Frame& frame = frames_[current_];
+    if (frame.pending) resolve(frame);
+    frame.records.clear();
+    used_ = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+GLuint GpuProfiler::query()
+{
+    Frame& frame = frames_[current_];
+    if (used_ == frame.queries.size()) {
+        // grow the pool of this frame; it is reused from then on
+        size_t n = std::max<size_t>(16, frame.queries.size());
+        frame.queries.resize(frame.queries.size() + n);
+        glGenQueries((GLsizei)n, &frame.queries[frame.queries.size() - n]);
+    }
+    return frame.queries[used_++];
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void GpuProfiler::push(const char* name)
+{
+    if (!available_ || current_ < 0) return;
+
+    Frame& frame = frames_[current_];
+    Record record = { name, open_, query(), 0, 0 };
+    glQueryCounter(record.begin, GL_TIMESTAMP);
+    frame.records.push_back(record);
+    frame.pending = true;
+    open_ = (int)frame.records.size() - 1;
+}
+
+
+void GpuProfiler::pop()
+{
+    if (!available_ || current_ < 0) return;
+
+    assert(open_ >= 0 && "GpuProfiler::pop() without push()");
+    Record& record = frames_[current_].records[open_];
+    record.end = query();
+    glQueryCounter(record.end, GL_TIMESTAMP);
+    open_ = record.parent;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool GpuProfiler::AverageKey::operator<(const AverageKey& other) const
+{
+    if (parent != other.parent) return parent < other.parent;
+    return std::strcmp(name, other.name) < 0;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void GpuProfiler::resolve(Frame& frame)
+{
+    frame.pending = false;
+    if (history_.empty()) history_.resize(HISTORY_EVENTS);
+
+    for (Record& record : frame.records) {
+        // records are in push order, so the parent's average is known
+        const size_t root = size_t(-1);
+        AverageKey key = { record.parent < 0 ? root : frame.records[record.parent].average, record.name };
+        auto it = average_index_.find(key);
+        if (it == average_index_.end()) {
+            Average avg;
+            avg.path  = key.parent == root ? record.name : averages_[key.parent].path + "/" + record.name;
+            avg.depth = key.parent == root ? 0 : averages_[key.parent].depth + 1;
+            it = average_index_.emplace(key, averages_.size()).first;
+            averages_.push_back(avg);
+        }
+        record.average = it->second;
+
+        if (!record.end) continue; // never closed
+
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(record.begin, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(record.end,   GL_QUERY_RESULT, &end);
+        int64_t duration = (int64_t)(end - begin);
+
+        TraceEvent& event = history_[history_head_++ % HISTORY_EVENTS];
+        event = { record.name, "gpu", cpu_epoch_ + ((int64_t)begin - gpu_epoch_), duration, 0 };
+
+        // rolling average
+        Average& avg = averages_[record.average];
+        double ms = 1e-6 * duration;
+        double& slot = avg.samples[avg.count % AVERAGE_FRAMES];
+        avg.sum += ms - slot;
+        slot = ms;
+        ++avg.count;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+std::vector<std::pair<std::string, double>> GpuProfiler::averages() const
+{
+    std::vector<std::pair<std::string, double>> result;
+    for (const Average& avg : averages_) {
+        unsigned int n = std::min<unsigned int>(avg.count, AVERAGE_FRAMES);
+        result.emplace_back(avg.path, n ? avg.sum / n : 0.0);
+    }
+    return result;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void GpuProfiler::report(std::ostream& os) const
+{
+    if (!available_) {
+        os << "GPU profiler: timer queries not supported" << std::endl;
+        return;
+    }
+
+    os << "GPU time (average of the last " << AVERAGE_FRAMES << " frames):" << std::endl;
+    auto avgs = averages();
+    for (size_t i = 0; i < avgs.size(); ++i) {
+        const std::string& path = avgs[i].first;
+        std::string name = path.substr(path.rfind('/') + 1);
+        os << "  " << std::string(2 * averages_[i].depth, ' ') << std::left
+           << std::setw(24 - 2 * averages_[i].depth) << name << std::right
+           << std::fixed << std::setprecision(3) << std::setw(9) << avgs[i].second
+           << " ms" << std::defaultfloat << std::endl;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void GpuProfiler::trace_events(int64_t since, int tid, std::vector<TraceEvent>& events) const
+{
+    uint64_t begin = history_head_ > HISTORY_EVENTS ? history_head_ - HISTORY_EVENTS : 0;
+    for (uint64_t i = begin; i < history_head_; ++i) {
+        const TraceEvent& e = history_[i % HISTORY_EVENTS];
+        if (e.start + e.duration < since) continue;
+        events.push_back(e);
+        events.back().tid = tid;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void GpuProfiler::write_trace(std::ostream& os) const
+{
+    std::vector<TraceEvent> events;
+    trace_events(0, 0, events);
+    write_chrome_trace(os, events, { { 0, "GPU" } });
+}
+
+
+//=============================================================================
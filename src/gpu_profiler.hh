@@ -0,0 +1,154 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "gl.hh"
+#include "trace.hh"
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+//=============================================================================
+
+
+/// Profiler of the GPU time spent in named, nested scopes of a frame. Every
+/// scope puts a GL_TIMESTAMP query (glQueryCounter) at its start and end;
+/// unlike GL_TIME_ELAPSED queries, timestamps may nest and overlap. The
+/// queries of a frame are read back FRAMES_IN_FLIGHT frames later, when the
+/// GPU has long finished them, so profiling does not stall the pipeline.
+/// Per scope the profiler keeps a rolling average over the last frames and
+/// a history of recent scopes that is written as a Chrome trace. Once every
+/// scope has been seen, profiling a frame does not allocate.
+class GpuProfiler
+{
+public:
+
+    /// frames recorded before the oldest one is read back
+    static const int FRAMES_IN_FLIGHT = 4;
+    /// frames in the rolling averages
+    static const int AVERAGE_FRAMES = 64;
+    /// scopes kept for the trace
+    static const size_t HISTORY_EVENTS = 4096;
+
+    GpuProfiler() = default;
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    /// whether the GL supports timestamp queries (valid after the first frame)
+    bool available() const { return available_; }
+
+    /// start a frame; reads back the frame recorded FRAMES_IN_FLIGHT ago
+    void begin_frame();
+
+    /// open a scope nested into the currently open one; the name has to be
+    /// a string literal (it is stored as pointer)
+    void push(const char* name);
+
+    /// close the innermost open scope
+    void pop();
+
+    /// scope guard for push() and pop()
+    class Scope
+    {
+    public:
+        Scope(GpuProfiler& profiler, const char* name) : profiler_(profiler) { profiler_.push(name); }
+        ~Scope() { profiler_.pop(); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        GpuProfiler& profiler_;
+    };
+
+    /// rolling average (ms) of every scope, identified by its path of names
+    /// separated by '/', in the order the scopes were first seen
+    std::vector<std::pair<std::string, double>> averages() const;
+
+    /// write the rolling averages as an indented table
+    void report(std::ostream& os) const;
+
+    /// Append the recent scopes that ended at or after time
+    /// since as events of thread tid. GPU timestamps are mapped to the
+    /// steady clock, so the events line up with the CPU trace.
+    void trace_events(int64_t since, int tid, std::vector<TraceEvent>& events) const;
+
+    /// write the recent scopes as Chrome trace_event JSON
+    void write_trace(std::ostream& os) const;
+
+private:
+
+    /// a scope as recorded during a frame
+    struct Record {
+        const char* name;
+        int parent;
+        GLuint begin, end;
+        /// index of the scope's rolling average (set when resolved)
+        size_t average;
+    };
+
+    /// the queries and scopes of one frame in flight
+    struct Frame {
+        std::vector<GLuint> queries;
+        std::vector<Record> records;
+        bool pending = false;
+    };
+
+    /// a scope identified by its parent's average and its name
+    struct AverageKey {
+        size_t parent;
+        const char* name;
+        bool operator<(const AverageKey& other) const;
+    };
+
+    /// rolling average of a scope
+    struct Average {
+        std::string path;
+        int depth;
+        double samples[AVERAGE_FRAMES] = {};
+        double sum = 0.0;
+        unsigned int count = 0;
+    };
+
+    /// read the queries of a frame (waiting for them) and update the
+    /// averages and the history
+    void resolve(Frame& frame);
+
+    /// a query object of the current frame
+    GLuint query();
+
+private:
+
+    bool initialized_ = false;
+    bool available_ = false;
+
+    Frame frames_[FRAMES_IN_FLIGHT];
+    int current_ = -1;
+    /// number of queries of the current frame in use
+    size_t used_ = 0;
+    /// index of the innermost open scope, -1 if none
+    int open_ = -1;
+
+    /// GPU timestamp and steady clock (ns) at the same moment
+    int64_t gpu_epoch_ = 0;
+    int64_t cpu_epoch_ = 0;
+
+    std::vector<Average> averages_;
+    std::map<AverageKey, size_t> average_index_;
+
+    /// ring of the recent scopes and the number of scopes ever written
+    std::vector<TraceEvent> history_;
+    uint64_t history_head_ = 0;
+};
+
+
+//=============================================================================
@@ -0,0 +1,88 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "instance_buffer.hh"
+#include <cstddef>
+#include <algorithm>
+
+//=============================================================================
+
+
+Instance::Instance(const mat4& m, float _layer)
+    : layer(_layer)
+{
+    std::copy_n(m.data(), 16, model);
+    mat3 n = transpose(inverse(mat3(m)));
+    std::copy_n(n.data(), 9, normal);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+InstanceBuffer::~InstanceBuffer()
+{
+    if (vbo_) glDeleteBuffers(1, &vbo_);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void InstanceBuffer::upload(const Instance* instances, size_t n)
+{
+    if (!vbo_) glGenBuffers(1, &vbo_);
+
+    size_ = n;
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    if (size_ > capacity_) {
+        capacity_ = size_;
+        glBufferData(GL_ARRAY_BUFFER, capacity_ * sizeof(Instance), instances, GL_STREAM_DRAW);
+    }
+    else if (size_) {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size_ * sizeof(Instance), instances);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void InstanceBuffer::attach()
+{
+    if (!vbo_) glGenBuffers(1, &vbo_);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+
+    // a mat4 attribute occupies four consecutive vec4 locations
+    for (GLuint c = 0; c < 4; ++c) {
+        GLuint loc = INSTANCE_ATTRIB_MODEL + c;
+        glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                              (const void*)(offsetof(Instance, model) + 4 * c * sizeof(float)));
+        glVertexAttribDivisor(loc, 1);
+        glEnableVertexAttribArray(loc);
+    }
+
+    // a mat3 attribute occupies three consecutive vec3 locations
+    for (GLuint c = 0; c < 3; ++c) {
+        GLuint loc = INSTANCE_ATTRIB_NORMAL + c;
+        glVertexAttribPointer(loc, 3, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                              (const void*)(offsetof(Instance, normal) + 3 * c * sizeof(float)));
+        glVertexAttribDivisor(loc, 1);
+        glEnableVertexAttribArray(loc);
+    }
+
+    glVertexAttribPointer(INSTANCE_ATTRIB_LAYER, 1, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                          (const void*)offsetof(Instance, layer));
+    glVertexAttribDivisor(INSTANCE_ATTRIB_LAYER, 1);
+    glEnableVertexAttribArray(INSTANCE_ATTRIB_LAYER);
+}
+
+
+//=============================================================================
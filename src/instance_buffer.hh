@@ -0,0 +1,76 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "gl.hh"
+#include "glmath.hh"
+#include <vector>
+
+/// per-instance data of an instanced draw call (tightly packed, uploaded as is)
+struct Instance
+{
+    /// set model matrix, world-space normal matrix and texture layer
+    Instance() {}
+    Instance(const mat4& model, float layer);
+
+    /// model matrix (column-major) -> attributes 3..6
+    float model[16];
+    /// transpose(inverse(model)), upper 3x3 (column-major) -> attributes 7..9
+    float normal[9];
+    /// layer of the texture array -> attribute 10
+    float layer;
+};
+
+/// vertex attribute locations used for the per-instance data
+enum InstanceAttribute {
+    INSTANCE_ATTRIB_MODEL  = 3,
+    INSTANCE_ATTRIB_NORMAL = 7,
+    INSTANCE_ATTRIB_LAYER  = 10
+};
+
+/// class that manages a GPU buffer holding per-instance attributes
+class InstanceBuffer
+{
+public:
+
+    /// default constructor
+    InstanceBuffer() {}
+
+    // InstanceBuffer objects may not be assigned or copied, or both copies will
+    // believe they own the OpenGL buffer exclusively.
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    /// destructor
+    ~InstanceBuffer();
+
+    /// upload the instances; the buffer only grows, so uploads of the same
+    /// number of instances every frame do not reallocate GPU memory
+    void upload(const Instance* instances, size_t n);
+    void upload(const std::vector<Instance>& instances) { upload(instances.data(), instances.size()); }
+
+    /// set up the per-instance vertex attributes in the currently bound
+    /// vertex array object
+    void attach();
+
+    /// number of instances uploaded last
+    GLsizei size() const { return size_; }
+
+    /// returns the buffer id
+    GLuint id() const { return vbo_; }
+
+private:
+
+    /// vertex buffer object
+    GLuint vbo_ = 0;
+    /// number of instances uploaded last
+    GLsizei size_ = 0;
+    /// number of instances the buffer storage can hold
+    GLsizei capacity_ = 0;
+};
@@ -0,0 +1,111 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include <vector>
+#include <cstddef>
+#include <iosfwd>
+
+//=============================================================================
+
+
+/// classical orbital elements of a Keplerian orbit (angles in radians)
+struct KeplerElements
+{
+    /// semi-major axis
+    float a = 1.0f;
+    /// eccentricity (0 <= e < 1)
+    float e = 0.0f;
+    /// inclination of the orbit plane against the reference (x-z) plane
+    float i = 0.0f;
+    /// longitude of the ascending node
+    float node = 0.0f;
+    /// argument of periapsis
+    float peri = 0.0f;
+    /// mean anomaly
+    float M = 0.0f;
+};
+
+
+/// Solve Kepler's equation E - e sin(E) = M for the eccentric anomaly E of n
+/// orbits. Uses a fixed number of Newton iterations and a polynomial sin/cos,
+/// so the loop has no data-dependent branches and is vectorized by the
+/// compiler. Accurate to float precision for e <= 0.7 (see kepler.cpp).
+void solve_kepler(const float* M, const float* e, float* E, size_t n);
+
+/// reference solution of Kepler's equation in double precision (iterated to
+/// convergence)
+double solve_kepler_reference(double M, double e);
+
+
+/// Set of Keplerian orbits stored as structure of arrays. The arrays are
+/// padded to a multiple of LANES entries, so that evaluation always works on
+/// full lane groups (one AVX register of floats per group).
+class KeplerOrbits
+{
+public:
+
+    /// number of orbits evaluated together
+    static const size_t LANES = 8;
+
+    /// number of orbits
+    size_t size() const { return size_; }
+
+    /// number of entries of the padded arrays (a multiple of LANES)
+    size_t padded_size() const { return a_.size(); }
+
+    /// change the number of orbits; new orbits are circles of radius 1
+    void resize(size_t n);
+
+    /// add an orbit and return its index
+    size_t add(const KeplerElements& elements);
+
+    /// set the elements of orbit \c idx
+    void set(size_t idx, const KeplerElements& elements);
+
+    /// mean anomalies (padded array), e.g. for advancing the orbits in time
+    float* mean_anomaly() { return M_.data(); }
+    const float* mean_anomaly() const { return M_.data(); }
+
+    /// Compute positions relative to the orbit center for orbits
+    /// [begin, end); begin must be a multiple of LANES and end either a
+    /// multiple of LANES or size(). The orbits' reference plane is the x-z
+    /// plane (y is up); with all angles zero, an orbit starts on the +x axis
+    /// and moves towards +z, like Solar_viewer's original circular orbits.
+    /// The output arrays must hold padded_size() entries.
+    void positions(size_t begin, size_t end, float* x, float* y, float* z) const;
+
+    /// Compute velocities for orbits [begin, end) (same requirements as for
+    /// positions()), given the mean motion of every orbit in radians per unit
+    /// of time. Velocities are in semi-major axis units per unit of time.
+    void velocities(size_t begin, size_t end, const float* mean_motion,
+                    float* vx, float* vy, float* vz) const;
+
+private:
+
+    /// number of orbits (without padding)
+    size_t size_ = 0;
+
+    /// semi-major axis, eccentricity and mean anomaly
+    std::vector<float> a_, e_, M_;
+    /// semi-minor axis factor sqrt(1 - e^2)
+    std::vector<float> b_;
+    /// orbit plane basis: P points to the periapsis, Q 90 degrees ahead
+    std::vector<float> px_, py_, pz_, qx_, qy_, qz_;
+    /// scratch array for the eccentric anomalies
+    mutable std::vector<float> E_;
+};
+
+
+/// Check solve_kepler() against solve_kepler_reference() on a grid of mean
+/// anomalies and eccentricities up to 0.7 and write the largest errors, then
+/// time solve_kepler() and KeplerOrbits::positions() against the reference
+/// (bodies per second on one thread). Returns false if an error exceeds the
+/// tolerance.
+bool kepler_benchmark(std::ostream& os);
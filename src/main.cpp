@@ -15,6 +15,18 @@
 #endif
 
 #include "solar_viewer.hh"
+#include "nbody.hh"
+#include "kepler.hh"
+#include "frame_arena.hh"
+#include "texture.hh"
+#include "png_decoder.hh"
+#include "png_encoder.hh"
+#include "procedural_texture.hh"
+#include "trace.hh"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
 
 //=============================================================================
 
@@ -27,9 +39,111 @@ int main(int argc, char *argv[])
     // any signs of a an application crash!
     SetErrorMode(0);
 #endif
+
+    // label the render thread before the viewer and the thread pools start
+    // threads of their own that trace
+    Tracer::instance().set_thread_name("main");
+
+    // command line options
+    bool headless = false, png_textures = false, shader_cache = true;
+    unsigned int frames = 0;
+    std::string bench, bench_output, trace, record;
+    int width = 640, height = 480;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--nbody-bench") {
+            // compare Barnes-Hut with direct summation and exit
+            nbody_benchmark(std::cout);
+            return 0;
+        }
+        else if (arg == "--kepler-bench") {
+            // check the Kepler solver against the reference, time it and exit
+            return kepler_benchmark(std::cout) ? 0 : 1;
+        }
+        else if (arg == "--arena-bench") {
+            // compare the frame arena with the default heap and exit
+            frame_arena_benchmark(std::cout);
+            return 0;
+        }
+        else if (arg == "--flip-bench") {
+            // time the vertical flip of the largest textures and exit
+            texture_flip_benchmark(std::cout);
+            return 0;
+        }
+        else if (arg == "--png-bench") {
+            // time png decoding and encoding against lodepng and exit
+            png_decode_benchmark(std::cout);
+            std::cout << std::endl;
+            png_encode_benchmark(std::cout);
+            return 0;
+        }
+        else if (arg == "--procedural-bench") {
+            // time the generation of the sun halo and exit
+            procedural_texture_benchmark(std::cout);
+            return 0;
+        }
+        else if (arg == "--headless") {
+            headless = true;
+        }
+        else if (arg == "--png-textures") {
+            png_textures = true;
+        }
+        else if (arg == "--no-shader-cache") {
+            shader_cache = false;
+        }
+        else if (arg == "--bench" && i + 1 < argc) {
+            bench = argv[++i];
+        }
+        else if (arg == "--bench-out" && i + 1 < argc) {
+            bench_output = argv[++i];
+        }
+        else if (arg == "--record" && i + 1 < argc) {
+            record = argv[++i];
+        }
+        else if (arg == "--trace" && i + 1 < argc) {
+            trace = argv[++i];
+        }
+        else if (arg == "--frames" && i + 1 < argc) {
+            frames = std::atoi(argv[++i]);
+        }
+        else if (arg == "--size" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                std::cerr << "Invalid size " << argv[i] << " (expected WIDTHxHEIGHT)" << std::endl;
+                return 1;
+            }
+        }
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--headless] [--frames N] [--size WIDTHxHEIGHT] [--png-textures] [--no-shader-cache]"
+                      << " [--bench SCENARIO [--bench-out FILE]] [--record FILES|FILE.y4m|-] [--trace FILE] [--nbody-bench] [--kepler-bench] [--arena-bench] [--flip-bench] [--png-bench] [--procedural-bench]" << std::endl
+                      << "Benchmark scenarios: " << Solar_viewer::benchmark_scenarios() << std::endl;
+            return 1;
+        }
+    }
+
+    // a benchmark measures --frames frames and then closes the window itself
+    unsigned int bench_frames = 0;
+    if (!bench.empty()) {
+        bench_frames = frames ? frames : 600;
+        frames = 0;
+        if (bench_output.empty()) bench_output = "bench_" + bench + ".json";
+    }
+
+    // a headless run has to end by itself
+    else if (headless && frames == 0) frames = 100;
+
+    // the video stream takes stdout, the messages go to stderr
+    if (record == "-") std::cout.rdbuf(std::cerr.rdbuf());
+
+    if (!shader_cache) Shader::set_binary_cache({});
+
     try {
-        Solar_viewer window("Solar System", 640, 480);
-        return window.run();
+        Solar_viewer window("Solar System", width, height, headless);
+        if (png_textures) window.use_png_textures();
+        if (!bench.empty()) window.enable_benchmark(bench, bench_frames, bench_output);
+        if (!record.empty()) window.enable_recording(record);
+        int result = window.run(frames);
+        if (!trace.empty()) window.write_trace(trace, 0.0);
+        return result;
     } catch (std::runtime_error const &e) {
         std::cerr << "FATAL ERROR: "
             << e.what()
@@ -0,0 +1,698 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "nbody.hh"
+#include "thread_pool.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <random>
+
+//=============================================================================
+
+namespace {
+
+/// bits per coordinate of the Morton codes (3 * 21 = 63 bits)
+const int MORTON_BITS = 21;
+
+/// cells with at most this many particles are not subdivided further
+const uint32_t LEAF_SIZE = 16;
+
+typedef std::pair<uint64_t, uint32_t> Key;
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+/// spread the lower 21 bits of v to every third bit
+uint64_t spread_bits(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v <<  8) & 0x100f00f00f00f00fULL;
+    v = (v | v <<  4) & 0x10c30c30c30c30c3ULL;
+    v = (v | v <<  2) & 0x1249249249249249ULL;
+    return v;
+}
+
+
+/// first key in [begin, end) whose octant digit at the given level exceeds oct
+/// (keys of one cell share all higher digits, so the digits are sorted)
+uint32_t octant_end(const Key* keys, uint32_t begin, uint32_t end, int level, unsigned oct)
+{
+    const int shift = 3 * (MORTON_BITS - 1 - level);
+    return std::partition_point(keys + begin, keys + end, [=](const Key& k) {
+        return ((k.first >> shift) & 7) <= oct;
+    }) - keys;
+}
+
+
+/// Softened gravity of the particles [begin, end) at p, accumulated into
+/// (ax, ay, az). Eight independent partial sums let the compiler vectorize
+/// the loop without reordering a single floating point reduction.
+void direct_sum(float px, float py, float pz,
+                const float* __restrict x, const float* __restrict y,
+                const float* __restrict z, const float* __restrict m,
+                size_t begin, size_t end, float eps2,
+                float& ax, float& ay, float& az)
+{
+    const int L = 8;
+    float sx[L] = {}, sy[L] = {}, sz[L] = {};
+
+    size_t j = begin;
+    for (; j + L <= end; j += L) {
+        for (int l = 0; l < L; ++l) {
+            float dx = x[j+l] - px, dy = y[j+l] - py, dz = z[j+l] - pz;
+            float inv = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
+            float f = m[j+l] * inv * inv * inv;
+            sx[l] += f * dx;
+            sy[l] += f * dy;
+            sz[l] += f * dz;
+        }
+    }
+    for (; j < end; ++j) {
+        float dx = x[j] - px, dy = y[j] - py, dz = z[j] - pz;
+        float inv = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
+        float f = m[j] * inv * inv * inv;
+        sx[0] += f * dx;
+        sy[0] += f * dy;
+        sz[0] += f * dz;
+    }
+
+    for (int l = 0; l < L; ++l) {
+        ax += sx[l];
+        ay += sy[l];
+        az += sz[l];
+    }
+}
+
+
+/// half a leapfrog kick: v += a dt/2
+void kick(size_t begin, size_t end, float dt,
+          float* __restrict vx, float* __restrict vy, float* __restrict vz,
+          const float* __restrict ax, const float* __restrict ay, const float* __restrict az)
+{
+    const float h = 0.5f * dt;
+    for (size_t i = begin; i < end; ++i) {
+        vx[i] += h * ax[i];
+        vy[i] += h * ay[i];
+        vz[i] += h * az[i];
+    }
+}
+
+
+/// leapfrog drift: x += v dt
+void drift(size_t begin, size_t end, float dt,
+           float* __restrict x, float* __restrict y, float* __restrict z,
+           const float* __restrict vx, const float* __restrict vy, const float* __restrict vz)
+{
+    for (size_t i = begin; i < end; ++i) {
+        x[i] += dt * vx[i];
+        y[i] += dt * vy[i];
+        z[i] += dt * vz[i];
+    }
+}
+
+}
+
+
+//=============================================================================
+
+
+void NBody::clear()
+{
+    for (auto* v : { &x_, &y_, &z_, &vx_, &vy_, &vz_, &ax_, &ay_, &az_, &m_ })
+        v->clear();
+    nodes_.clear();
+    acc_valid_ = false;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+size_t NBody::add(float mass, const vec3& p, const vec3& v)
+{
+    x_.push_back(p.x);   y_.push_back(p.y);   z_.push_back(p.z);
+    vx_.push_back(v.x);  vy_.push_back(v.y);  vz_.push_back(v.z);
+    ax_.push_back(0.0f); ay_.push_back(0.0f); az_.push_back(0.0f);
+    m_.push_back(mass);
+    acc_valid_ = false;
+    return m_.size() - 1;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void NBody::step(float dt)
+{
+    ThreadPool& pool = ThreadPool::instance();
+    const size_t n = size();
+
+    if (!acc_valid_) compute_accelerations();
+
+    pool.parallel_for(n, 4096, [&](size_t begin, size_t end) {
+        kick (begin, end, dt, vx_.data(), vy_.data(), vz_.data(), ax_.data(), ay_.data(), az_.data());
+        drift(begin, end, dt, x_.data(), y_.data(), z_.data(), vx_.data(), vy_.data(), vz_.data());
+    });
+
+    compute_accelerations();
+
+    pool.parallel_for(n, 4096, [&](size_t begin, size_t end) {
+        kick(begin, end, dt, vx_.data(), vy_.data(), vz_.data(), ax_.data(), ay_.data(), az_.data());
+    });
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void NBody::compute_accelerations()
+{
+    ThreadPool& pool = ThreadPool::instance();
+    const size_t n = size();
+    const float eps2 = eps_ * eps_;
+    std::atomic<size_t> interactions(0);
+
+    auto start = Clock::now();
+
+    if (method_ == BARNES_HUT) {
+        build_tree();
+        stats_.build_seconds += seconds_since(start);
+        start = Clock::now();
+
+        // One walk per leaf collects the cells and particles acting on all
+        // of the leaf's particles; each of those then sums over this list
+        // with the vectorized kernel.
+        pool.parallel_for(leaves_.size(), 16, [&](size_t begin, size_t end) {
+            thread_local std::vector<float> lx, ly, lz, lm;
+            size_t count = 0;
+            for (size_t l = begin; l < end; ++l) {
+                const Node& leaf = nodes_[leaves_[l]];
+                interaction_list(leaf, lx, ly, lz, lm);
+                for (uint32_t k = leaf.begin; k < leaf.end; ++k) {
+                    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+                    direct_sum(sx_[k], sy_[k], sz_[k], lx.data(), ly.data(), lz.data(), lm.data(),
+                               0, lm.size(), eps2, ax, ay, az);
+                    uint32_t i = keys_[k].second;
+                    ax_[i] = ax;
+                    ay_[i] = ay;
+                    az_[i] = az;
+                }
+                count += (leaf.end - leaf.begin) * lm.size();
+            }
+            interactions += count;
+        });
+    }
+    else {
+        pool.parallel_for(n, 64, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                float ax = 0.0f, ay = 0.0f, az = 0.0f;
+                direct_sum(x_[i], y_[i], z_[i], x_.data(), y_.data(), z_.data(), m_.data(),
+                           0, n, eps2, ax, ay, az);
+                ax_[i] = ax;
+                ay_[i] = ay;
+                az_[i] = az;
+            }
+        });
+        interactions = n * n;
+    }
+
+    stats_.force_seconds += seconds_since(start);
+    stats_.interactions += interactions;
+    ++stats_.evaluations;
+    acc_valid_ = true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+vec3 NBody::acceleration(size_t i) const
+{
+    return vec3(ax_[i], ay_[i], az_[i]);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+vec3 NBody::acceleration_at(const vec3& p) const
+{
+    if (method_ == BARNES_HUT && !nodes_.empty()) {
+        size_t count = 0;
+        return tree_acceleration(p.x, p.y, p.z, count);
+    }
+
+    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+    direct_sum(p.x, p.y, p.z, x_.data(), y_.data(), z_.data(), m_.data(),
+               0, size(), eps_ * eps_, ax, ay, az);
+    return vec3(ax, ay, az);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+vec3 NBody::tree_acceleration(float px, float py, float pz, size_t& interactions) const
+{
+    const float eps2 = eps_ * eps_;
+    const Node* nodes = nodes_.data();
+    const size_t n_nodes = nodes_.size();
+    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+
+    // stackless depth-first walk: skip a subtree if it is far enough away,
+    // otherwise descend into its first child (the next node)
+    size_t k = 0;
+    while (k < n_nodes) {
+        const Node& node = nodes[k];
+        float dx = node.x - px, dy = node.y - py, dz = node.z - pz;
+        float d2 = dx * dx + dy * dy + dz * dz;
+
+        if (d2 > node.open2) {
+            float inv = 1.0f / std::sqrt(d2 + eps2);
+            float f = node.m * inv * inv * inv;
+            ax += f * dx;
+            ay += f * dy;
+            az += f * dz;
+            ++interactions;
+            k += node.skip;
+        }
+        else if (node.skip == 1) {
+            direct_sum(px, py, pz, sx_.data(), sy_.data(), sz_.data(), sm_.data(),
+                       node.begin, node.end, eps2, ax, ay, az);
+            interactions += node.end - node.begin;
+            ++k;
+        }
+        else {
+            ++k;
+        }
+    }
+
+    return vec3(ax, ay, az);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void NBody::interaction_list(const Node& leaf, std::vector<float>& lx, std::vector<float>& ly,
+                             std::vector<float>& lz, std::vector<float>& lm) const
+{
+    lx.clear(); ly.clear(); lz.clear(); lm.clear();
+
+    // bounding sphere of the leaf's particles
+    float lo[3] = { sx_[leaf.begin], sy_[leaf.begin], sz_[leaf.begin] };
+    float hi[3] = { lo[0], lo[1], lo[2] };
+    for (uint32_t k = leaf.begin + 1; k < leaf.end; ++k) {
+        lo[0] = std::min(lo[0], sx_[k]);  hi[0] = std::max(hi[0], sx_[k]);
+        lo[1] = std::min(lo[1], sy_[k]);  hi[1] = std::max(hi[1], sy_[k]);
+        lo[2] = std::min(lo[2], sz_[k]);  hi[2] = std::max(hi[2], sz_[k]);
+    }
+    const float cx = 0.5f * (lo[0] + hi[0]), cy = 0.5f * (lo[1] + hi[1]), cz = 0.5f * (lo[2] + hi[2]);
+    const float r = 0.5f * std::sqrt((hi[0] - lo[0]) * (hi[0] - lo[0]) +
+                                     (hi[1] - lo[1]) * (hi[1] - lo[1]) +
+                                     (hi[2] - lo[2]) * (hi[2] - lo[2]));
+
+    // A cell may act as a point mass if the opening criterion holds for
+    // the point of the sphere closest to its center of mass, i.e. for every
+    // particle of the leaf.
+    const Node* nodes = nodes_.data();
+    const size_t n_nodes = nodes_.size();
+    size_t k = 0;
+    while (k < n_nodes) {
+        const Node& node = nodes[k];
+        float dx = node.x - cx, dy = node.y - cy, dz = node.z - cz;
+        float d = std::sqrt(dx * dx + dy * dy + dz * dz) - r;
+
+        if (d > 0.0f && d * d > node.open2) {
+            lx.push_back(node.x);
+            ly.push_back(node.y);
+            lz.push_back(node.z);
+            lm.push_back(node.m);
+            k += node.skip;
+        }
+        else if (node.skip == 1) {
+            lx.insert(lx.end(), &sx_[node.begin], &sx_[node.end]);
+            ly.insert(ly.end(), &sy_[node.begin], &sy_[node.end]);
+            lz.insert(lz.end(), &sz_[node.begin], &sz_[node.end]);
+            lm.insert(lm.end(), &sm_[node.begin], &sm_[node.end]);
+            ++k;
+        }
+        else {
+            ++k;
+        }
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void NBody::build_tree()
+{
+    ThreadPool& pool = ThreadPool::instance();
+    const uint32_t n = size();
+    nodes_.clear();
+    if (n == 0) return;
+
+    // fixed blocks for the reductions and the run sorting
+    const size_t n_blocks = std::min<size_t>(4 * pool.concurrency(), std::max<size_t>(1, n / 4096));
+    const size_t block = (n + n_blocks - 1) / n_blocks;
+
+    // bounding cube
+    const float inf = std::numeric_limits<float>::max();
+    std::vector<float>& bounds = bounds_;
+    bounds.resize(6 * n_blocks);
+    pool.parallel_for(n_blocks, 1, [&](size_t b0, size_t b1) {
+        for (size_t b = b0; b < b1; ++b) {
+            float lo[3] = { inf, inf, inf }, hi[3] = { -inf, -inf, -inf };
+            for (size_t i = b * block, end = std::min<size_t>(n, (b + 1) * block); i < end; ++i) {
+                lo[0] = std::min(lo[0], x_[i]);  hi[0] = std::max(hi[0], x_[i]);
+                lo[1] = std::min(lo[1], y_[i]);  hi[1] = std::max(hi[1], y_[i]);
+                lo[2] = std::min(lo[2], z_[i]);  hi[2] = std::max(hi[2], z_[i]);
+            }
+            std::copy(lo, lo + 3, &bounds[6 * b]);
+            std::copy(hi, hi + 3, &bounds[6 * b + 3]);
+        }
+    });
+    float lo[3] = { inf, inf, inf }, hi[3] = { -inf, -inf, -inf };
+    for (size_t b = 0; b < n_blocks; ++b) {
+        for (int c = 0; c < 3; ++c) {
+            lo[c] = std::min(lo[c], bounds[6 * b + c]);
+            hi[c] = std::max(hi[c], bounds[6 * b + 3 + c]);
+        }
+    }
+    float half = 0.0f;
+    for (int c = 0; c < 3; ++c) half = std::max(half, 0.5f * (hi[c] - lo[c]));
+    half = half * 1.001f + 1e-6f;
+    const float corner[3] = { 0.5f * (lo[0] + hi[0]) - half,
+                              0.5f * (lo[1] + hi[1]) - half,
+                              0.5f * (lo[2] + hi[2]) - half };
+
+    // Morton codes
+    const float scale = float(1 << MORTON_BITS) / (2.0f * half);
+    const int max_cell = (1 << MORTON_BITS) - 1;
+    keys_.resize(n);
+    keys_tmp_.resize(n);
+    pool.parallel_for(n, 4096, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            int qx = std::min(max_cell, std::max(0, int((x_[i] - corner[0]) * scale)));
+            int qy = std::min(max_cell, std::max(0, int((y_[i] - corner[1]) * scale)));
+            int qz = std::min(max_cell, std::max(0, int((z_[i] - corner[2]) * scale)));
+            keys_[i] = Key(spread_bits(qx) << 2 | spread_bits(qy) << 1 | spread_bits(qz), uint32_t(i));
+        }
+    });
+
+    // sort the blocks in parallel, then merge pairs of runs in parallel
+    pool.parallel_for(n_blocks, 1, [&](size_t b0, size_t b1) {
+        for (size_t b = b0; b < b1; ++b)
+            std::sort(keys_.begin() + std::min<size_t>(n, b * block),
+                      keys_.begin() + std::min<size_t>(n, (b + 1) * block));
+    });
+    for (size_t width = block; width < n; width *= 2) {
+        size_t pairs = (n + 2 * width - 1) / (2 * width);
+        pool.parallel_for(pairs, 1, [&](size_t p0, size_t p1) {
+            for (size_t p = p0; p < p1; ++p) {
+                size_t lo = p * 2 * width;
+                size_t mid = std::min<size_t>(n, lo + width), hi = std::min<size_t>(n, lo + 2 * width);
+                std::merge(keys_.begin() + lo, keys_.begin() + mid,
+                           keys_.begin() + mid, keys_.begin() + hi, keys_tmp_.begin() + lo);
+            }
+        });
+        keys_.swap(keys_tmp_);
+    }
+
+    // particles in Morton order
+    sx_.resize(n); sy_.resize(n); sz_.resize(n); sm_.resize(n);
+    pool.parallel_for(n, 4096, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            uint32_t i = keys_[k].second;
+            sx_[k] = x_[i];
+            sy_[k] = y_[i];
+            sz_[k] = z_[i];
+            sm_[k] = m_[i];
+        }
+    });
+
+    // Split the top of the tree serially into cells small enough to give
+    // every thread several of them, build those subtrees in parallel, and
+    // splice them into the node array. Since nodes only refer to each other
+    // by relative offsets (skip), subtrees can be copied as they are.
+    std::vector<PlanEntry>& entries = plan_;
+    entries.clear();
+    const uint32_t cutoff = std::max<uint32_t>(4 * LEAF_SIZE, n / (8 * pool.concurrency()));
+    int n_subtrees = 0;
+
+    // (recursive lambdas take themselves as argument; a std::function would allocate)
+    auto plan = [&](auto& self, uint32_t begin, uint32_t end, int level, float h) -> void {
+        size_t idx = entries.size();
+        entries.push_back({ begin, end, level, h, 0, -1 });
+        if (end - begin <= cutoff || level == MORTON_BITS) {
+            entries[idx].subtree = n_subtrees++;
+            return;
+        }
+        uint32_t b = begin;
+        for (unsigned oct = 0; oct < 8; ++oct) {
+            uint32_t e = octant_end(keys_.data(), b, end, level, oct);
+            if (e > b) {
+                self(self, b, e, level + 1, 0.5f * h);
+                ++entries[idx].children;
+            }
+            b = e;
+        }
+    };
+    plan(plan, 0, n, 0, half);
+
+    std::vector<const PlanEntry*>& tasks = tasks_;
+    tasks.assign(n_subtrees, nullptr);
+    for (const PlanEntry& e : entries)
+        if (e.subtree >= 0) tasks[e.subtree] = &e;
+    if (subtrees_.size() < tasks.size()) subtrees_.resize(tasks.size());
+
+    pool.parallel_for(tasks.size(), 1, [&](size_t t0, size_t t1) {
+        for (size_t t = t0; t < t1; ++t) {
+            subtrees_[t].clear();
+            build_subtree(subtrees_[t], tasks[t]->begin, tasks[t]->end, tasks[t]->level, tasks[t]->half);
+        }
+    });
+
+    const float inv_theta2 = 1.0f / (theta_ * theta_);
+    size_t next = 0;
+    auto assemble = [&](auto& self) -> uint32_t {
+        const PlanEntry& e = entries[next++];
+        uint32_t idx = nodes_.size();
+        if (e.subtree >= 0) {
+            const std::vector<Node>& sub = subtrees_[e.subtree];
+            nodes_.insert(nodes_.end(), sub.begin(), sub.end());
+            return idx;
+        }
+
+        nodes_.push_back(Node());
+        float m = 0.0f, mx = 0.0f, my = 0.0f, mz = 0.0f;
+        for (int c = 0; c < e.children; ++c) {
+            const Node& child = nodes_[self(self)];
+            m  += child.m;
+            mx += child.m * child.x;
+            my += child.m * child.y;
+            mz += child.m * child.z;
+        }
+
+        Node& node = nodes_[idx];
+        float inv_m = (m > 0.0f) ? 1.0f / m : 0.0f;
+        node.x = (m > 0.0f) ? mx * inv_m : sx_[e.begin];
+        node.y = (m > 0.0f) ? my * inv_m : sy_[e.begin];
+        node.z = (m > 0.0f) ? mz * inv_m : sz_[e.begin];
+        node.m = m;
+        node.open2 = 4.0f * e.half * e.half * inv_theta2;
+        node.begin = e.begin;
+        node.end = e.end;
+        node.skip = nodes_.size() - idx;
+        return idx;
+    };
+    assemble(assemble);
+
+    leaves_.clear();
+    for (uint32_t k = 0; k < nodes_.size(); ++k)
+        if (nodes_[k].skip == 1) leaves_.push_back(k);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void NBody::build_subtree(std::vector<Node>& out, uint32_t begin, uint32_t end,
+                          int level, float half) const
+{
+    uint32_t idx = out.size();
+    out.push_back(Node());
+
+    float m = 0.0f, mx = 0.0f, my = 0.0f, mz = 0.0f;
+    if (end - begin <= LEAF_SIZE || level == MORTON_BITS) {
+        for (uint32_t k = begin; k < end; ++k) {
+            m  += sm_[k];
+            mx += sm_[k] * sx_[k];
+            my += sm_[k] * sy_[k];
+            mz += sm_[k] * sz_[k];
+        }
+    }
+    else {
+        uint32_t b = begin;
+        for (unsigned oct = 0; oct < 8; ++oct) {
+            uint32_t e = octant_end(keys_.data(), b, end, level, oct);
+            if (e > b) {
+                uint32_t child = out.size();
+                build_subtree(out, b, e, level + 1, 0.5f * half);
+                const Node& c = out[child];
+                m  += c.m;
+                mx += c.m * c.x;
+                my += c.m * c.y;
+                mz += c.m * c.z;
+            }
+            b = e;
+        }
+    }
+
+    Node& node = out[idx];
+    float inv_m = (m > 0.0f) ? 1.0f / m : 0.0f;
+    node.x = (m > 0.0f) ? mx * inv_m : sx_[begin];
+    node.y = (m > 0.0f) ? my * inv_m : sy_[begin];
+    node.z = (m > 0.0f) ? mz * inv_m : sz_[begin];
+    node.m = m;
+    node.open2 = 4.0f * half * half / (theta_ * theta_);
+    node.begin = begin;
+    node.end = end;
+    node.skip = out.size() - idx;
+}
+
+
+//=============================================================================
+
+
+void nbody_benchmark(std::ostream& os)
+{
+    // exponential disk of equal masses around a heavy center
+    auto make_disk = [](NBody& sys, size_t n) {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        std::normal_distribution<float> gauss(0.0f, 1.0f);
+        sys.clear();
+        sys.add(1.0f, vec3(0, 0, 0), vec3(0, 0, 0));
+        for (size_t i = 1; i < n; ++i) {
+            float r = -std::log(1.0f - uniform(rng)) + 0.05f;
+            float phi = 2.0f * (float)M_PI * uniform(rng);
+            float v = std::sqrt(1.0f / r);
+            sys.add(0.1f / n, vec3(r * std::cos(phi), 0.02f * gauss(rng), r * std::sin(phi)),
+                    vec3(-v * std::sin(phi), 0.0f, v * std::cos(phi)));
+        }
+    };
+
+    // RMS relative error of the current accelerations against direct summation
+    auto force_error = [](NBody& sys) {
+        // skip the center, whose acceleration nearly cancels by symmetry
+        const size_t samples = std::min<size_t>(sys.size() - 1, 256);
+        const size_t stride = (sys.size() - 1) / samples;
+        NBody::Method method = sys.method();
+        sys.set_method(NBody::DIRECT);
+        double err2 = 0.0;
+        for (size_t s = 0; s < samples; ++s) {
+            size_t i = 1 + s * stride;
+            vec3 ref = sys.acceleration_at(sys.position(i));
+            vec3 d = sys.acceleration(i) - ref;
+            err2 += dot(d, d) / dot(ref, ref);
+        }
+        sys.set_method(method);
+        return std::sqrt(err2 / samples);
+    };
+
+    const size_t direct_limit = 16384;
+    const unsigned threads = ThreadPool::instance().concurrency();
+    os << "N-body force evaluation, " << threads << " thread(s), theta 0.5\n"
+       << std::setw(8) << "N"
+       << std::setw(12) << "BH build"
+       << std::setw(12) << "BH force"
+       << std::setw(14) << "inter./part."
+       << std::setw(14) << "direct"
+       << std::setw(10) << "speedup"
+       << std::setw(12) << "rms error" << "\n";
+
+    NBody sys;
+    double direct_ms = 0.0;
+    for (size_t n = 1024; n <= 131072; n *= 2) {
+        make_disk(sys, n);
+
+        sys.set_method(NBody::BARNES_HUT);
+        sys.compute_accelerations();
+        sys.reset_stats();
+        const unsigned reps = std::max<size_t>(1, 65536 / n);
+        for (unsigned r = 0; r < reps; ++r) sys.compute_accelerations();
+        const NBody::Stats bh = sys.stats();
+        double build_ms = 1e3 * bh.build_seconds / reps;
+        double force_ms = 1e3 * bh.force_seconds / reps;
+        double error = force_error(sys);
+
+        // direct summation beyond the limit is extrapolated (O(N^2))
+        bool measured = n <= direct_limit;
+        if (measured) {
+            sys.set_method(NBody::DIRECT);
+            sys.reset_stats();
+            sys.compute_accelerations();
+            direct_ms = 1e3 * sys.stats().force_seconds;
+        }
+        else {
+            direct_ms *= 4.0;
+        }
+
+        os << std::fixed << std::setprecision(2)
+           << std::setw(8) << n
+           << std::setw(10) << build_ms << "ms"
+           << std::setw(10) << force_ms << "ms"
+           << std::setw(14) << std::setprecision(0) << bh.interactions / reps / n
+           << std::setw(12) << std::setprecision(2) << direct_ms << (measured ? "ms" : "ms*")
+           << std::setw(9) << std::setprecision(1) << direct_ms / (build_ms + force_ms) << "x"
+           << std::setw(12) << std::scientific << std::setprecision(2) << error
+           << "\n";
+    }
+    os << "(* extrapolated)\n";
+
+    // accuracy versus speed at fixed N
+    const size_t n = 65536;
+    make_disk(sys, n);
+    os << "\ntheta sweep, N = " << n << "\n"
+       << std::setw(8) << "theta"
+       << std::setw(12) << "BH total"
+       << std::setw(14) << "inter./part."
+       << std::setw(12) << "rms error" << "\n";
+    for (float theta : { 0.3f, 0.5f, 0.7f, 1.0f }) {
+        sys.set_theta(theta);
+        sys.reset_stats();
+        sys.compute_accelerations();
+        const NBody::Stats bh = sys.stats();
+        os << std::fixed << std::setprecision(1)
+           << std::setw(8) << theta
+           << std::setw(10) << std::setprecision(2) << 1e3 * (bh.build_seconds + bh.force_seconds) << "ms"
+           << std::setw(14) << std::setprecision(0) << bh.interactions / n
+           << std::setw(12) << std::scientific << std::setprecision(2) << force_error(sys)
+           << "\n";
+    }
+    os << std::defaultfloat;
+}
+
+
+//=============================================================================
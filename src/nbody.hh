@@ -0,0 +1,159 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "glmath.hh"
+#include <vector>
+#include <cstdint>
+#include <iosfwd>
+
+//=============================================================================
+
+
+/// Gravitational N-body system integrated with a kick-drift-kick leapfrog.
+/// Forces are evaluated either by direct summation, O(N^2), or by the
+/// Barnes-Hut approximation on an octree, O(N log N): cells whose size s seen
+/// from distance d satisfies s/d < theta act as a single point mass at their
+/// center of mass. Particles are stored as structure of arrays; the tree is
+/// built over Morton-sorted copies of the particles, and sorting, tree
+/// building and force evaluation run in parallel on the thread pool.
+/// Units are arbitrary but consistent, with G = 1 (masses are GM values).
+class NBody
+{
+public:
+
+    /// force evaluation method
+    enum Method { BARNES_HUT, DIRECT };
+
+    /// number of particles
+    size_t size() const { return m_.size(); }
+
+    /// remove all particles
+    void clear();
+
+    /// add a particle and return its index
+    size_t add(float mass, const vec3& position, const vec3& velocity);
+
+    /// position and velocity of particle i
+    vec3 position(size_t i) const { return vec3(x_[i], y_[i], z_[i]); }
+    vec3 velocity(size_t i) const { return vec3(vx_[i], vy_[i], vz_[i]); }
+
+    /// acceleration of particle i from the last force evaluation
+    vec3 acceleration(size_t i) const;
+
+    /// particle positions (structure of arrays)
+    const float* x() const { return x_.data(); }
+    const float* y() const { return y_.data(); }
+    const float* z() const { return z_.data(); }
+
+    /// opening angle of the Barnes-Hut approximation (0 = exact)
+    void set_theta(float theta) { theta_ = theta; acc_valid_ = false; }
+    float theta() const { return theta_; }
+
+    /// Plummer softening length (avoids singular forces in close encounters)
+    void set_softening(float eps) { eps_ = eps; acc_valid_ = false; }
+
+    /// select the force evaluation method
+    void set_method(Method method) { method_ = method; acc_valid_ = false; }
+    Method method() const { return method_; }
+
+    /// advance the system by dt with one leapfrog step
+    void step(float dt);
+
+    /// compute the accelerations of all particles at their current positions
+    void compute_accelerations();
+
+    /// acceleration a massless test particle at p feels; uses the tree of
+    /// the last force evaluation (Barnes-Hut) or sums over all particles
+    vec3 acceleration_at(const vec3& p) const;
+
+    /// accumulated timings since the last reset_stats()
+    struct Stats {
+        unsigned evaluations = 0;
+        double build_seconds = 0.0;
+        double force_seconds = 0.0;
+        double interactions = 0.0;
+    };
+    const Stats& stats() const { return stats_; }
+    void reset_stats() { stats_ = Stats(); }
+
+private:
+
+    /// octree node, stored in depth-first order: children directly follow
+    /// their parent and the next sibling is skip nodes ahead
+    struct Node {
+        /// center of mass and mass
+        float x, y, z, m;
+        /// squared cell size divided by theta^2 (open the cell if closer)
+        float open2;
+        /// range of sorted particles in this cell
+        uint32_t begin, end;
+        /// number of nodes in this subtree
+        uint32_t skip;
+    };
+
+    /// sort the particles by Morton code and build the octree
+    void build_tree();
+
+    /// build the subtree of sorted particles [begin, end) into out
+    void build_subtree(std::vector<Node>& out, uint32_t begin, uint32_t end,
+                       int level, float half) const;
+
+    /// collect the cells and particles acting on all particles of a leaf
+    void interaction_list(const Node& leaf, std::vector<float>& lx, std::vector<float>& ly,
+                          std::vector<float>& lz, std::vector<float>& lm) const;
+
+    /// acceleration at (px, py, pz) from the tree; counts interactions
+    vec3 tree_acceleration(float px, float py, float pz, size_t& interactions) const;
+
+private:
+
+    /// particle state
+    std::vector<float> x_, y_, z_, vx_, vy_, vz_, ax_, ay_, az_, m_;
+
+    /// Morton codes with particle index, sorted (and merge scratch)
+    std::vector<std::pair<uint64_t, uint32_t>> keys_, keys_tmp_;
+    /// particle positions and masses in Morton order
+    std::vector<float> sx_, sy_, sz_, sm_;
+    /// octree nodes and the indices of the leaves among them
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> leaves_;
+    /// subtrees built in parallel before they are spliced into nodes_
+    std::vector<std::vector<Node>> subtrees_;
+
+    /// cell of the serially split top of the tree: an inner node with its
+    /// number of children, or the root of a subtree built in parallel
+    struct PlanEntry {
+        uint32_t begin, end;
+        int level;
+        float half;
+        int children;
+        int subtree;
+    };
+    /// scratch of build_tree(), kept to avoid allocations in every step
+    std::vector<float> bounds_;
+    std::vector<PlanEntry> plan_;
+    std::vector<const PlanEntry*> tasks_;
+
+    Method method_ = BARNES_HUT;
+    float theta_ = 0.5f;
+    float eps_ = 1e-3f;
+    /// whether ax_, ay_, az_ belong to the current positions
+    bool acc_valid_ = false;
+
+    Stats stats_;
+};
+
+
+/// Compare direct summation with Barnes-Hut for growing N on a random disk
+/// of particles (timings, interactions, force error) and write a table.
+void nbody_benchmark(std::ostream& os);
+
+
+//=============================================================================
@@ -3,6 +3,7 @@
 #include "gl.hh"
 #include "glmath.hh"
 #include <vector>
+#include <memory_resource>
 
 class Path {
 public:
@@ -28,9 +29,12 @@ public:
         glBindVertexArray(0);
     }
 
-    void setPoints(const std::vector<vec3> &pts) {
-        m_num_pts = pts.size();
-        std::vector<GLfloat> positions(3 * m_num_pts);
+    /// upload the points of the path; scratch memory comes from the given
+    /// resource (e.g. the frame arena)
+    void setPoints(const vec3* pts, size_t n,
+                   std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
+        m_num_pts = n;
+        std::pmr::vector<GLfloat> positions(3 * m_num_pts, resource);
         for (size_t i = 0; i < m_num_pts; ++i) {
             positions[3 * i    ] = pts[i][0];
             positions[3 * i + 1] = pts[i][1];
@@ -40,7 +44,7 @@ public:
         glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(GLfloat), positions.data(), GL_STATIC_DRAW);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-        std::vector<GLuint> indices(m_num_pts);
+        std::pmr::vector<GLuint> indices(m_num_pts, resource);
         for (size_t i = 0; i < m_num_pts; ++i) indices[i] = i;
 
         glBindVertexArray(m_vao);
@@ -48,13 +52,16 @@ public:
         glBindVertexArray(0);
     }
 
-    // Uniformly parametrized curve 'f' on the interval [0, 1]
+    void setPoints(const std::vector<vec3> &pts) { setPoints(pts.data(), pts.size()); }
+
+    // Uniformly parametrized curve 'f' on the interval [0, 1]; the samples
+    // are transient and come from the given resource (e.g. the frame arena)
     template<typename F>
-    void sample(const F &f) {
-        std::vector<vec3> pts;
+    void sample(const F &f, std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
+        std::pmr::vector<vec3> pts(m_resolution, resource);
         for (size_t i = 0; i < m_resolution; ++i)
-            pts.push_back(f(i / float(m_resolution - 1)));
-        setPoints(pts);
+            pts[i] = f(i / float(m_resolution - 1));
+        setPoints(pts.data(), pts.size(), resource);
     }
 
     /// render the path as line segments
@@ -77,7 +84,6 @@ private:
     /// tessellation resolution
     unsigned int m_resolution;
     size_t m_num_pts = 0;
-
     // vertex array object
     GLuint m_vao = 0;
 
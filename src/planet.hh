@@ -9,6 +9,7 @@
 //=============================================================================
 
 #include "texture.hh"
+#include "virtual_texture.hh"
 #include "glmath.hh"
 
 //=============================================================================
@@ -31,6 +32,17 @@ public:
         angle_step_self_(_angle_step_self)
     {}
 
+    /// set the shape and orientation of the (elliptic) orbit; distance_ is
+    /// the semi-major axis, angles are given in degrees
+    void set_orbit(float _eccentricity, float _inclination,
+                   float _ascending_node, float _periapsis)
+    {
+        eccentricity_   = _eccentricity;
+        inclination_    = deg2rad(_inclination);
+        ascending_node_ = deg2rad(_ascending_node);
+        periapsis_      = deg2rad(_periapsis);
+    }
+
     /// set the time for every update
     void time_step(float _days)
     {
@@ -45,7 +57,17 @@ public:
     /// the radius of the planet
     float radius_;
 
-    /// current rotation around the orbit center
+    /// eccentricity of the orbit (0 = circle)
+    float eccentricity_ = 0.0f;
+    /// inclination of the orbit plane against the x-z plane (in radians)
+    float inclination_ = 0.0f;
+    /// longitude of the ascending node (in radians)
+    float ascending_node_ = 0.0f;
+    /// argument of periapsis (in radians)
+    float periapsis_ = 0.0f;
+
+    /// current mean anomaly, i.e. rotation around the orbit center for a
+    /// circular orbit
     float angle_orbit_ = 0.0f;
     /// current rotation around planet center
     float angle_self_ = 0.0f;
@@ -58,6 +80,10 @@ public:
 
     /// main diffuse texture for the planet
     Texture tex_;
+
+    /// layer of the diffuse texture in the shared planet texture array
+    /// (used by the instanced phong rendering instead of tex_)
+    unsigned int layer_ = 0;
 };
 
 
@@ -79,13 +105,12 @@ public:
     /// diffuse texture for the night
     Texture night_;
 
-    /// texture with the clouds
-    Texture cloud_;
-
-    /// the gloss texture - defines where the surface si glossy or not
-    Texture gloss_;
+    /// clouds (red) and gloss (green) packed into one texture; gloss
+    /// defines where the surface is glossy or not
+    Texture cloud_gloss_;
 
-    /// the normal texture - detailed normal maps
-    Texture normal_;
+    /// the bump map (heights), a virtual texture of which only the visible
+    /// pages are resident
+    VirtualTexture bump_;
 };
 
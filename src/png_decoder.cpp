@@ -0,0 +1,884 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "png_decoder.hh"
+#include "thread_pool.hh"
+#include "trace.hh"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include "lodepng.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PNG_DECODER_SSE2
+#include <emmintrin.h>
+#endif
+
+//=============================================================================
+
+
+namespace {
+
+
+inline uint32_t read_be32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+/// 8 bytes as a little endian number
+inline uint64_t read_le64(const uint8_t* p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+/// Huffman decoding table. An entry holds the number of bits of its code
+/// (bits 0-3), its kind (4-7), the number of extra bits (8-15) and its value
+/// (16-31): a literal byte, the base of a length or distance, or for codes
+/// longer than the root bits the offset of the subtable (whose index width
+/// is then in the extra bits field).
+enum EntryKind : uint32_t { LITERAL, LENGTH, END, SUBTABLE, INVALID };
+
+inline uint32_t entry(uint32_t bits, uint32_t kind, uint32_t extra, uint32_t value)
+{
+    return bits | (kind << 4) | (extra << 8) | (value << 16);
+}
+inline unsigned entry_bits(uint32_t e)  { return e & 15; }
+inline unsigned entry_kind(uint32_t e)  { return (e >> 4) & 15; }
+inline unsigned entry_extra(uint32_t e) { return (e >> 8) & 255; }
+inline unsigned entry_value(uint32_t e) { return e >> 16; }
+
+/// root bits and capacities (root table plus subtables) of the tables; the
+/// capacities hold the largest complete codes (see zlib's enough.c)
+const unsigned LITLEN_BITS = 10, DIST_BITS = 8, CODELEN_BITS = 7;
+const unsigned LITLEN_ENTRIES = (1 << LITLEN_BITS) + 512, DIST_ENTRIES = (1 << DIST_BITS) + 256;
+
+/// bases and extra bits of the length symbols 257..285 and distance symbols
+const uint16_t LENGTH_BASE[29]  = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t  LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t DIST_BASE[30]    = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+                                    513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t  DIST_EXTRA[30]   = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7,
+                                    8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/// which alphabet a table decodes
+enum Alphabet { LITLEN, DIST, CODELEN };
+
+/// the table entry of a symbol with a code of the given number of bits
+uint32_t symbol_entry(Alphabet alphabet, unsigned symbol, unsigned bits)
+{
+    switch (alphabet) {
+        case LITLEN:
+            if (symbol < 256)  return entry(bits, LITERAL, 0, symbol);
+            if (symbol == 256) return entry(bits, END, 0, 0);
+            if (symbol < 286)  return entry(bits, LENGTH, LENGTH_EXTRA[symbol - 257], LENGTH_BASE[symbol - 257]);
+            return entry(bits, INVALID, 0, 0);
+        case DIST:
+            if (symbol < 30) return entry(bits, LENGTH, DIST_EXTRA[symbol], DIST_BASE[symbol]);
+            return entry(bits, INVALID, 0, 0);
+        default:
+            return entry(bits, LITERAL, 0, symbol);
+    }
+}
+
+inline unsigned reverse_bits(unsigned code, unsigned bits)
+{
+    unsigned r = 0;
+    for (unsigned i = 0; i < bits; ++i, code >>= 1) r = (r << 1) | (code & 1);
+    return r;
+}
+
+/// Build the decoding table of the canonical Huffman code with the given
+/// code lengths (0: unused symbol) in table[capacity]. Codes of up to
+/// root_bits bits are decoded with one lookup, longer ones with a second
+/// lookup in a subtable. Incomplete codes are allowed (their unused entries
+/// are INVALID), over-subscribed ones are not; returns a lodepng error code.
+unsigned build_table(const uint8_t* lengths, unsigned n, Alphabet alphabet, unsigned root_bits,
+                     uint32_t* table, unsigned capacity)
+{
+    unsigned count[16] = {};
+    for (unsigned s = 0; s < n; ++s) ++count[lengths[s]];
+    count[0] = 0;
+    int left = 1;
+    for (unsigned len = 1; len < 16; ++len) {
+        left = 2 * left - int(count[len]);
+        if (left < 0) return 55;
+    }
+
+    // first canonical code of every length
+    unsigned next_code[16] = {};
+    for (unsigned len = 1, code = 0; len < 16; ++len) {
+        code = (code + count[len - 1]) << 1;
+        next_code[len] = code;
+    }
+
+    const unsigned root_size = 1u << root_bits;
+    std::fill(table, table + root_size, entry(0, INVALID, 0, 0));
+
+    // longest code behind every root entry, which sizes its subtable
+    uint8_t longest[1 << LITLEN_BITS] = {};
+    unsigned codes[288];
+    for (unsigned s = 0; s < n; ++s) {
+        unsigned len = lengths[s];
+        if (!len) continue;
+        codes[s] = reverse_bits(next_code[len]++, len);
+        if (len > root_bits) {
+            uint8_t& l = longest[codes[s] & (root_size - 1)];
+            l = uint8_t(std::max<unsigned>(l, len));
+        }
+    }
+
+    unsigned used = root_size;
+    for (unsigned r = 0; r < root_size; ++r) {
+        if (!longest[r]) continue;
+        unsigned sub_bits = longest[r] - root_bits;
+        if (used + (1u << sub_bits) > capacity) return 55;
+        table[r] = entry(root_bits, SUBTABLE, sub_bits, used);
+        std::fill(table + used, table + used + (1u << sub_bits), entry(0, INVALID, 0, 0));
+        used += 1u << sub_bits;
+    }
+
+    // replicate every code over the entries whose low bits it matches
+    for (unsigned s = 0; s < n; ++s) {
+        unsigned len = lengths[s];
+        if (!len) continue;
+        if (len <= root_bits) {
+            uint32_t e = symbol_entry(alphabet, s, len);
+            for (unsigned i = codes[s]; i < root_size; i += 1u << len) table[i] = e;
+        }
+        else {
+            uint32_t sub = table[codes[s] & (root_size - 1)];
+            uint32_t* subtable = table + entry_value(sub);
+            unsigned sub_len = len - root_bits;
+            uint32_t e = symbol_entry(alphabet, s, sub_len);
+            for (unsigned i = codes[s] >> root_bits; i < (1u << entry_extra(sub)); i += 1u << sub_len) subtable[i] = e;
+        }
+    }
+    return 0;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+/// Inflate a zlib stream: in[size] must be followed by 16 readable bytes,
+/// out[out_size] by 16 writable bytes, and the stream must decompress to
+/// exactly out_size bytes. The bits are read through a 64 bit buffer that
+/// is refilled without branches once per literal or match, which is enough
+/// for the longest match with its extra bits (48 bits); the tables are
+/// built once per block.
+class Inflater
+{
+public:
+
+    Inflater(const uint8_t* in, size_t size) : in_(in), end_(in + size) {}
+
+    unsigned inflate(uint8_t* out, size_t out_size)
+    {
+        if (end_ - in_ < 2) return 53;
+        const unsigned cmf = in_[0], flg = in_[1];
+        if ((cmf * 256 + flg) % 31) return 24;
+        if ((cmf & 15) != 8 || (cmf >> 4) > 7) return 25;
+        if (flg & 32) return 26;
+        in_ += 2;
+
+        uint8_t* o = out;
+        uint8_t* const out_end = out + out_size;
+        bool final = false;
+        while (!final) {
+            refill();
+            if (overrun()) return 23;
+            final = take(1);
+            unsigned type = take(2);
+            unsigned error = 0;
+            if (type == 0)
+                error = stored(o, out_end);
+            else if (type == 1)
+                error = huffman(fixed_litlen(), fixed_dist(), out, o, out_end);
+            else if (type == 2)
+                error = dynamic(out, o, out_end);
+            else
+                error = 20;
+            if (error) return error;
+        }
+        if (o != out_end) return 91;
+
+        // Adler-32 of the image data, byte aligned behind the last block
+        in_ -= count_ >> 3;
+        if (end_ - in_ < 4) return 53;
+        if (png_adler32(1, out, out_size) != read_be32(in_)) return 58;
+        return 0;
+    }
+
+private:
+
+    void refill()
+    {
+        bits_ |= read_le64(in_) << count_;
+        in_ += (63 - count_) >> 3;
+        count_ |= 56;
+    }
+
+    /// whether the bits read so far go beyond the end of the input; refill()
+    /// reads 8 bytes ahead, so this is checked after every refill
+    bool overrun() const { return in_ > end_ + 8; }
+
+    unsigned take(unsigned n)
+    {
+        unsigned v = unsigned(bits_ & ((uint64_t(1) << n) - 1));
+        bits_ >>= n;
+        count_ -= n;
+        return v;
+    }
+
+    /// decode a symbol with a table of the given root bits
+    uint32_t decode(const uint32_t* table, unsigned root_bits)
+    {
+        uint32_t e = table[bits_ & ((1u << root_bits) - 1)];
+        if (entry_kind(e) == SUBTABLE) {
+            bits_ >>= root_bits;
+            count_ -= root_bits;
+            e = table[entry_value(e) + (bits_ & ((1u << entry_extra(e)) - 1))];
+        }
+        bits_ >>= entry_bits(e);
+        count_ -= entry_bits(e);
+        return e;
+    }
+
+    unsigned stored(uint8_t*& o, uint8_t* out_end)
+    {
+        // back to the byte following the block header
+        in_ -= count_ >> 3;
+        bits_ = 0;
+        count_ = 0;
+        if (end_ - in_ < 4) return 23;
+        const unsigned len  = in_[0] | (in_[1] << 8);
+        const unsigned nlen = in_[2] | (in_[3] << 8);
+        if (len + nlen != 65535) return 21;
+        in_ += 4;
+        if (size_t(end_ - in_) < len) return 23;
+        if (size_t(out_end - o) < len) return 17;
+        std::memcpy(o, in_, len);
+        o += len;
+        in_ += len;
+        return 0;
+    }
+
+    unsigned dynamic(uint8_t* out, uint8_t*& o, uint8_t* out_end)
+    {
+        static const uint8_t ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+        const unsigned hlit = take(5) + 257, hdist = take(5) + 1, hclen = take(4) + 4;
+        uint8_t lengths[288 + 32] = {};
+        for (unsigned i = 0; i < hclen; ++i) {
+            if (count_ < 3) {
+                refill();
+                if (overrun()) return 23;
+            }
+            lengths[ORDER[i]] = uint8_t(take(3));
+        }
+        uint32_t codelen[1 << CODELEN_BITS];
+        if (build_table(lengths, 19, CODELEN, CODELEN_BITS, codelen, 1 << CODELEN_BITS)) return 16;
+
+        std::fill(lengths, lengths + 19, 0);
+        for (unsigned i = 0; i < hlit + hdist;) {
+            refill();
+            if (overrun()) return 23;
+            uint32_t e = decode(codelen, CODELEN_BITS);
+            if (entry_kind(e) == INVALID) return 16;
+            const unsigned symbol = entry_value(e);
+            if (symbol < 16) {
+                lengths[i++] = uint8_t(symbol);
+                continue;
+            }
+            unsigned value = 0, repeat;
+            if (symbol == 16) {
+                if (i == 0) return 54;
+                value = lengths[i - 1];
+                repeat = 3 + take(2);
+            }
+            else if (symbol == 17) repeat = 3 + take(3);
+            else                   repeat = 11 + take(7);
+            if (i + repeat > hlit + hdist) return 13;
+            std::fill(lengths + i, lengths + i + repeat, uint8_t(value));
+            i += repeat;
+        }
+        if (!lengths[256]) return 64;
+
+        uint32_t litlen[LITLEN_ENTRIES], dist[DIST_ENTRIES];
+        if (unsigned error = build_table(lengths, hlit, LITLEN, LITLEN_BITS, litlen, LITLEN_ENTRIES)) return error;
+        if (unsigned error = build_table(lengths + hlit, hdist, DIST, DIST_BITS, dist, DIST_ENTRIES)) return error;
+        return huffman(litlen, dist, out, o, out_end);
+    }
+
+    unsigned huffman(const uint32_t* litlen, const uint32_t* dist, uint8_t* out, uint8_t*& o, uint8_t* out_end)
+    {
+        for (;;) {
+            refill();
+            if (overrun()) return 23;
+
+            uint32_t e = decode(litlen, LITLEN_BITS);
+            if (entry_kind(e) == LITERAL) {
+                if (out_end - o < 2) {
+                    if (o == out_end) return 17;
+                    *o++ = uint8_t(entry_value(e));
+                    continue;
+                }
+                *o++ = uint8_t(entry_value(e));
+
+                // the bits left suffice for another literal, not for a match
+                e = litlen[bits_ & ((1u << LITLEN_BITS) - 1)];
+                if (entry_kind(e) == LITERAL) {
+                    bits_ >>= entry_bits(e);
+                    count_ -= entry_bits(e);
+                    *o++ = uint8_t(entry_value(e));
+                }
+                continue;
+            }
+            if (entry_kind(e) == END) return 0;
+            if (entry_kind(e) != LENGTH) return 16;
+            const unsigned length = entry_value(e) + take(entry_extra(e));
+
+            e = decode(dist, DIST_BITS);
+            if (entry_kind(e) != LENGTH) return 18;
+            const size_t distance = entry_value(e) + take(entry_extra(e));
+            if (distance > size_t(o - out)) return 18;
+            if (size_t(out_end - o) < length) return 17;
+
+            // the output has 16 bytes of slack, so that copies may overshoot
+            const uint8_t* from = o - distance;
+            if (distance >= 8) {
+                for (unsigned i = 0; i < length; i += 8) std::memcpy(o + i, from + i, 8);
+            }
+            else if (distance == 1) {
+                std::memset(o, *from, length);
+            }
+            else {
+                for (unsigned i = 0; i < length; ++i) o[i] = from[i];
+            }
+            o += length;
+        }
+    }
+
+    static const uint32_t* fixed_litlen()
+    {
+        static const auto table = [] {
+            std::vector<uint32_t> t(LITLEN_ENTRIES);
+            uint8_t lengths[288];
+            std::fill(lengths,       lengths + 144, 8);
+            std::fill(lengths + 144, lengths + 256, 9);
+            std::fill(lengths + 256, lengths + 280, 7);
+            std::fill(lengths + 280, lengths + 288, 8);
+            build_table(lengths, 288, LITLEN, LITLEN_BITS, t.data(), LITLEN_ENTRIES);
+            return t;
+        }();
+        return table.data();
+    }
+
+    static const uint32_t* fixed_dist()
+    {
+        static const auto table = [] {
+            std::vector<uint32_t> t(DIST_ENTRIES);
+            uint8_t lengths[32];
+            std::fill(lengths, lengths + 32, 5);
+            build_table(lengths, 32, DIST, DIST_BITS, t.data(), DIST_ENTRIES);
+            return t;
+        }();
+        return table.data();
+    }
+
+private:
+
+    const uint8_t* in_;
+    const uint8_t* end_;
+    uint64_t bits_ = 0;
+    unsigned count_ = 0;
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+#ifdef PNG_DECODER_SSE2
+
+/// a pixel of BPP (3 or 4) bytes in the low bytes of a vector and back
+/// (3 bytes are assembled in a register, a memcpy of them would go through
+/// the stack and stall on the store forwarding)
+template <unsigned BPP> inline __m128i load_pixel(const uint8_t* p)
+{
+    uint32_t v;
+    if (BPP == 4) std::memcpy(&v, p, 4);
+    else v = uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16);
+    return _mm_cvtsi32_si128(int(v));
+}
+template <unsigned BPP> inline void store_pixel(uint8_t* p, __m128i x)
+{
+    uint32_t v = uint32_t(_mm_cvtsi128_si32(x));
+    if (BPP == 4) std::memcpy(p, &v, 4);
+    else p[0] = uint8_t(v), p[1] = uint8_t(v >> 8), p[2] = uint8_t(v >> 16);
+}
+
+/// Sub, Avg and Paeth filters of scanlines with 3 or 4 bytes per pixel,
+/// which depend on the pixel to the left and therefore go pixel by pixel,
+/// each pixel's bytes in one vector
+template <unsigned BPP> void unfilter_sub(uint8_t* cur, size_t n)
+{
+    __m128i a = _mm_setzero_si128();
+    for (size_t i = 0; i < n; i += BPP) {
+        a = _mm_add_epi8(a, load_pixel<BPP>(cur + i));
+        store_pixel<BPP>(cur + i, a);
+    }
+}
+
+template <unsigned BPP> void unfilter_avg(uint8_t* cur, const uint8_t* prev, size_t n)
+{
+    // (a + b) / 2 rounded down: the rounded up average minus the lowest
+    // bit of a ^ b
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i a = _mm_setzero_si128();
+    for (size_t i = 0; i < n; i += BPP) {
+        __m128i b = load_pixel<BPP>(prev + i);
+        __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+        a = _mm_add_epi8(load_pixel<BPP>(cur + i), avg);
+        store_pixel<BPP>(cur + i, a);
+    }
+}
+
+template <unsigned BPP> void unfilter_paeth(uint8_t* cur, const uint8_t* prev, size_t n)
+{
+    // the predictor on 16 bit lanes: p - a = b - c, p - b = a - c,
+    // p - c = (b - c) + (a - c); ties prefer a, then b
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = zero, c = zero;
+    for (size_t i = 0; i < n; i += BPP) {
+        __m128i b = _mm_unpacklo_epi8(load_pixel<BPP>(prev + i), zero);
+        __m128i pa = _mm_sub_epi16(b, c);
+        __m128i pb = _mm_sub_epi16(a, c);
+        __m128i pc = _mm_add_epi16(pa, pb);
+        pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+        pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+        pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+        __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+        __m128i use_a = _mm_cmpeq_epi16(smallest, pa);
+        __m128i use_b = _mm_andnot_si128(use_a, _mm_cmpeq_epi16(smallest, pb));
+        __m128i nearest = _mm_or_si128(_mm_and_si128(use_a, a), _mm_and_si128(use_b, b));
+        nearest = _mm_or_si128(nearest, _mm_andnot_si128(_mm_or_si128(use_a, use_b), c));
+        __m128i x = _mm_add_epi8(load_pixel<BPP>(cur + i), _mm_packus_epi16(nearest, nearest));
+        store_pixel<BPP>(cur + i, x);
+        a = _mm_unpacklo_epi8(x, zero);
+        c = b;
+    }
+}
+
+#endif
+
+
+/// undo the filter of a scanline of n bytes and bpp bytes per pixel in
+/// place, given the unfiltered previous one; a lodepng error code
+unsigned unfilter_row(uint8_t* cur, const uint8_t* prev, size_t n, unsigned bpp, unsigned filter)
+{
+#ifdef PNG_DECODER_SSE2
+    if (bpp == 3 || bpp == 4) {
+        switch (filter) {
+            case 1: bpp == 3 ? unfilter_sub<3>(cur, n) : unfilter_sub<4>(cur, n); return 0;
+            case 3: bpp == 3 ? unfilter_avg<3>(cur, prev, n) : unfilter_avg<4>(cur, prev, n); return 0;
+            case 4: bpp == 3 ? unfilter_paeth<3>(cur, prev, n) : unfilter_paeth<4>(cur, prev, n); return 0;
+        }
+    }
+#endif
+
+    switch (filter) {
+        case 0:
+            return 0;
+
+        case 1:
+            for (size_t i = bpp; i < n; ++i) cur[i] = uint8_t(cur[i] + cur[i - bpp]);
+            return 0;
+
+        case 2: {
+            size_t i = 0;
+#ifdef PNG_DECODER_SSE2
+            for (; i + 16 <= n; i += 16) {
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(cur + i), _mm_add_epi8(c, b));
+            }
+#endif
+            for (; i < n; ++i) cur[i] = uint8_t(cur[i] + prev[i]);
+            return 0;
+        }
+
+        case 3:
+            for (size_t i = 0; i < bpp && i < n; ++i) cur[i] = uint8_t(cur[i] + (prev[i] >> 1));
+            for (size_t i = bpp; i < n; ++i) cur[i] = uint8_t(cur[i] + ((cur[i - bpp] + prev[i]) >> 1));
+            return 0;
+
+        case 4:
+            for (size_t i = 0; i < bpp && i < n; ++i) cur[i] = uint8_t(cur[i] + prev[i]);
+            for (size_t i = bpp; i < n; ++i) {
+                int a = cur[i - bpp], b = prev[i], c = prev[i - bpp];
+                int pa = std::abs(b - c), pb = std::abs(a - c), pc = std::abs(a + b - 2 * c);
+                int p = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                cur[i] = uint8_t(cur[i] + p);
+            }
+            return 0;
+
+        default:
+            return 36;
+    }
+}
+
+
+/// expand an unfiltered scanline of width pixels to RGBA
+void expand_row(const uint8_t* row, unsigned width, unsigned color_type, const uint8_t* palette, uint8_t* rgba)
+{
+    switch (color_type) {
+        case 0: {
+            unsigned x = 0;
+#ifdef PNG_DECODER_SSE2
+            // g -> g g g 255, 16 pixels at a time
+            const __m128i alpha = _mm_set1_epi32(int(0xff000000u));
+            for (; x + 16 <= width; x += 16, rgba += 64) {
+                __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+                __m128i gg_lo = _mm_unpacklo_epi8(g, g), gg_hi = _mm_unpackhi_epi8(g, g);
+                __m128i* out = reinterpret_cast<__m128i*>(rgba);
+                _mm_storeu_si128(out + 0, _mm_or_si128(_mm_unpacklo_epi16(gg_lo, gg_lo), alpha));
+                _mm_storeu_si128(out + 1, _mm_or_si128(_mm_unpackhi_epi16(gg_lo, gg_lo), alpha));
+                _mm_storeu_si128(out + 2, _mm_or_si128(_mm_unpacklo_epi16(gg_hi, gg_hi), alpha));
+                _mm_storeu_si128(out + 3, _mm_or_si128(_mm_unpackhi_epi16(gg_hi, gg_hi), alpha));
+            }
+#endif
+            for (; x < width; ++x, rgba += 4)
+                rgba[0] = rgba[1] = rgba[2] = row[x], rgba[3] = 255;
+            return;
+        }
+        case 2:
+            for (unsigned x = 0; x < width; ++x, row += 3, rgba += 4)
+                rgba[0] = row[0], rgba[1] = row[1], rgba[2] = row[2], rgba[3] = 255;
+            return;
+        case 3:
+            for (unsigned x = 0; x < width; ++x, rgba += 4)
+                std::memcpy(rgba, palette + 4 * row[x], 4);
+            return;
+        case 4:
+            for (unsigned x = 0; x < width; ++x, row += 2, rgba += 4)
+                rgba[0] = rgba[1] = rgba[2] = row[0], rgba[3] = row[1];
+            return;
+        default:
+            std::memcpy(rgba, row, size_t(width) * 4);
+            return;
+    }
+}
+
+
+/// whether the CRC of the chunk starting at \p chunk (at its length field)
+/// with \p length data bytes matches its type and data
+bool chunk_crc_ok(const uint8_t* chunk, size_t length)
+{
+    return lodepng_crc32(chunk + 4, length + 4) == read_be32(chunk + 8 + length);
+}
+
+
+/// lodepng's decoder, for the images png_decode() does not handle itself
+unsigned decode_lodepng(const uint8_t* png, size_t size, uint8_t* rgba, unsigned width, unsigned height)
+{
+    std::vector<uint8_t> img;
+    unsigned w, h;
+    unsigned error = lodepng::decode(img, w, h, png, size);
+    if (error) return error;
+    if (w != width || h != height) return 77;
+    std::memcpy(rgba, img.data(), img.size());
+    return 0;
+}
+
+
+} // namespace
+
+
+//=============================================================================
+
+
+uint32_t png_adler32(uint32_t adler, const uint8_t* data, size_t size)
+{
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    while (size) {
+        // the largest block whose sums cannot overflow before the modulo
+        size_t n = std::min<size_t>(size, 5552);
+        size -= n;
+#ifdef PNG_DECODER_SSE2
+        // 16 bytes at a time: a grows by their sum, b by 16 times the
+        // previous a plus the bytes weighted 16, 15, ..., 1
+        if (n >= 16) {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i weights_lo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+            const __m128i weights_hi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+            __m128i sum = zero, prefix = zero, weighted = zero;
+            const size_t blocks = n / 16;
+            for (size_t i = 0; i < blocks; ++i, data += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+                prefix = _mm_add_epi32(prefix, sum);
+                sum = _mm_add_epi32(sum, _mm_sad_epu8(v, zero));
+                weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), weights_lo));
+                weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), weights_hi));
+            }
+            uint32_t lanes[3][4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[0]), sum);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[1]), prefix);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[2]), weighted);
+            const uint64_t sum_all    = uint64_t(lanes[0][0]) + lanes[0][2];
+            const uint64_t prefix_all = uint64_t(lanes[1][0]) + lanes[1][2];
+            const uint64_t weighted_all = uint64_t(lanes[2][0]) + lanes[2][1] + lanes[2][2] + lanes[2][3];
+            b = uint32_t((b + 16 * blocks * uint64_t(a) + 16 * prefix_all + weighted_all) % 65521);
+            a = uint32_t((a + sum_all) % 65521);
+            n -= blocks * 16;
+        }
+#endif
+        for (; n; --n) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+unsigned png_inspect(const uint8_t* png, size_t size, unsigned& width, unsigned& height)
+{
+    static const uint8_t SIGNATURE[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    if (!png || !size) return 48;
+    if (size < 33) return 27;
+    if (std::memcmp(png, SIGNATURE, 8)) return 28;
+    if (std::memcmp(png + 12, "IHDR", 4)) return 29;
+    if (read_be32(png + 8) != 13) return 94;
+    if (!chunk_crc_ok(png + 8, 13)) return 57;
+    width  = read_be32(png + 16);
+    height = read_be32(png + 20);
+    if (!width || !height) return 93;
+    if (width > 0x7fffffff || height > 0x7fffffff || uint64_t(width) * height > (uint64_t(1) << 32)) return 92;
+    return 0;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+unsigned png_decode(const uint8_t* png, size_t size, uint8_t* rgba, unsigned width, unsigned height)
+{
+    TRACE_SCOPE("png_decode");
+
+    unsigned w, h;
+    if (unsigned error = png_inspect(png, size, w, h)) return error;
+    if (w != width || h != height) return 77;
+
+    const unsigned bit_depth  = png[24];
+    const unsigned color_type = png[25];
+    if (png[26] != 0) return 32;
+    if (png[27] != 0) return 33;
+    if (png[28] > 1) return 34;
+    if (bit_depth != 8 || png[28] != 0) return decode_lodepng(png, size, rgba, width, height);
+
+    unsigned bpp;
+    switch (color_type) {
+        case 0: bpp = 1; break;
+        case 2: bpp = 3; break;
+        case 3: bpp = 1; break;
+        case 4: bpp = 2; break;
+        case 6: bpp = 4; break;
+        default: return 31;
+    }
+
+    // collect the palette and the image data, concatenated and followed by
+    // the padding the inflater reads ahead into
+    // entries beyond the palette are opaque black, as with lodepng
+    uint8_t palette[256 * 4];
+    for (unsigned i = 0; i < 256; ++i) palette[4 * i] = palette[4 * i + 1] = palette[4 * i + 2] = 0, palette[4 * i + 3] = 255;
+    unsigned palette_size = 0;
+    std::vector<uint8_t> idat;
+    for (size_t pos = 33; pos + 12 <= size;) {
+        const size_t length = read_be32(png + pos);
+        if (length > 0x7fffffff) return 63;
+        if (size - pos - 12 < length) return 30;
+        const uint8_t* type = png + pos + 4;
+        const uint8_t* data = png + pos + 8;
+        // like lodepng, the CRCs of the chunks read are checked, those of
+        // skipped ancillary chunks are not
+        const bool known = !std::memcmp(type, "IDAT", 4) || !std::memcmp(type, "PLTE", 4) ||
+                           !std::memcmp(type, "tRNS", 4) || !std::memcmp(type, "IEND", 4);
+        if (known && !chunk_crc_ok(png + pos, length)) return 57;
+        if (!std::memcmp(type, "IDAT", 4)) {
+            idat.insert(idat.end(), data, data + length);
+        }
+        else if (!std::memcmp(type, "PLTE", 4)) {
+            if (length % 3 || length > 3 * 256) return 38;
+            palette_size = unsigned(length / 3);
+            for (unsigned i = 0; i < palette_size; ++i) std::memcpy(palette + 4 * i, data + 3 * i, 3);
+        }
+        else if (!std::memcmp(type, "tRNS", 4)) {
+            // color keys are left to lodepng, alpha of palette entries is not
+            if (color_type != 3) return decode_lodepng(png, size, rgba, width, height);
+            if (length > palette_size) return 39;
+            for (size_t i = 0; i < length; ++i) palette[4 * i + 3] = data[i];
+        }
+        else if (!std::memcmp(type, "IEND", 4)) {
+            break;
+        }
+        else if (!(type[0] & 32)) {
+            return 69;
+        }
+        pos += 12 + length;
+    }
+    if (color_type == 3 && !palette_size) return 106;
+    const size_t compressed = idat.size();
+    idat.resize(compressed + 16, 0);
+
+    // inflate the scanlines, each a filter type byte followed by the pixels
+    const size_t row_bytes = size_t(width) * bpp;
+    const size_t stride = row_bytes + 1;
+    std::vector<uint8_t> scanlines(stride * height + 16 + row_bytes);
+    {
+        TRACE_SCOPE("png_decode::inflate");
+        Inflater inflater(idat.data(), compressed);
+        unsigned error = inflater.inflate(scanlines.data(), stride * height);
+        // codes that are over-subscribed or whose tables exceed the fixed
+        // capacities (only possible for incomplete ones, which zlib never
+        // writes) are left to lodepng
+        if (error == 55) return decode_lodepng(png, size, rgba, width, height);
+        if (error) return error;
+    }
+
+    // unfilter in place and expand every row as soon as it is done; the
+    // row above the first one is zero (behind the scanlines)
+    TRACE_SCOPE("png_decode::unfilter");
+    const uint8_t* prev = &scanlines[stride * height + 16];
+    std::memset(&scanlines[stride * height], 0, 16 + row_bytes);
+    for (unsigned y = 0; y < height; ++y) {
+        uint8_t* line = &scanlines[y * stride];
+        if (unsigned error = unfilter_row(line + 1, prev, row_bytes, bpp, line[0])) return error;
+        expand_row(line + 1, width, color_type, palette, rgba + size_t(y) * width * 4);
+        prev = line + 1;
+    }
+    return 0;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+unsigned png_decode_file(std::vector<uint8_t>& rgba, unsigned& width, unsigned& height,
+                         const std::string& filename)
+{
+    std::vector<uint8_t> png;
+    if (unsigned error = lodepng::load_file(png, filename)) return error;
+    if (unsigned error = png_inspect(png.data(), png.size(), width, height)) return error;
+    rgba.resize(size_t(width) * height * 4);
+    return png_decode(png.data(), png.size(), rgba.data(), width, height);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void png_decode_benchmark(std::ostream& os)
+{
+    typedef std::chrono::steady_clock Clock;
+    namespace fs = std::filesystem;
+
+    std::vector<std::string> filenames;
+    std::error_code ec;
+    for (const fs::directory_entry& e : fs::directory_iterator(TEXTURE_PATH, ec))
+        if (e.path().extension() == ".png") filenames.push_back(e.path().string());
+    std::sort(filenames.begin(), filenames.end());
+
+    os << "PNG decoding to RGBA (best of 3)\n"
+       << std::setw(36) << "texture" << std::setw(12) << "size"
+       << std::setw(14) << "lodepng [ms]" << std::setw(14) << "fast [ms]"
+       << std::setw(12) << "[MB/s]" << std::setw(10) << "speedup" << std::endl;
+
+    double total_lodepng = 0, total_fast = 0, total_mb = 0;
+    for (const std::string& filename : filenames) {
+        const std::string name = fs::path(filename).filename().string();
+        std::vector<uint8_t> reference, img;
+        unsigned width = 0, height = 0;
+
+        auto time = [&](auto&& decode) {
+            double best = 1e30;
+            for (int run = 0; run < 3; ++run) {
+                auto start = Clock::now();
+                if (decode()) return -1.0;
+                best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+            }
+            return best;
+        };
+        // (lodepng appends to the image)
+        double lodepng_ms = time([&] { reference.clear(); return lodepng::decode(reference, width, height, filename); });
+        double fast_ms    = time([&] { return png_decode_file(img, width, height, filename); });
+        if (lodepng_ms < 0 || fast_ms < 0) {
+            os << std::setw(36) << name << "  (cannot be decoded)" << std::endl;
+            continue;
+        }
+        if (img != reference) {
+            os << std::setw(36) << name << "  MISMATCH" << std::endl;
+            continue;
+        }
+
+        const double mb = img.size() / 1e6;
+        total_lodepng += lodepng_ms;
+        total_fast += fast_ms;
+        total_mb += mb;
+        os << std::setw(36) << name << std::setw(12) << (std::to_string(width) + "x" + std::to_string(height))
+           << std::fixed << std::setprecision(2)
+           << std::setw(14) << lodepng_ms << std::setw(14) << fast_ms
+           << std::setprecision(0) << std::setw(12) << mb / fast_ms * 1e3
+           << std::setprecision(1) << std::setw(9) << lodepng_ms / fast_ms << "x"
+           << std::defaultfloat << std::endl;
+    }
+    if (total_fast <= 0) return;
+
+    // all textures at once, one per thread, as the texture loader decodes them
+    ThreadPool& pool = ThreadPool::instance();
+    auto start = Clock::now();
+    pool.parallel_for(filenames.size(), 1, [&](size_t begin, size_t end) {
+        std::vector<uint8_t> img;
+        unsigned width, height;
+        for (size_t i = begin; i < end; ++i) png_decode_file(img, width, height, filenames[i]);
+    });
+    double parallel_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    os << std::setw(36) << "total" << std::setw(12) << ""
+       << std::fixed << std::setprecision(2)
+       << std::setw(14) << total_lodepng << std::setw(14) << total_fast
+       << std::setprecision(0) << std::setw(12) << total_mb / total_fast * 1e3
+       << std::setprecision(1) << std::setw(9) << total_lodepng / total_fast << "x" << std::endl
+       << std::setw(36) << ("total on " + std::to_string(pool.concurrency()) + " threads") << std::setw(12) << ""
+       << std::setw(14) << "" << std::setprecision(2) << std::setw(14) << parallel_ms
+       << std::setprecision(0) << std::setw(12) << total_mb / parallel_ms * 1e3
+       << std::defaultfloat << std::endl;
+}
+
+
+//=============================================================================
@@ -0,0 +1,52 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+//=============================================================================
+
+
+/// Fast PNG decoding to 8 bit RGBA for the images textures are made of:
+/// 8 bits per channel, grey, grey+alpha, RGB, RGBA or palette, not
+/// interlaced. The zlib stream is inflated with a table-driven decoder on a
+/// 64 bit bit buffer (one refill per literal or match), the scanlines are
+/// unfiltered with SSE2 for 3 and 4 bytes per pixel, and every row is
+/// expanded to RGBA right after it is unfiltered, directly into the
+/// caller's memory. Everything else (16 bit, low bit depths, Adam7, color
+/// keys) is decoded by lodepng and converted. As with lodepng, the CRCs of
+/// the chunks read and the Adler-32 checksum of the image data are checked.
+/// Errors are lodepng's error codes, so lodepng_error_text() describes them.
+
+/// Read the size of a PNG image from its header; a lodepng error code.
+unsigned png_inspect(const uint8_t* png, size_t size, unsigned& width, unsigned& height);
+
+/// Decode a PNG image in memory into width * height * 4 bytes at rgba (the
+/// size png_inspect() reported, rows top to bottom as in the file), e.g. a
+/// mapped buffer. Returns a lodepng error code.
+unsigned png_decode(const uint8_t* png, size_t size, uint8_t* rgba, unsigned width, unsigned height);
+
+/// Decode a PNG file into an RGBA image, like lodepng::decode().
+unsigned png_decode_file(std::vector<uint8_t>& rgba, unsigned& width, unsigned& height,
+                         const std::string& filename);
+
+/// Adler-32 checksum of zlib streams, continuing one of the preceding data
+/// (1 for none)
+uint32_t png_adler32(uint32_t adler, const uint8_t* data, size_t size);
+
+/// Compare the decoding throughput of png_decode_file() with
+/// lodepng::decode() on the textures and check that the images agree.
+void png_decode_benchmark(std::ostream& os);
+
+
+//=============================================================================
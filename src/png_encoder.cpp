@@ -0,0 +1,709 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "png_encoder.hh"
+#include "png_decoder.hh"
+#include "thread_pool.hh"
+#include "trace.hh"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include "lodepng.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PNG_ENCODER_SSE2
+#include <emmintrin.h>
+#endif
+
+//=============================================================================
+
+
+namespace {
+
+
+/// filtered bytes per strip: large enough that the independent deflate
+/// streams lose little compression, small enough for a few strips per thread
+const size_t STRIP_BYTES = 256 * 1024;
+
+/// symbols per deflate block, each block gets its own Huffman codes
+const size_t BLOCK_SYMBOLS = 16384;
+
+/// bits of the LZ77 hash of 4 bytes
+const unsigned HASH_BITS = 15;
+
+
+inline void write_be32(uint8_t* p, uint32_t v)
+{
+    p[0] = uint8_t(v >> 24);
+    p[1] = uint8_t(v >> 16);
+    p[2] = uint8_t(v >> 8);
+    p[3] = uint8_t(v);
+}
+
+inline uint32_t read32(const uint8_t* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t read64(const uint8_t* p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+/// bases and extra bits of the length symbols 257..285 and distance symbols
+const uint16_t LENGTH_BASE[29]  = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t  LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t DIST_BASE[30]    = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+                                    513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t  DIST_EXTRA[30]   = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7,
+                                    8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/// order of the code length code lengths in a dynamic block header
+const uint8_t CODELEN_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+/// symbol (minus 257) of every match length, and distance symbol of every
+/// distance - 1: directly below 256, by its upper bits above (like zlib)
+struct SymbolTables {
+    uint8_t length[259];
+    uint8_t dist[512];
+
+    SymbolTables()
+    {
+        for (unsigned s = 0; s < 28; ++s)
+            for (unsigned l = LENGTH_BASE[s]; l < LENGTH_BASE[s] + (1u << LENGTH_EXTRA[s]) && l < 258; ++l)
+                length[l] = uint8_t(s);
+        length[258] = 28;
+        for (unsigned s = 0; s < 30; ++s)
+            for (unsigned d = DIST_BASE[s]; d < DIST_BASE[s] + (1u << DIST_EXTRA[s]); ++d)
+                (d - 1 < 256 ? dist[d - 1] : dist[256 + ((d - 1) >> 7)]) = uint8_t(s);
+    }
+
+    unsigned dist_symbol(unsigned d) const { return d - 1 < 256 ? dist[d - 1] : dist[256 + ((d - 1) >> 7)]; }
+};
+
+const SymbolTables& symbol_tables()
+{
+    static const SymbolTables tables;
+    return tables;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+/// Writes the bits of a deflate stream, least significant bit first
+class BitWriter
+{
+public:
+
+    explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+    /// append the n <= 32 lowest bits of value
+    void put(uint32_t value, unsigned n)
+    {
+        bits_ |= uint64_t(value) << count_;
+        count_ += n;
+        if (count_ >= 32) {
+            const uint8_t bytes[4] = { uint8_t(bits_), uint8_t(bits_ >> 8), uint8_t(bits_ >> 16), uint8_t(bits_ >> 24) };
+            out_.insert(out_.end(), bytes, bytes + 4);
+            bits_ >>= 32;
+            count_ -= 32;
+        }
+    }
+
+    /// pad with zero bits to the next byte boundary
+    void align()
+    {
+        for (; count_ > 0; count_ = count_ > 8 ? count_ - 8 : 0) {
+            out_.push_back(uint8_t(bits_));
+            bits_ >>= 8;
+        }
+        bits_ = 0;
+    }
+
+private:
+
+    std::vector<uint8_t>& out_;
+    uint64_t bits_ = 0;
+    unsigned count_ = 0;
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+/// Code lengths of a Huffman code for the given symbol frequencies, limited
+/// to max_bits by flattening the frequencies until the tree is shallow
+/// enough. At least two symbols get a code, as decoders expect.
+void huffman_lengths(const uint32_t* freq, unsigned n, unsigned max_bits, uint8_t* lengths)
+{
+    std::vector<uint32_t> f(freq, freq + n);
+    unsigned used = unsigned(std::count_if(f.begin(), f.end(), [](uint32_t x) { return x != 0; }));
+    for (unsigned s = 0; used < 2 && s < n; ++s)
+        if (!f[s]) f[s] = 1, ++used;
+
+    typedef std::pair<uint64_t, unsigned> Node;
+    std::vector<unsigned> parent(2 * n);
+    std::vector<uint8_t> depth(2 * n);
+    for (;;) {
+        // leaves are 0..n-1, inner nodes follow in the order they are merged,
+        // so every node comes before its parent
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+        for (unsigned s = 0; s < n; ++s)
+            if (f[s]) queue.push({ f[s], s });
+        unsigned next = n;
+        while (queue.size() > 1) {
+            Node a = queue.top(); queue.pop();
+            Node b = queue.top(); queue.pop();
+            parent[a.second] = parent[b.second] = next;
+            queue.push({ a.first + b.first, next++ });
+        }
+
+        depth[next - 1] = 0;
+        for (unsigned i = next - 1; i-- > 0;)
+            if (i >= n || f[i]) depth[i] = uint8_t(depth[parent[i]] + 1);
+
+        unsigned longest = 0;
+        for (unsigned s = 0; s < n; ++s) {
+            lengths[s] = f[s] ? depth[s] : 0;
+            longest = std::max<unsigned>(longest, lengths[s]);
+        }
+        if (longest <= max_bits) return;
+        for (uint32_t& x : f)
+            if (x) x = (x >> 1) | 1;
+    }
+}
+
+/// canonical codes of the given code lengths, bit-reversed for the writer
+void canonical_codes(const uint8_t* lengths, unsigned n, uint16_t* codes)
+{
+    unsigned count[16] = {};
+    for (unsigned s = 0; s < n; ++s) ++count[lengths[s]];
+    count[0] = 0;
+    unsigned next_code[16] = {};
+    for (unsigned len = 1, code = 0; len < 16; ++len) {
+        code = (code + count[len - 1]) << 1;
+        next_code[len] = code;
+    }
+    for (unsigned s = 0; s < n; ++s) {
+        unsigned len = lengths[s], code = len ? next_code[len]++ : 0, r = 0;
+        for (unsigned i = 0; i < len; ++i, code >>= 1) r = (r << 1) | (code & 1);
+        codes[s] = uint16_t(r);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+/// LZ77 symbols of a block: literal bytes, or MATCH | (length - 3) << 16 | (distance - 1)
+const uint32_t MATCH = 0x80000000u;
+
+/// write a non-final deflate block with Huffman codes made for its symbols
+void write_block(BitWriter& out, const std::vector<uint32_t>& symbols)
+{
+    const SymbolTables& tables = symbol_tables();
+
+    uint32_t freq[286 + 30] = {};
+    for (uint32_t sym : symbols) {
+        if (sym & MATCH) {
+            ++freq[257 + tables.length[((sym >> 16) & 255) + 3]];
+            ++freq[286 + tables.dist_symbol((sym & 0xffff) + 1)];
+        }
+        else ++freq[sym];
+    }
+    freq[256] = 1;
+
+    uint8_t lengths[286 + 30];
+    huffman_lengths(freq, 286, 15, lengths);
+    huffman_lengths(freq + 286, 30, 15, lengths + 286);
+    uint16_t codes[286 + 30];
+    canonical_codes(lengths, 286, codes);
+    canonical_codes(lengths + 286, 30, codes + 286);
+
+    unsigned hlit = 286, hdist = 30;
+    while (hlit > 257 && !lengths[hlit - 1]) --hlit;
+    while (hdist > 1 && !lengths[286 + hdist - 1]) --hdist;
+
+    // run-length code the code lengths of both alphabets: code length
+    // symbols with their extra bits in the upper byte
+    uint8_t all[286 + 30];
+    std::memcpy(all, lengths, hlit);
+    std::memcpy(all + hlit, lengths + 286, hdist);
+    const unsigned n = hlit + hdist;
+    uint16_t rle[286 + 30];
+    unsigned n_rle = 0;
+    uint32_t codelen_freq[19] = {};
+    for (unsigned i = 0; i < n;) {
+        const unsigned v = all[i];
+        unsigned run = 1;
+        while (i + run < n && all[i + run] == v) ++run;
+        i += run;
+        if (v == 0) {
+            while (run >= 11) {
+                unsigned r = std::min(run, 138u);
+                rle[n_rle++] = uint16_t(18 | (r - 11) << 8);
+                run -= r;
+            }
+            if (run >= 3) {
+                rle[n_rle++] = uint16_t(17 | (run - 3) << 8);
+                run = 0;
+            }
+        }
+        else {
+            rle[n_rle++] = uint16_t(v);
+            --run;
+            while (run >= 3) {
+                unsigned r = std::min(run, 6u);
+                rle[n_rle++] = uint16_t(16 | (r - 3) << 8);
+                run -= r;
+            }
+        }
+        for (; run; --run) rle[n_rle++] = uint16_t(v);
+    }
+    for (unsigned i = 0; i < n_rle; ++i) ++codelen_freq[rle[i] & 255];
+
+    uint8_t codelen_lengths[19];
+    uint16_t codelen_codes[19];
+    huffman_lengths(codelen_freq, 19, 7, codelen_lengths);
+    canonical_codes(codelen_lengths, 19, codelen_codes);
+    unsigned hclen = 19;
+    while (hclen > 4 && !codelen_lengths[CODELEN_ORDER[hclen - 1]]) --hclen;
+
+    // header
+    out.put(0, 1);
+    out.put(2, 2);
+    out.put(hlit - 257, 5);
+    out.put(hdist - 1, 5);
+    out.put(hclen - 4, 4);
+    for (unsigned i = 0; i < hclen; ++i) out.put(codelen_lengths[CODELEN_ORDER[i]], 3);
+    static const unsigned REPEAT_BITS[3] = { 2, 3, 7 };
+    for (unsigned i = 0; i < n_rle; ++i) {
+        const unsigned sym = rle[i] & 255;
+        out.put(codelen_codes[sym], codelen_lengths[sym]);
+        if (sym >= 16) out.put(rle[i] >> 8, REPEAT_BITS[sym - 16]);
+    }
+
+    // data
+    for (uint32_t sym : symbols) {
+        if (sym & MATCH) {
+            const unsigned length = ((sym >> 16) & 255) + 3, distance = (sym & 0xffff) + 1;
+            const unsigned ls = tables.length[length], ds = tables.dist_symbol(distance);
+            out.put(codes[257 + ls], lengths[257 + ls]);
+            out.put(length - LENGTH_BASE[ls], LENGTH_EXTRA[ls]);
+            out.put(codes[286 + ds], lengths[286 + ds]);
+            out.put(distance - DIST_BASE[ds], DIST_EXTRA[ds]);
+        }
+        else out.put(codes[sym], lengths[sym]);
+    }
+    out.put(codes[256], lengths[256]);
+}
+
+
+/// Deflate data into non-final blocks: greedy LZ77 with a single probe of a
+/// hash table of 4 byte sequences, matches within the data only.
+void deflate(const uint8_t* data, size_t n, BitWriter& out)
+{
+    std::vector<int32_t> head(size_t(1) << HASH_BITS, -1);
+    std::vector<uint32_t> symbols;
+    symbols.reserve(BLOCK_SYMBOLS + 4);
+
+    size_t i = 0;
+    while (i + 4 <= n) {
+        const uint32_t v = read32(data + i);
+        const uint32_t h = (v * 2654435761u) >> (32 - HASH_BITS);
+        const int32_t candidate = head[h];
+        head[h] = int32_t(i);
+
+        if (candidate >= 0 && i - size_t(candidate) <= 32768 && read32(data + candidate) == v) {
+            const uint8_t* a = data + candidate;
+            const uint8_t* b = data + i;
+            const size_t max = std::min<size_t>(258, n - i);
+            size_t len = 4;
+            while (len + 8 <= max && read64(a + len) == read64(b + len)) len += 8;
+            while (len < max && a[len] == b[len]) ++len;
+            symbols.push_back(MATCH | uint32_t(len - 3) << 16 | uint32_t(i - candidate - 1));
+            i += len;
+        }
+        else {
+            symbols.push_back(data[i++]);
+        }
+
+        if (symbols.size() >= BLOCK_SYMBOLS) {
+            write_block(out, symbols);
+            symbols.clear();
+        }
+    }
+    for (; i < n; ++i) symbols.push_back(data[i]);
+    if (!symbols.empty()) write_block(out, symbols);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+/// predictor of the Paeth filter
+inline int paeth(int a, int b, int c)
+{
+    const int pa = std::abs(b - c), pb = std::abs(a - c), pc = std::abs(a + b - 2 * c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+#ifdef PNG_ENCODER_SSE2
+/// Paeth predictors of 8 bytes on 16 bit lanes, as in png_decoder.cpp
+inline __m128i paeth8(__m128i a, __m128i b, __m128i c)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i pa = _mm_sub_epi16(b, c), pb = _mm_sub_epi16(a, c);
+    __m128i pc = _mm_add_epi16(pa, pb);
+    pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+    pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+    pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+    __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+    __m128i use_a = _mm_cmpeq_epi16(smallest, pa);
+    __m128i use_b = _mm_andnot_si128(use_a, _mm_cmpeq_epi16(smallest, pb));
+    __m128i p = _mm_or_si128(_mm_and_si128(use_a, a), _mm_and_si128(use_b, b));
+    return _mm_or_si128(p, _mm_andnot_si128(_mm_or_si128(use_a, use_b), c));
+}
+
+/// Paeth predictors of 16 bytes
+inline __m128i paeth16(__m128i a, __m128i b, __m128i c)
+{
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_packus_epi16(paeth8(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero)),
+                            paeth8(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero)));
+}
+#endif
+
+/// Apply a filter (0: None, 1: Sub, 2: Up, 4: Paeth) to a row of n bytes
+/// and return the sum of the absolute (signed) residuals. The filters only
+/// read the unfiltered rows, so they vectorize.
+size_t apply_filter(unsigned filter, const uint8_t* row, const uint8_t* prev, size_t n, unsigned bpp, uint8_t* out)
+{
+    size_t cost = 0, i = 0;
+    auto scalar = [&](size_t end) {
+        for (; i < end; ++i) {
+            const int a = i >= bpp ? row[i - bpp] : 0, b = prev[i], c = i >= bpp ? prev[i - bpp] : 0;
+            const int p = filter == 0 ? 0 : filter == 1 ? a : filter == 2 ? b : paeth(a, b, c);
+            out[i] = uint8_t(row[i] - p);
+            cost += std::abs(int(int8_t(out[i])));
+        }
+    };
+    scalar(std::min<size_t>(bpp, n));
+
+#ifdef PNG_ENCODER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m128i p = zero;
+        if (filter == 1)
+            p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i - bpp));
+        else if (filter == 2)
+            p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i));
+        else if (filter == 4)
+            p = paeth16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i - bpp)),
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i)),
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i - bpp)));
+        const __m128i r = _mm_sub_epi8(x, p);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), r);
+        // |r| as signed byte is min(r, -r) as unsigned byte
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_min_epu8(r, _mm_sub_epi8(zero, r)), zero));
+    }
+    cost += size_t(_mm_cvtsi128_si32(sum)) + size_t(_mm_cvtsi128_si32(_mm_unpackhi_epi64(sum, sum)));
+#endif
+
+    scalar(n);
+    return cost;
+}
+
+
+/// Filter a row with the filter type of the smallest sum of absolute
+/// (signed) residuals among None, Sub, Up and Paeth, the heuristic of the
+/// PNG specification; out receives the filter type and the row.
+void filter_row(const uint8_t* row, const uint8_t* prev, size_t n, unsigned bpp, uint8_t* out, uint8_t* scratch)
+{
+    out[0] = 0;
+    size_t best_cost = apply_filter(0, row, prev, n, bpp, out + 1);
+    for (unsigned filter : { 1, 2, 4 }) {
+        const size_t cost = apply_filter(filter, row, prev, n, bpp, scratch);
+        if (cost < best_cost) {
+            best_cost = cost;
+            out[0] = uint8_t(filter);
+            std::memcpy(out + 1, scratch, n);
+        }
+    }
+}
+
+
+/// a strip of rows, encoded as IDAT chunk
+struct Strip {
+    std::vector<uint8_t> chunk;
+    /// Adler-32 and size of its filtered rows
+    uint32_t adler = 1;
+    size_t size = 0;
+};
+
+void encode_strip(const uint8_t* pixels, unsigned width, unsigned height, unsigned channels, bool flip,
+                  PngCompression compression, unsigned y0, unsigned y1, bool first, bool last, Strip& strip)
+{
+    TRACE_SCOPE("png_encode::strip");
+
+    // filtered rows
+    const size_t row_bytes = size_t(width) * channels;
+    auto row = [&](unsigned y) { return pixels + size_t(flip ? height - 1 - y : y) * row_bytes; };
+    std::vector<uint8_t> filtered((row_bytes + 1) * (y1 - y0));
+    if (compression == PngCompression::Store) {
+        for (unsigned y = y0; y < y1; ++y) {
+            uint8_t* out = &filtered[(y - y0) * (row_bytes + 1)];
+            out[0] = 0;
+            std::memcpy(out + 1, row(y), row_bytes);
+        }
+    }
+    else {
+        std::vector<uint8_t> zero(row_bytes, 0), scratch(row_bytes);
+        for (unsigned y = y0; y < y1; ++y)
+            filter_row(row(y), y ? row(y - 1) : zero.data(), row_bytes, channels,
+                       &filtered[(y - y0) * (row_bytes + 1)], scratch.data());
+    }
+    strip.adler = png_adler32(1, filtered.data(), filtered.size());
+    strip.size = filtered.size();
+
+    // chunk length and type, filled in below
+    std::vector<uint8_t>& chunk = strip.chunk;
+    chunk.clear();
+    chunk.reserve(compression == PngCompression::Store ? filtered.size() + filtered.size() / 65535 * 5 + 32
+                                                        : filtered.size() / 2 + 64);
+    chunk.resize(8);
+    std::memcpy(&chunk[4], "IDAT", 4);
+    if (first) {
+        // zlib header: deflate with a 32K window, no dictionary, fastest
+        chunk.push_back(0x78);
+        chunk.push_back(0x01);
+    }
+
+    if (compression == PngCompression::Store) {
+        // stored blocks of up to 65535 bytes, the last one of the image final
+        for (size_t pos = 0; pos < filtered.size();) {
+            const size_t len = std::min<size_t>(65535, filtered.size() - pos);
+            const bool final = last && pos + len == filtered.size();
+            const uint8_t header[5] = { uint8_t(final), uint8_t(len), uint8_t(len >> 8),
+                                        uint8_t(~len), uint8_t(~len >> 8) };
+            chunk.insert(chunk.end(), header, header + 5);
+            chunk.insert(chunk.end(), &filtered[pos], &filtered[pos] + len);
+            pos += len;
+        }
+    }
+    else {
+        BitWriter out(chunk);
+        deflate(filtered.data(), filtered.size(), out);
+        if (last) {
+            // an empty final block with the fixed codes: BFINAL, BTYPE 01, end code
+            out.put(1, 1);
+            out.put(1, 2);
+            out.put(0, 7);
+            out.align();
+        }
+        else {
+            // an empty stored block aligns the stream to a byte, so that the
+            // next strip can start right behind it (zlib's sync flush)
+            out.put(0, 3);
+            out.align();
+            const uint8_t empty[4] = { 0, 0, 0xff, 0xff };
+            chunk.insert(chunk.end(), empty, empty + 4);
+        }
+    }
+
+    write_be32(&chunk[0], uint32_t(chunk.size() - 8));
+    const uint32_t crc = lodepng_crc32(&chunk[4], chunk.size() - 4);
+    chunk.resize(chunk.size() + 4);
+    write_be32(&chunk[chunk.size() - 4], crc);
+}
+
+
+/// Adler-32 of two pieces of data from theirs (zlib's adler32_combine())
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2)
+{
+    const uint32_t BASE = 65521;
+    const uint32_t rem = uint32_t(size2 % BASE);
+    uint32_t sum1 = adler1 & 0xffff;
+    uint32_t sum2 = uint32_t((uint64_t(rem) * sum1) % BASE);
+    sum1 += (adler2 & 0xffff) + BASE - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + BASE - rem;
+    if (sum1 >= BASE) sum1 -= BASE;
+    if (sum1 >= BASE) sum1 -= BASE;
+    if (sum2 >= 2 * BASE) sum2 -= 2 * BASE;
+    if (sum2 >= BASE) sum2 -= BASE;
+    return sum1 | (sum2 << 16);
+}
+
+
+void append_chunk(std::vector<uint8_t>& png, const char* type, const uint8_t* data, size_t size)
+{
+    const size_t start = png.size();
+    png.resize(start + 12 + size);
+    write_be32(&png[start], uint32_t(size));
+    std::memcpy(&png[start + 4], type, 4);
+    if (size) std::memcpy(&png[start + 8], data, size);
+    write_be32(&png[start + 8 + size], lodepng_crc32(&png[start + 4], size + 4));
+}
+
+
+} // namespace
+
+
+//=============================================================================
+
+
+void png_encode(std::vector<uint8_t>& png, const uint8_t* pixels, unsigned width, unsigned height,
+                unsigned channels, PngCompression compression, bool flip)
+{
+    TRACE_SCOPE("png_encode");
+
+    // encode the strips in parallel
+    const size_t stride = size_t(width) * channels + 1;
+    const unsigned rows = unsigned(std::max<size_t>(1, STRIP_BYTES / stride));
+    const unsigned n_strips = (height + rows - 1) / rows;
+    std::vector<Strip> strips(n_strips);
+    ThreadPool::instance().parallel_for(n_strips, 1, [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s) {
+            const unsigned y0 = unsigned(s) * rows, y1 = std::min(height, y0 + rows);
+            encode_strip(pixels, width, height, channels, flip, compression, y0, y1,
+                         s == 0, s + 1 == n_strips, strips[s]);
+        }
+    });
+
+    // signature, header, the strips, and the Adler-32 of the zlib stream in
+    // an IDAT chunk of its own
+    static const uint8_t SIGNATURE[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    size_t size = 8 + 25 + 16 + 12;
+    for (const Strip& strip : strips) size += strip.chunk.size();
+    png.clear();
+    png.reserve(size);
+    png.insert(png.end(), SIGNATURE, SIGNATURE + 8);
+
+    uint8_t ihdr[13];
+    write_be32(ihdr, width);
+    write_be32(ihdr + 4, height);
+    ihdr[8]  = 8;                      // bit depth
+    ihdr[9]  = channels == 4 ? 6 : 2;  // RGBA or RGB
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    append_chunk(png, "IHDR", ihdr, 13);
+
+    uint32_t adler = 1;
+    for (const Strip& strip : strips) {
+        png.insert(png.end(), strip.chunk.begin(), strip.chunk.end());
+        adler = adler32_combine(adler, strip.adler, strip.size);
+    }
+    uint8_t checksum[4];
+    write_be32(checksum, adler);
+    append_chunk(png, "IDAT", checksum, 4);
+    append_chunk(png, "IEND", nullptr, 0);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool png_encode_file(const std::string& filename, const uint8_t* pixels, unsigned width, unsigned height,
+                     unsigned channels, PngCompression compression, bool flip)
+{
+    std::vector<uint8_t> png;
+    png_encode(png, pixels, width, height, channels, compression, flip);
+
+    FILE* file = std::fopen(filename.c_str(), "wb");
+    if (!file) return false;
+    bool ok = std::fwrite(png.data(), 1, png.size(), file) == png.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void png_encode_benchmark(std::ostream& os)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // a 4K RGB frame: the starfield tiled as background, the earth at night
+    // in the middle
+    const unsigned width = 3840, height = 2160;
+    std::vector<uint8_t> frame(size_t(width) * height * 3, 0);
+    auto paste = [&](const char* name, unsigned x0, unsigned y0, bool tile) {
+        std::vector<uint8_t> img;
+        unsigned w, h;
+        if (png_decode_file(img, w, h, std::string(TEXTURE_PATH "/") + name)) return false;
+        for (unsigned y = y0; y < height && (tile || y < y0 + h); ++y)
+            for (unsigned x = x0; x < width && (tile || x < x0 + w); ++x)
+                std::memcpy(&frame[(size_t(y) * width + x) * 3], &img[(size_t((y - y0) % h) * w + (x - x0) % w) * 4], 3);
+        return true;
+    };
+    if (!paste("stars2.png", 0, 0, true) || !paste("night.png", (width - 2048) / 2, (height - 1024) / 2, false)) {
+        os << "textures not found" << std::endl;
+        return;
+    }
+    const double mb = frame.size() / 1e6;
+
+    os << "PNG encoding of a " << width << "x" << height << " RGB frame on "
+       << ThreadPool::instance().concurrency() << " threads (best of 3)\n"
+       << std::setw(20) << "encoder" << std::setw(14) << "time [ms]" << std::setw(12) << "[MB/s]"
+       << std::setw(14) << "size [KB]" << std::setw(10) << "ratio" << std::endl;
+
+    auto report = [&](const char* name, double ms, size_t size, bool ok) {
+        os << std::setw(20) << name << std::fixed << std::setprecision(2) << std::setw(14) << ms
+           << std::setprecision(0) << std::setw(12) << mb / ms * 1e3 << std::setw(14) << size / 1024.0
+           << std::setprecision(1) << std::setw(9) << 100.0 * size / frame.size() << "%"
+           << (ok ? "" : "  DECODES WRONG") << std::defaultfloat << std::endl;
+    };
+
+    // lodepng once, it takes a while
+    {
+        std::vector<uint8_t> png;
+        auto start = Clock::now();
+        lodepng::encode(png, frame, width, height, LCT_RGB);
+        report("lodepng", std::chrono::duration<double, std::milli>(Clock::now() - start).count(), png.size(), true);
+    }
+
+    for (PngCompression compression : { PngCompression::Store, PngCompression::Fast }) {
+        std::vector<uint8_t> png;
+        double best = 1e30;
+        for (int run = 0; run < 3; ++run) {
+            auto start = Clock::now();
+            png_encode(png, frame.data(), width, height, 3, compression);
+            best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+
+        // decode it again and compare
+        std::vector<uint8_t> rgba(size_t(width) * height * 4);
+        unsigned w, h;
+        bool ok = !png_inspect(png.data(), png.size(), w, h) && w == width && h == height &&
+                  !png_decode(png.data(), png.size(), rgba.data(), w, h);
+        for (size_t i = 0; ok && i < size_t(width) * height; ++i)
+            ok = std::memcmp(&rgba[4 * i], &frame[3 * i], 3) == 0;
+        report(compression == PngCompression::Store ? "png_encode store" : "png_encode fast", best, png.size(), ok);
+    }
+}
+
+
+//=============================================================================
@@ -0,0 +1,46 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+//=============================================================================
+
+
+/// Compression of png_encode()
+enum class PngCompression {
+    Store,   ///< no filter, stored deflate blocks: memory bandwidth, for recording
+    Fast,    ///< per-row filter choice, greedy LZ77 with one hash probe, Huffman codes per block
+};
+
+
+/// Encode an 8 bit RGB (channels = 3) or RGBA (4) image as PNG, e.g. a
+/// frame dump. Rows are top to bottom, or bottom to top, as glReadPixels()
+/// returns them, if flip is set. The image is cut into strips of rows that
+/// are filtered and deflated in parallel on the thread pool, each into an
+/// independent, byte-aligned piece of the zlib stream (like pigz does), which
+/// becomes an IDAT chunk of its own. An encode called from a thread pool job
+/// runs on that thread alone.
+void png_encode(std::vector<uint8_t>& png, const uint8_t* pixels, unsigned width, unsigned height,
+                unsigned channels, PngCompression compression = PngCompression::Fast, bool flip = false);
+
+/// png_encode() into a file; false if it cannot be written
+bool png_encode_file(const std::string& filename, const uint8_t* pixels, unsigned width, unsigned height,
+                     unsigned channels, PngCompression compression = PngCompression::Fast, bool flip = false);
+
+/// Compare the encoding time and size of png_encode() with lodepng::encode()
+/// on a 4K frame made of the textures and check that it decodes to the frame.
+void png_encode_benchmark(std::ostream& os);
+
+
+//=============================================================================
@@ -0,0 +1,201 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "procedural_texture.hh"
+#include "trace.hh"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <tuple>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PROCEDURAL_TEXTURE_SSE2
+#include <emmintrin.h>
+#endif
+
+//=============================================================================
+
+
+void pack_rgba8(const float* __restrict r, const float* __restrict g, const float* __restrict b,
+                const float* __restrict a, size_t n, uint8_t* __restrict rgba)
+{
+    size_t i = 0;
+
+#ifdef PROCEDURAL_TEXTURE_SSE2
+    // Four pixels at a time; the saturating packs clamp to [0, 255]. The
+    // bytes come out as r0-3 b0-3 g0-3 a0-3 and are interleaved by two
+    // unpacks with the upper half.
+    const __m128 scale = _mm_set1_ps(255.0f);
+    for (; i + 4 <= n; i += 4) {
+        __m128i ri = _mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(r + i), scale), scale));
+        __m128i gi = _mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(g + i), scale), scale));
+        __m128i bi = _mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(b + i), scale), scale));
+        __m128i ai = _mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(a + i), scale), scale));
+        __m128i x = _mm_packus_epi16(_mm_packs_epi32(ri, bi), _mm_packs_epi32(gi, ai));
+        x = _mm_unpacklo_epi8(x, _mm_srli_si128(x, 8));
+        x = _mm_unpacklo_epi16(x, _mm_srli_si128(x, 8));
+        _mm_storeu_si128((__m128i*)(rgba + 4 * i), x);
+    }
+#endif
+
+    auto to_byte = [](float x) { return uint8_t(int(std::min(std::max(x, 0.0f), 1.0f) * 255.0f + 0.5f)); };
+    for (; i < n; ++i) {
+        rgba[4 * i + 0] = to_byte(r[i]);
+        rgba[4 * i + 1] = to_byte(g[i]);
+        rgba[4 * i + 2] = to_byte(b[i]);
+        rgba[4 * i + 3] = to_byte(a[i]);
+    }
+}
+
+
+//=============================================================================
+
+
+namespace {
+
+/// the glow of GlowParams as pixel function of generate_texture()
+void generate_glow(std::vector<uint8_t>& rgba, const GlowParams& p)
+{
+    const float outer = p.outer_radius, scale = 1.0f / (p.outer_radius - p.inner_radius);
+    const float falloff = p.falloff;
+    const float red = p.red / 255.0f, green = p.green / 255.0f, blue = p.blue / 255.0f;
+    const float highlight = p.highlight_green / 255.0f;
+
+    generate_texture(rgba, p.size, p.size, [=](float u, float v, float& r, float& g, float& b, float& a) {
+        const float x = 2.0f * u - 1.0f, y = 2.0f * v - 1.0f;
+        const float d = std::sqrt(x * x + y * y);
+        // 1 inside the disk, falling to 0 at the outer radius
+        const float t = std::min(std::max((outer - d) * scale, 0.0f), 1.0f);
+        a = fast_pow(t, falloff);
+        r = red;
+        g = std::max(highlight * a, green);
+        b = blue;
+    });
+}
+
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool GlowParams::operator<(const GlowParams& o) const
+{
+    return std::tie(size, inner_radius, outer_radius, falloff, red, green, blue, highlight_green) <
+           std::tie(o.size, o.inner_radius, o.outer_radius, o.falloff, o.red, o.green, o.blue, o.highlight_green);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+const std::vector<uint8_t>& glow_sprite(const GlowParams& params)
+{
+    // entries are never removed, so references to them stay valid
+    static std::map<GlowParams, std::vector<uint8_t>> cache;
+    static std::mutex mutex;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(params);
+    if (it == cache.end()) {
+        TRACE_SCOPE("glow_sprite");
+        it = cache.emplace(params, std::vector<uint8_t>()).first;
+        generate_glow(it->second, params);
+    }
+    return it->second;
+}
+
+
+//=============================================================================
+
+
+void procedural_texture_benchmark(std::ostream& os)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // the former loop of Texture::createSunBillboardTexture(), scaled to the
+    // size (including its green channel carried over from pixel to pixel)
+    auto reference = [](std::vector<uint8_t>& img, int size) {
+        img.resize(size_t(size) * size * 4);
+        float center = size / 2.0f;
+        float inner_radius = size / 6.0f, outer_radius = size / 2.0f;
+        uint8_t R = 255, G = 110, B = 50;
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                float dist_x = std::fabs(x - center);
+                float dist_y = std::fabs(y - center);
+                float dist_center = sqrtf(dist_x * dist_x + dist_y * dist_y);
+                float alpha;
+                if (dist_center < inner_radius) {
+                    alpha = 1;
+                }
+                else if (dist_center < outer_radius) {
+                    float rel_dist = (outer_radius - dist_center) / (outer_radius - inner_radius);
+                    alpha = powf(rel_dist, 3.5f);
+                    G = std::max(200 * alpha, 90.0f);
+                }
+                else {
+                    alpha = 0;
+                }
+                img[(y * size + x) * 4 + 0] = R;
+                img[(y * size + x) * 4 + 1] = G;
+                img[(y * size + x) * 4 + 2] = B;
+                img[(y * size + x) * 4 + 3] = uint8_t(255 * alpha);
+            }
+        }
+    };
+
+    auto time = [](auto&& f) {
+        double best = 1e30;
+        for (int run = 0; run < 3; ++run) {
+            auto start = Clock::now();
+            f();
+            best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+        return best;
+    };
+
+    os << "Sun halo generation (best of 3)\n"
+       << std::setw(12) << "size" << std::setw(16) << "serial [ms]" << std::setw(16) << "1 thread [ms]"
+       << std::setw(16) << "pool [ms]" << std::setw(10) << "speedup" << std::setw(16) << "max alpha diff" << std::endl;
+
+    for (unsigned size : { 900u, 4096u }) {
+        GlowParams params;
+        params.size = size;
+        std::vector<uint8_t> old_img, img;
+
+        double serial_ms = time([&] { reference(old_img, int(size)); });
+
+        double single_ms;
+        {
+            ThreadPool::set_thread_serial(true);
+            single_ms = time([&] { generate_glow(img, params); });
+            ThreadPool::set_thread_serial(false);
+        }
+        double pool_ms = time([&] { generate_glow(img, params); });
+
+        // the former image sampled pixel corners, this one pixel centers
+        int diff = 0;
+        for (size_t i = 3; i < img.size(); i += 4) diff = std::max(diff, std::abs(int(img[i]) - int(old_img[i])));
+
+        os << std::setw(12) << (std::to_string(size) + "x" + std::to_string(size))
+           << std::fixed << std::setprecision(2)
+           << std::setw(16) << serial_ms << std::setw(16) << single_ms << std::setw(16) << pool_ms
+           << std::setprecision(1) << std::setw(9) << serial_ms / pool_ms << "x"
+           << std::defaultfloat << std::setw(16) << diff << std::endl;
+    }
+    os << ThreadPool::instance().concurrency() << " threads" << std::endl;
+}
+
+
+//=============================================================================
@@ -0,0 +1,141 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "thread_pool.hh"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include <vector>
+
+//=============================================================================
+
+
+/// Pack row chunks of float colors (clamped to [0, 1]) into RGBA8 pixels.
+void pack_rgba8(const float* r, const float* g, const float* b, const float* a,
+                size_t n, uint8_t* rgba);
+
+
+/// Fill a width x height RGBA8 image with f(u, v, r, g, b, a), which
+/// computes the color in [0, 1] of the pixel centered at texture coordinates
+/// (u, v), with v = 0 at the first row (the bottom row for OpenGL). Rows are
+/// spread over the thread pool. Each row is evaluated in chunks into float
+/// arrays, so that a branch-free f (selects, std::min/max, std::sqrt,
+/// fast_pow() instead of pow) inlines into a loop the compiler vectorizes.
+template <class F>
+void generate_texture(std::vector<uint8_t>& rgba, unsigned width, unsigned height, const F& f)
+{
+    rgba.resize(size_t(width) * height * 4);
+    const float du = 1.0f / width, dv = 1.0f / height;
+
+    ThreadPool::instance().parallel_for(height, 16, [&](size_t begin, size_t end) {
+        const size_t CHUNK = 256;
+        alignas(32) float r[CHUNK], g[CHUNK], b[CHUNK], a[CHUNK];
+
+        for (size_t y = begin; y < end; ++y) {
+            const float v = (float(y) + 0.5f) * dv;
+            uint8_t* row = &rgba[y * width * 4];
+            for (size_t x0 = 0; x0 < width; x0 += CHUNK) {
+                const size_t n = std::min(CHUNK, width - x0);
+                for (size_t i = 0; i < n; ++i) {
+                    const float u = (float(int(x0 + i)) + 0.5f) * du;
+                    float pr, pg, pb, pa;
+                    f(u, v, pr, pg, pb, pa);
+                    r[i] = pr; g[i] = pg; b[i] = pb; a[i] = pa;
+                }
+                pack_rgba8(r, g, b, a, n, row + 4 * x0);
+            }
+        }
+    });
+}
+
+
+/// Branch-free 2^x, relative error below 2e-7; results below 2^-126 flush
+/// to zero. Vectorizes inside loops.
+inline float fast_exp2(float x)
+{
+    x = std::min(std::max(x, -127.0f), 127.0f);
+    // biased exponent of 2^round(x); x + 127.5 > 0, so truncation rounds down
+    const int e = int(x + 127.5f);
+    // Taylor polynomial of 2^f on [-1/2, 1/2]
+    const float f = x - float(e - 127);
+    const float p = 1.0f + f * (0.693147181f + f * (0.240226507f + f * (0.0555041087f +
+                    f * (0.00961812911f + f * (0.00133335581f + f * 0.000154035304f)))));
+    const int32_t bits = e << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+/// Branch-free log2(x) for normal x > 0, absolute error below 1e-6.
+/// Vectorizes inside loops.
+inline float fast_log2(float x)
+{
+    int32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    // x = m 2^e with m in [sqrt(1/2), sqrt(2))
+    int32_t e = ((bits - 0x3f3504f3) >> 23);
+    bits -= e * (1 << 23);
+    float m;
+    std::memcpy(&m, &bits, sizeof(m));
+    // log2(m) = 2/ln(2) atanh(s) with s = (m - 1) / (m + 1), |s| < 0.172
+    const float s = (m - 1.0f) / (m + 1.0f), s2 = s * s;
+    const float l = s * (2.88539008f + s2 * (0.961796694f + s2 * (0.577078016f + s2 * 0.412198583f)));
+    return float(e) + l;
+}
+
+/// Branch-free x^y for x >= 0 (0 for x = 0 and y > 0) via fast_exp2() and
+/// fast_log2(), relative error about 1e-6 * |y log2 x|.
+inline float fast_pow(float x, float y)
+{
+    const float p = fast_exp2(y * fast_log2(std::max(x, 1e-30f)));
+    return x > 0.0f ? p : 0.0f;
+}
+
+
+//=============================================================================
+
+
+/// Parameters of a radial glow sprite: an opaque disk that fades out
+/// towards the border of the square image, e.g. the sun's halo. Radii are
+/// relative to half the image size.
+struct GlowParams
+{
+    /// width and height in pixels
+    unsigned size = 900;
+    /// radius of the opaque disk and radius where the glow has faded out
+    float inner_radius = 1.0f / 3.0f;
+    float outer_radius = 1.0f;
+    /// exponent of the fall-off (alpha = t^falloff, t from 1 to 0 between
+    /// the radii)
+    float falloff = 3.5f;
+    /// color of the glow (0..255); close to the disk the green channel
+    /// rises to highlight_green times alpha, a yellow highlight
+    float red = 255.0f, green = 90.0f, blue = 50.0f;
+    float highlight_green = 200.0f;
+
+    bool operator<(const GlowParams& other) const;
+};
+
+
+/// The RGBA8 image of a glow sprite, bottom row first. Generated with
+/// generate_texture() on first use and cached by its parameters, so that
+/// sprites of the same look are made only once; thread-safe.
+const std::vector<uint8_t>& glow_sprite(const GlowParams& params);
+
+
+/// Time the generation of the sun halo at its size and at 4K: the former
+/// serial loop with sqrtf() and powf() per pixel against generate_texture()
+/// on one thread and on the thread pool.
+void procedural_texture_benchmark(std::ostream& os);
+
+
+//=============================================================================
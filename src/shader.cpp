@@ -8,15 +8,177 @@
 //=============================================================================
 
 #include "shader.hh"
+#include "trace.hh"
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
 #include <cassert>
-
-class cannot_compile_shader : public std::runtime_error {
-    using std::runtime_error::runtime_error;
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+#ifdef SHADER_CACHE_PATH
+std::filesystem::path binary_cache_dir = SHADER_CACHE_PATH;
+#else
+std::filesystem::path binary_cache_dir;
+#endif
+
+Shader::LoadStats stats;
+
+/// header of a file of the program binary cache
+struct BinaryHeader {
+    static const uint32_t MAGIC = 0x42505353; // "SSPB"
+    uint32_t magic = MAGIC;
+    GLenum format = 0;
+    uint64_t key = 0;
+    uint32_t length = 0, reserved = 0;
 };
 
+/// whether program binaries can be cached (GL 4.1 or ARB_get_program_binary
+/// with at least one binary format, and a cache directory)
+bool binary_cache_supported()
+{
+    static const bool supported = [] {
+        if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }();
+    return supported && !binary_cache_dir.empty();
+}
+
+std::filesystem::path binary_path(uint64_t key)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return binary_cache_dir / name;
+}
+
+bool read_file(const std::filesystem::path& filename, std::string& text)
+{
+    std::ifstream ifs(filename);
+    if (!ifs) return false;
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    text = ss.str();
+    return true;
+}
+
+/// whether the driver compiles and links in the background and reports
+/// when it is done (GL_COMPLETION_STATUS_KHR, the same as the ARB token)
+bool parallel_compile_supported()
+{
+    static const bool supported = [] {
+        if (GLEW_ARB_parallel_shader_compile) return true;
+        GLint n = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+        for (GLint i = 0; i < n; ++i) {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (name && std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0) return true;
+        }
+        return false;
+    }();
+    return supported;
+}
+
+/// print the log of a shader that failed to compile, with the files of the
+/// source string numbers in it; return whether it compiled
+bool check_compiled(GLint id, const std::filesystem::path& filename,
+                    const std::vector<std::filesystem::path>& files)
+{
+    GLint status;
+    glGetShaderiv(id, GL_COMPILE_STATUS, &status);
+    if (status == GL_TRUE) return true;
+
+    GLint length;
+    glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
+
+    std::string info(length + 1, ' ');
+    glGetShaderInfoLog(id, length, NULL, &info[0]);
+    std::cerr << "Shader: Cannot compile shader \""  << filename.string() << "\"\n" << info.c_str();
+    for (size_t i = 0; i < files.size(); ++i)
+        std::cerr << "  source " << i << ": " << files[i].string() << "\n";
+    std::cerr << std::endl;
+    return false;
+}
+
+/// Append a shader file with its #include directives expanded to \c out,
+/// the definitions after its #version line if there are any (see
+/// Shader::preprocess()). \c included holds the files of this shader so far.
+bool expand(const std::filesystem::path& filename, const ShaderDefines* defines,
+            std::vector<std::filesystem::path>& files, std::vector<std::filesystem::path>& included,
+            int& glsl_version, std::string& out)
+{
+    const std::string index = std::to_string(files.size());
+    files.push_back(filename);
+    std::string text;
+    if (!read_file(filename, text)) {
+        std::cerr << "Shader: Cannot open file \""  << filename.string() << "\"\n";
+        return false;
+    }
+
+    // before GLSL 3.30, "#line n" numbers the line after the next one n
+    auto line_directive = [&](int next_line, const std::string& source) {
+        return "#line " + std::to_string(glsl_version < 330 ? next_line - 1 : next_line) + " " + source + "\n";
+    };
+    auto insert_defines = [&](int next_line) {
+        for (const auto& define : *defines)
+            out += "#define " + define.first + " " + define.second + "\n";
+        out += line_directive(next_line, index);
+        defines = nullptr;
+    };
+    // without #version the definitions come first
+    if (defines && text.find("#version") == std::string::npos) insert_defines(1);
+
+    std::istringstream lines(text);
+    std::string line;
+    for (int number = 1; std::getline(lines, line); ++number) {
+        const size_t start = line.find_first_not_of(" \t");
+        if (start != std::string::npos && line.compare(start, 8, "#include") == 0) {
+            const size_t open = line.find('"', start + 8);
+            const size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos) {
+                std::cerr << "Shader: Malformed #include in \"" << filename.string() << "\" line " << number << "\n";
+                return false;
+            }
+            std::filesystem::path file = (filename.parent_path() / line.substr(open + 1, close - open - 1)).lexically_normal();
+            if (std::find(included.begin(), included.end(), file) == included.end()) {
+                included.push_back(file);
+                out += line_directive(1, std::to_string(files.size()));
+                if (!expand(file, nullptr, files, included, glsl_version, out)) return false;
+                out += line_directive(number + 1, index);
+            }
+            else {
+                out += "\n";
+            }
+            continue;
+        }
+
+        out += line;
+        out += '\n';
+        if (start != std::string::npos && line.compare(start, 8, "#version") == 0) {
+            glsl_version = std::atoi(line.c_str() + start + 8);
+            if (defines) insert_defines(number + 1);
+        }
+    }
+    return true;
+}
+
+void count_program(std::chrono::steady_clock::time_point start, bool cached)
+{
+    ++stats.programs;
+    if (cached) ++stats.cached;
+    stats.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
 
 //=============================================================================
 
@@ -47,6 +209,22 @@ void Shader::cleanup()
     if (gid_) glDeleteShader(gid_);
 
     pid_ = vid_ = fid_ = gid_ = 0;
+
+    discard_pending();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Shader::discard_pending()
+{
+    if (pending_pid_) glDeleteProgram(pending_pid_);
+    if (pending_vid_) glDeleteShader(pending_vid_);
+    if (pending_fid_) glDeleteShader(pending_fid_);
+    if (pending_gid_) glDeleteShader(pending_gid_);
+
+    pending_pid_ = pending_vid_ = pending_fid_ = pending_gid_ = 0;
 }
 
 
@@ -64,64 +242,159 @@ bool Shader::load(std::filesystem::path const&  _vfile,
     return reload();
 }
 
+
+//-----------------------------------------------------------------------------
+
+
 bool Shader::reload()
 {
-    cleanup();
+    TRACE_SCOPE("Shader::reload");
+    for (auto& variant : variants_) variant.second->reload();
+    if (!begin_program_reload()) return false;
+    return !pending_pid_ || finish_reload();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool Shader::begin_reload()
+{
+    for (auto& variant : variants_) variant.second->begin_reload();
+    return begin_program_reload();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool Shader::begin_program_reload()
+{
+    TRACE_SCOPE("Shader::begin_reload");
+    reload_start_ = std::chrono::steady_clock::now();
     glCheckError();
 
-    // create program
-    GLint new_pid = glCreateProgram();
+    // read and preprocess the sources; they key the binary cache
+    const std::filesystem::path* files[3] = { &vfile_, &ffile_, &gfile_ };
+    std::string sources[3];
+    const int n_files = gfile_.empty() ? 2 : 3;
+    files_.clear();
+    for (int i = 0; i < n_files; ++i) {
+        if (!preprocess(*files[i], sources[i])) return false;
+    }
+
+    // a reload still in flight is superseded
+    discard_pending();
+
+    const uint64_t key = binary_key(sources, n_files);
+    if (GLint cached = load_binary(key)) {
+        cleanup();
+        pid_ = cached;
+        count_program(reload_start_, true);
+        return true;
+    }
+
+    // compile and link without asking for the status, which would wait for
+    // the driver; finish_reload() checks it
+    pending_key_ = key;
+    pending_pid_ = glCreateProgram();
+    pending_vid_ = load_and_compile(vfile_, sources[0], GL_VERTEX_SHADER);
+    pending_fid_ = load_and_compile(ffile_, sources[1], GL_FRAGMENT_SHADER);
+    if (!gfile_.empty())
+        pending_gid_ = load_and_compile(gfile_, sources[2], GL_GEOMETRY_SHADER);
+
+    for (GLint id : { pending_vid_, pending_fid_, pending_gid_ })
+        if (id) glAttachShader(pending_pid_, id);
+
+    if (binary_cache_supported())
+        glProgramParameteri(pending_pid_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(pending_pid_);
     glCheckError();
 
-    try {
-        // vertex shader
-        GLint new_vid = load_and_compile(vfile_, GL_VERTEX_SHADER);
-        glCheckError();
-        if (new_vid)  glAttachShader(new_pid, new_vid);
-        glCheckError();
-
-        // fragment shader
-        GLint new_fid = load_and_compile(ffile_, GL_FRAGMENT_SHADER);
-        if (new_fid)  glAttachShader(new_pid, new_fid);
-
-        glCheckError();
-
-        GLint new_gid = 0;
-        // geometry shader
-        if (!gfile_.empty())
-        {
-            new_gid = load_and_compile(gfile_, GL_GEOMETRY_SHADER);
-            if (new_gid)  glAttachShader(new_pid, new_gid);
-        }
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool Shader::poll_reload()
+{
+    bool done = true;
+    for (auto& variant : variants_)
+        if (!variant.second->poll_reload()) done = false;
+
+    if (!pending_pid_) return done;
+
+    if (parallel_compile_supported()) {
+        GLint linked = GL_FALSE;
+        glGetProgramiv(pending_pid_, GL_COMPLETION_STATUS_ARB, &linked);
+        if (!linked) return false;
+    }
+
+    finish_reload();
+    return done;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool Shader::reloading() const
+{
+    if (pending_pid_) return true;
+    for (const auto& variant : variants_)
+        if (variant.second->reloading()) return true;
+    return false;
+}
+
+
+//-----------------------------------------------------------------------------
+
 
+bool Shader::finish_reload()
+{
+    TRACE_SCOPE("Shader::finish_reload");
 
-        // link program
-        glLinkProgram(new_pid);
-        GLint status;
-        glGetProgramiv(new_pid, GL_LINK_STATUS, &status);
-        if (status == GL_FALSE)
-        {
+    GLint status;
+    glGetProgramiv(pending_pid_, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE)
+    {
+        // report the shader that does not compile, or else the link error
+        const std::filesystem::path* files[3] = { &vfile_, &ffile_, &gfile_ };
+        const GLint ids[3] = { pending_vid_, pending_fid_, pending_gid_ };
+        bool compiled = true;
+        for (int i = 0; i < 3; ++i)
+            if (ids[i] && !check_compiled(ids[i], *files[i], files_)) compiled = false;
+
+        if (compiled) {
             GLint length;
-            glGetProgramiv(new_pid, GL_INFO_LOG_LENGTH, &length);
+            glGetProgramiv(pending_pid_, GL_INFO_LOG_LENGTH, &length);
 
             std::string info(length + 1, ' ');
-            glGetProgramInfoLog(new_pid, length, NULL, &info[0]);
+            glGetProgramInfoLog(pending_pid_, length, NULL, &info[0]);
             std::cerr << "Shader: Cannot link program:\n" << info << std::endl;
-            throw std::runtime_error("cannot link opengl shader");
-
-            cleanup();
-
-            return false;
         }
-        glCheckError();
-        pid_ = new_pid;
-        vid_ = new_vid;
-        fid_ = new_fid;
-        gid_ = new_gid;
-    } catch (cannot_compile_shader &) {
+
+        // keep the current program
+        discard_pending();
         return false;
     }
 
+    if (pid_) glDeleteProgram(pid_);
+    if (vid_) glDeleteShader(vid_);
+    if (fid_) glDeleteShader(fid_);
+    if (gid_) glDeleteShader(gid_);
+
+    pid_ = pending_pid_;
+    vid_ = pending_vid_;
+    fid_ = pending_fid_;
+    gid_ = pending_gid_;
+    pending_pid_ = pending_vid_ = pending_fid_ = pending_gid_ = 0;
+    glCheckError();
+
+    save_binary(pid_, pending_key_);
+    count_program(reload_start_, false);
     return true;
 }
 
@@ -129,55 +402,169 @@ bool Shader::reload()
 //-----------------------------------------------------------------------------
 
 
-GLint Shader::load_and_compile(std::filesystem::path const& filename, GLenum type)
+bool Shader::depends_on(const std::filesystem::path& file) const
 {
-    // read file to string
-    std::ifstream  ifs(filename);
-    if (!ifs)
-    {
-        std::cerr << "Shader: Cannot open file \""  << filename << "\"\n";
-        return 0;
+    std::error_code error;
+    for (const std::filesystem::path& f : files_)
+        if (std::filesystem::equivalent(f, file, error)) return true;
+    return false;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+Shader& Shader::variant(const ShaderDefines& defines)
+{
+    if (defines.empty()) return *this;
+
+    auto it = variants_.find(defines);
+    if (it == variants_.end()) {
+        TRACE_SCOPE("Shader::variant");
+        std::unique_ptr<Shader> shader(new Shader);
+        shader->defines_ = defines;
+        shader->load(vfile_, ffile_, gfile_);
+        it = variants_.emplace(defines, std::move(shader)).first;
     }
-    std::stringstream  ss;
-    ss << ifs.rdbuf();
-    std::string str = ss.str();
-    ifs.close();
+    return *it->second;
+}
 
-    const char* source = str.c_str();
 
-    // create shader
-    GLint id = glCreateShader(type);
-    if (!id)
-    {
-        std::cerr << "Shader: Cannot create shader object for \""  << filename.string() << "\"\n";
+//-----------------------------------------------------------------------------
+
+
+bool Shader::preprocess(std::filesystem::path const& filename, std::string& source)
+{
+    std::vector<std::filesystem::path> included;
+    int glsl_version = 110;
+    source.clear();
+    return expand(filename, &defines_, files_, included, glsl_version, source);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Shader::set_binary_cache(const std::filesystem::path& directory)
+{
+    binary_cache_dir = directory;
+}
+
+
+const Shader::LoadStats& Shader::load_stats()
+{
+    return stats;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+uint64_t Shader::binary_key(const std::string* sources, int n)
+{
+    // FNV-1a over the sources and the driver strings, each followed by a
+    // zero byte so that moving text from one to the next changes the key
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&](const char* s, size_t length) {
+        for (size_t i = 0; i <= length; ++i) {
+            hash ^= i < length ? uint8_t(s[i]) : 0;
+            hash *= 0x100000001b3ull;
+        }
+    };
+    for (int i = 0; i < n; ++i) add(sources[i].data(), sources[i].size());
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+        const char* s = (const char*)glGetString(name);
+        if (!s) s = "";
+        add(s, std::strlen(s));
+    }
+    return hash;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+GLint Shader::load_binary(uint64_t key)
+{
+    if (!binary_cache_supported()) return 0;
+
+    std::ifstream ifs(binary_path(key), std::ios::binary);
+    if (!ifs) return 0;
+    BinaryHeader header;
+    std::vector<char> binary;
+    if (ifs.read((char*)&header, sizeof(header)) && header.magic == BinaryHeader::MAGIC && header.key == key) {
+        binary.resize(header.length);
+        if (!ifs.read(binary.data(), binary.size())) binary.clear();
+    }
+    if (binary.empty()) return 0;
+
+    // the driver may still reject the binary, e.g. after an update that
+    // kept its version string; then the program is compiled from source
+    GLint pid = glCreateProgram();
+    glProgramBinary(pid, header.format, binary.data(), GLsizei(binary.size()));
+    GLint status = GL_FALSE;
+    glGetProgramiv(pid, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        glDeleteProgram(pid);
+        (void)glGetError();
         return 0;
     }
+    return pid;
+}
 
 
-    // compile vertex shader
-    glShaderSource(id, 1, &source, NULL);
-    glCompileShader(id);
+//-----------------------------------------------------------------------------
 
 
-    // check compile status
-    GLint status;
-    glGetShaderiv(id, GL_COMPILE_STATUS, &status);
-    if (status == GL_FALSE)
+void Shader::save_binary(GLint pid, uint64_t key)
+{
+    if (!binary_cache_supported()) return;
+
+    GLint length = 0;
+    glGetProgramiv(pid, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    std::vector<char> binary(length);
+    BinaryHeader header;
+    header.key = key;
+    glGetProgramBinary(pid, length, &length, &header.format, binary.data());
+    header.length = uint32_t(length);
+
+    // write a temporary file and rename it, so that a viewer starting at
+    // the same time never reads a partial binary
+    std::error_code error;
+    std::filesystem::create_directories(binary_cache_dir, error);
+    std::filesystem::path path = binary_path(key), tmp = path;
+    tmp += ".tmp";
     {
-        GLint length;
-        glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
+        std::ofstream ofs(tmp, std::ios::binary);
+        ofs.write((const char*)&header, sizeof(header));
+        ofs.write(binary.data(), header.length);
+        if (!ofs) return;
+    }
+    std::filesystem::rename(tmp, path, error);
+}
+
+
+//-----------------------------------------------------------------------------
 
-        std::string info(length + 1, ' ');
-        glGetShaderInfoLog(id, length, NULL, &info[0]);
 
-        std::cerr << "Shader: Cannot compile shader \""  << filename.string() << "\"\n" << info << std::endl;
-        glDeleteShader(id);
-        throw cannot_compile_shader("cannot compile opengl shader: " + info);
+GLint Shader::load_and_compile(std::filesystem::path const& filename, const std::string& str, GLenum type)
+{
+    const char* source = str.c_str();
 
+    // create shader
+    GLint id = glCreateShader(type);
+    if (!id)
+    {
+        std::cerr << "Shader: Cannot create shader object for \""  << filename.string() << "\"\n";
         return 0;
     }
 
 
+    // compile shader; the driver may do so in the background
+    glShaderSource(id, 1, &source, NULL);
+    glCompileShader(id);
+
     return id;
 }
 
@@ -10,11 +10,27 @@
 
 #include "gl.hh"
 #include "glmath.hh"
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
 //=============================================================================
 
+/// Preprocessor definitions (name and value) of a shader variant, e.g.
+/// {{"GREYSCALE", ""}}
+typedef std::map<std::string, std::string> ShaderDefines;
+
+
 /// shader class for easy handling of the shader
+///
+/// The shader files may include others with #include "file" (relative to the
+/// including file; each file is included once). Variants specialised at
+/// compile time by preprocessor definitions, e.g. for features a uniform
+/// would otherwise switch, are compiled on first use by variant().
 class Shader
 {
 public:
@@ -38,9 +54,46 @@ public:
               std::filesystem::path const&  ffile,
               std::filesystem::path const&  gfile={});
 
-    /// re-load shaders from files, useful for debugging
+    /// re-load shaders from files, useful for debugging; waits for the new
+    /// program. If it does not compile or link, the old program stays.
     bool reload();
 
+    /// Start re-loading the shaders from their files without waiting for
+    /// the driver to compile and link them; the old program stays in use
+    /// until poll_reload() finds the new one linked. Returns false if the
+    /// files cannot be read.
+    bool begin_reload();
+
+    /// Finish a reload started by begin_reload() once the program is
+    /// linked: if it linked successfully it replaces the old program, else
+    /// the errors are printed and the old program stays. Without
+    /// KHR_parallel_shader_compile the program is waited for. Returns true
+    /// if the reload is over.
+    bool poll_reload();
+
+    /// whether a reload started by begin_reload() is still in flight
+    bool reloading() const;
+
+    /// whether the program is made from the given shader file (including
+    /// the files it includes)
+    bool depends_on(const std::filesystem::path& file) const;
+
+    /// The variant of this program compiled with the given definitions
+    /// inserted after the #version line (this program for none). Variants
+    /// are loaded on first use and kept; reloads include them.
+    Shader& variant(const ShaderDefines& defines);
+
+    /// Directory of the program binary cache (empty: no cache). Linked
+    /// programs are stored there with glGetProgramBinary() and loaded with
+    /// glProgramBinary() instead of being compiled, as long as their
+    /// sources and the GL vendor, renderer and version are unchanged.
+    static void set_binary_cache(const std::filesystem::path& directory);
+
+    /// programs loaded and linked since startup, how many came from the
+    /// binary cache, and the time it took (ms)
+    struct LoadStats { unsigned int programs = 0, cached = 0; double ms = 0.0; };
+    static const LoadStats& load_stats();
+
     /// deletes all shader and frees GPU shader capacities
     void cleanup();
 
@@ -60,13 +113,48 @@ public:
     void set_uniform(const char* name, const T &value, bool optional = false);
 
 private:
-    /// loads a vertex/fragment/geometry shader from a file and compiles it
-    /// \param filename the location and name of the shader
+    /// starts compiling a vertex/fragment/geometry shader read from a file;
+    /// its status is checked when the program is linked
+    /// \param filename the location and name of the shader (for messages)
+    /// \param source the source code read from it
     /// \param type the type of the shader (vertex, geometry, fragment)
-    GLint load_and_compile(std::filesystem::path const& filename, GLenum type);
+    GLint load_and_compile(std::filesystem::path const& filename, const std::string& source, GLenum type);
+
+    /// begin_reload() of this program without its variants
+    bool begin_program_reload();
+
+    /// check the pending program and make it the current one if it linked;
+    /// returns whether it did
+    bool finish_reload();
+
+    /// delete the program and shaders of a reload in flight
+    void discard_pending();
+
+    /// Read a shader file, expand its #include directives and insert the
+    /// definitions after its #version line. #line directives keep the
+    /// line numbers of compiler messages; their source string number is the
+    /// index of the file in files_, where the files read are appended.
+    bool preprocess(std::filesystem::path const& filename, std::string& source);
+
+    /// key of the program in the binary cache: a hash of the (preprocessed)
+    /// sources and of the GL vendor, renderer and version
+    static uint64_t binary_key(const std::string* sources, int n);
+
+    /// create the program from its cached binary, 0 if there is none or
+    /// the driver rejects it
+    static GLint load_binary(uint64_t key);
+
+    /// store the binary of a linked program in the cache
+    static void save_binary(GLint pid, uint64_t key);
 
 private:
     std::filesystem::path vfile_, ffile_, gfile_;
+    /// definitions of this variant
+    ShaderDefines defines_;
+    /// files read for the program, in order of their source string numbers
+    std::vector<std::filesystem::path> files_;
+    /// variants of this program by their definitions
+    std::map<ShaderDefines, std::unique_ptr<Shader>> variants_;
     /// id of the linked shader program
     GLint pid_ = 0;
     /// id of the vertex shader
@@ -75,6 +163,12 @@ private:
     GLint fid_ = 0;
     /// id of the geometry shader
     GLint gid_ = 0;
+
+    /// program and shaders of a reload in flight, the key of its binary
+    /// and when it started
+    GLint pending_pid_ = 0, pending_vid_ = 0, pending_fid_ = 0, pending_gid_ = 0;
+    uint64_t pending_key_ = 0;
+    std::chrono::steady_clock::time_point reload_start_;
 };
 
 inline void set_uniform_by_location(int loc, bool         val) { glUniform1i       (loc, static_cast<int>(val));          }
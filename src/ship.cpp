@@ -1,4 +1,5 @@
 #include "ship.hh"
+#include "trace.hh"
 #include <fstream>
 #include <string>
 
@@ -16,6 +17,7 @@ Ship::~Ship()
 
 bool Ship::load_model(const char* _filename)
 {
+    TRACE_SCOPE("Ship::load_model");
 
     // implements a simple OFF reader
 
@@ -116,6 +118,13 @@ void Ship::update_ship()
     pos_ += speed_*direction_;
 }
 
+void Ship::fall(const vec3& acceleration, float days)
+{
+    // semi-implicit Euler, i.e. symplectic like the planets' leapfrog
+    velocity_ += days * vec4(acceleration, 0.f);
+    pos_ += days * velocity_;
+}
+
 void Ship::draw()
 {
     if (n_indices_ == 0) initialize_buffers();
@@ -23,6 +23,10 @@ class Ship
         /// changes ship's angular speed
         void accelerate_angular(float angular_speedup);
 
+        /// lets the ship fall for the given time (in days) with the given
+        /// gravitational acceleration
+        void fall(const vec3& acceleration, float days);
+
         /// draws the ship
         void draw();
 
@@ -76,5 +80,8 @@ public:
 
         /// current angular speed (angle_ += angular_speed)
         float angular_speed_ = 0.f;
+
+        /// velocity gained by falling (in units per day, see fall())
+        vec4 velocity_ = vec4{0, 0, 0, 0};
 };
 
@@ -9,14 +9,21 @@
 
 #include "solar_viewer.hh"
 #include "glmath.hh"
+#include "thread_pool.hh"
+#include "trace.hh"
+#include "allocation_tracker.hh"
 #include <cstdlib>     /* srand, rand */
 #include <array>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
 
 //=============================================================================
 
 
-Solar_viewer::Solar_viewer(const char* _title, int _width, int _height)
-    : GLFW_window(_title, _width, _height),
+Solar_viewer::Solar_viewer(const char* _title, int _width, int _height, bool _headless)
+    : GLFW_window(_title, _width, _height, _headless),
     unit_sphere_(50), //level of tesselation
 
     sun_    (0.0,              2.0*M_PI/26.0,   1.0f,    0.0f),
@@ -25,8 +32,18 @@ Solar_viewer::Solar_viewer(const char* _title, int _width, int _height)
     earth_  (2.0*M_PI/365.0f,  2.0*M_PI,        0.25,   -3.3f),
     moon_   (2.0*M_PI/27.0f,   0.0,  0.04,   -0.4f),
     mars_   (2.0*M_PI/687.0f,  2.0*M_PI*24.0/25.0, 0.15,-5.0f),
-    stars_  (0.0, 0.0, 21.0, 0.0)
+    stars_  (0.0, 0.0, 21.0, 0.0),
+    asteroids_(5.6f, 6.8f)
 {
+    // orbit shapes (eccentricity, inclination, ascending node, argument of
+    // periapsis) of the real bodies; the moon's orbit is relative to the
+    // ecliptic as well
+    mercury_.set_orbit(0.2056f, 7.00f,  48.3f,  29.1f);
+    venus_  .set_orbit(0.0068f, 3.39f,  76.7f,  54.9f);
+    earth_  .set_orbit(0.0167f, 0.00f,   0.0f, 102.9f);
+    mars_   .set_orbit(0.0934f, 1.85f,  49.6f, 286.5f);
+    moon_   .set_orbit(0.0549f, 5.15f, 125.1f, 318.1f);
+
     // start animation
     timer_active_ = true;
     time_step_ = 1.0f/24.0f; // one hour
@@ -46,6 +63,8 @@ void
     Solar_viewer::
     keyboard(int key, int /*scancode*/, int action, int /*mods*/)
 {
+    quiet_frames_ = 0;
+
     if (action == GLFW_PRESS || action == GLFW_REPEAT)
     {
         // Change view between the various bodies with keys 1..6
@@ -85,6 +104,9 @@ void
         case GLFW_KEY_G:
         {
             greyscale_ = !greyscale_;
+            // the shaders' greyscale variants are compiled on first use
+            if (greyscale_) shader_defines_ = { { "GREYSCALE", "" } };
+            else shader_defines_.clear();
             break;
         }
 
@@ -169,13 +191,55 @@ void
             break;
         }
 
+        case GLFW_KEY_N:
+        {
+            resize_asteroid_belt(std::max<size_t>(1000, 2 * asteroids_.size()));
+            break;
+        }
+
+        case GLFW_KEY_B:
+        {
+            resize_asteroid_belt(asteroids_.size() / 2);
+            break;
+        }
+
+        case GLFW_KEY_K:
+        {
+            if (nbody_active_) stop_nbody();
+            else start_nbody();
+            break;
+        }
+
+        case GLFW_KEY_LEFT_BRACKET:
+        case GLFW_KEY_RIGHT_BRACKET:
+        {
+            float theta = nbody_.theta() + (key == GLFW_KEY_LEFT_BRACKET ? -0.1f : 0.1f);
+            nbody_.set_theta(std::min(1.5f, std::max(0.0f, theta)));
+            std::cout << "Barnes-Hut theta: " << nbody_.theta() << std::endl;
+            break;
+        }
+
+        case GLFW_KEY_F2:
+        {
+            gpu_profiler_.report(std::cout);
+            std::ofstream ofs("gpu_trace.json");
+            gpu_profiler_.write_trace(ofs);
+            std::cout << "GPU trace written to gpu_trace.json" << std::endl;
+            break;
+        }
+
+        case GLFW_KEY_F3:
+        {
+            write_trace("trace.json", 10.0);
+            break;
+        }
+
         case GLFW_KEY_J:
         {
+            // compiled in the background, see update_shaders()
             std::cout << "Reloading shaders..." << std::endl;
-            color_shader_.reload();
-            phong_shader_.reload();
-            earth_shader_.reload();
-            sun_shader_.reload();
+            for (Shader* shader : shaders())
+                reloading_shaders_ |= shader->begin_reload();
 
             break;
         }
@@ -192,42 +256,122 @@ void
 // around their orbits. This position is needed to set up the camera in the scene
 // (see Solar_viewer::paint)
 void Solar_viewer::update_body_positions() {
+    TRACE_SCOPE("update_body_positions");
 
     sun_.pos_ = vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
 
-    auto place_orbiting = [](const Planet &body, const vec4 &center) -> vec4 {
-        // start at distance on the positive x-axis
-        vec4 local_pos = vec4(body.distance_, 0.0f, 0.0f, 1.0f);
+    // Evaluate all orbits in one batch. A negative distance_ only rotates the
+    // orbit by 180 degrees, so it is used as semi-major axis as is.
+    std::array<Planet*, 5> bodies = { &mercury_, &venus_, &earth_, &mars_, &moon_ };
+    planet_orbits_.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        KeplerElements el;
+        el.a    = bodies[i]->distance_;
+        el.e    = bodies[i]->eccentricity_;
+        el.i    = bodies[i]->inclination_;
+        el.node = bodies[i]->ascending_node_;
+        el.peri = bodies[i]->periapsis_;
+        el.M    = bodies[i]->angle_orbit_;
+        planet_orbits_.set(i, el);
+    }
+
+    std::array<float, KeplerOrbits::LANES> x, y, z; // one lane group suffices
+    planet_orbits_.positions(0, bodies.size(), x.data(), y.data(), z.data());
+
+    // planets orbit the sun
+    for (size_t i = 0; i + 1 < bodies.size(); ++i)
+        bodies[i]->pos_ = sun_.pos_ + vec4(x[i], y[i], z[i], 0.0f);
+
+    // in N-body mode, the sun and the planets follow the simulation instead
+    if (nbody_active_) {
+        sun_.pos_ = vec4(nbody_.position(0), 1.0f);
+        for (size_t i = 0; i < 4; ++i)
+            bodies[i]->pos_ = vec4(nbody_.position(i + 1), 1.0f);
+        asteroids_.set_positions(nbody_.x() + 5, nbody_.y() + 5, nbody_.z() + 5);
+    }
 
-        // convert radians to degrees (rotate_y expects degrees)
-        float angle_degrees = body.angle_orbit_ * 180.0f / (float)M_PI;
+    // the moon stays on its Kepler orbit around the (simulated) earth
+    moon_.pos_ = earth_.pos_ + vec4(x[4], y[4], z[4], 0.0f);
 
-        // rotate clockwise around y-axis (negate angle for clockwise)
-        mat4 rotation = mat4::rotate_y(-angle_degrees);
-        vec4 rotated_pos = rotation * local_pos;
+}
 
-        // translate to the center (orbit center)
-        mat4 translation = mat4::translate(vec3(center.x, center.y, center.z));
-        return translation * rotated_pos;
-    };
+//-----------------------------------------------------------------------------
 
-    // planets orbit the sun
-    mercury_.pos_ = place_orbiting(mercury_, sun_.pos_);
-    venus_  .pos_ = place_orbiting(venus_,   sun_.pos_);
-    earth_  .pos_ = place_orbiting(earth_,   sun_.pos_);
-    mars_   .pos_ = place_orbiting(mars_,    sun_.pos_);
 
-    // moon orbits the earth
-    moon_.pos_ = place_orbiting(moon_, earth_.pos_);
+std::array<Shader*, 7> Solar_viewer::shaders()
+{
+    return { &color_shader_, &phong_shader_, &earth_shader_, &vt_feedback_shader_,
+             &sun_shader_, &solid_color_shader_, &asteroid_shader_ };
+}
 
+
+//-----------------------------------------------------------------------------
+
+
+void Solar_viewer::update_shaders()
+{
+    // reading, preprocessing and caching shaders allocates
+    if (shader_watcher_.poll(changed_shader_files_)) {
+        quiet_frames_ = 0;
+        for (Shader* shader : shaders()) {
+            for (const std::filesystem::path& file : changed_shader_files_) {
+                if (shader->depends_on(file)) {
+                    std::cout << "Reloading shaders using " << file.filename() << "..." << std::endl;
+                    reloading_shaders_ |= shader->begin_reload();
+                    break;
+                }
+            }
+        }
+    }
+
+    if (!reloading_shaders_) return;
+    quiet_frames_ = 0;
+
+    // all compiles were started together; take each program once it is linked
+    bool done = true;
+    for (Shader* shader : shaders())
+        if (shader->reloading() && !shader->poll_reload()) done = false;
+    if (done) {
+        reloading_shaders_ = false;
+        std::cout << "Shader reload done" << std::endl;
+    }
 }
 
+
 //-----------------------------------------------------------------------------
 
 
 void Solar_viewer::timer()
 {
+    TRACE_SCOPE("timer");
+
+    // the timer starts a frame: release the transient data of two frames ago
+    frame_arena_.begin_frame();
+
+    if (bench_) {
+        bench_->begin_frame();
+        bench_->begin_stage(Benchmark::STAGE_TIMER);
+        script_benchmark();
+    }
+
+    update_shaders();
+
+    // stream the pages of the bump map the last feedback pass asked for
+    earth_.bump_.update(8);
+
+    // upload at most one finished texture per frame to keep frames smooth
+    if (loaded_time_ < 0.0) {
+        texture_loader_.update(1);
+        quiet_frames_ = 0;
+        if (texture_loader_.done()) {
+            loaded_time_ = glfwGetTime();
+            std::cout << "Time to fully loaded: " << int(1000.0 * loaded_time_) << " ms (resident memory "
+                      << AllocationTracker::resident_bytes() / (1 << 20) << " MB, peak "
+                      << AllocationTracker::peak_resident_bytes() / (1 << 20) << " MB)" << std::endl;
+        }
+    }
+
     if (timer_active_) {
         sun_.time_step(time_step_);
         mercury_.time_step(time_step_);
@@ -235,8 +379,20 @@ void Solar_viewer::timer()
         earth_.time_step(time_step_);
         moon_.time_step(time_step_);
         mars_.time_step(time_step_);
+
+        if (nbody_active_) {
+            // leapfrog steps of at most 6 hours
+            const int steps = std::max(1, int(std::ceil(time_step_ / 0.25f)));
+            const float dt = time_step_ / steps;
+            for (int s = 0; s < steps; ++s) {
+                nbody_.step(dt);
+                ship_.fall(nbody_.acceleration_at(vec3(ship_.pos_)), dt);
+            }
+        }
         update_body_positions();
 
+        asteroids_.time_step(time_step_);
+
         ship_.update_ship();
 
         // Desired ship speed (in units of Euclidean distance per animation
@@ -248,6 +404,8 @@ void Solar_viewer::timer()
         vec3 tangent = ship_path_.tangent(ship_path_param_);
         ship_path_frame_.alignTo(tangent);
     }
+
+    if (bench_) bench_->end_stage(Benchmark::STAGE_TIMER);
 }
 
 
@@ -256,6 +414,7 @@ void Solar_viewer::timer()
 
 void Solar_viewer::resize(int _width, int _height)
 {
+    quiet_frames_ = 0;
     width_  = _width;
     height_ = _height;
     glViewport(0, 0, _width, _height);
@@ -266,43 +425,60 @@ void Solar_viewer::resize(int _width, int _height)
 
 void Solar_viewer::initialize()
 {
+    TRACE_SCOPE("initialize");
+
     // set initial state
     glClearColor(1,1,1,0);
     glEnable(GL_DEPTH_TEST);
 
     // Allocate textures
     sun_    .tex_.init(GL_TEXTURE0, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
-    mercury_.tex_.init(GL_TEXTURE0, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
-    venus_  .tex_.init(GL_TEXTURE0, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
 
     earth_  .tex_.init(GL_TEXTURE0, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
     earth_.night_.init(GL_TEXTURE1, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
-    earth_.cloud_.init(GL_TEXTURE2, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
-    earth_.gloss_.init(GL_TEXTURE3, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
+    earth_.cloud_gloss_.init(GL_TEXTURE2, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
 
-    moon_   .tex_.init(GL_TEXTURE0, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
-    mars_   .tex_.init(GL_TEXTURE0, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
     stars_  .tex_.init(GL_TEXTURE0, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
     ship_   .tex_.init(GL_TEXTURE0, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
 
     sunglow_.tex_.init(GL_TEXTURE0, GL_TEXTURE_2D, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
 
-    // Load/generate textures
-    sun_    .tex_.loadPNG(TEXTURE_PATH "/sun.png");
-    mercury_.tex_.loadPNG(TEXTURE_PATH "/mercury.png");
-    venus_  .tex_.loadPNG(TEXTURE_PATH "/venus.png");
+    // the phong-shaded bodies share one texture array, one layer per body
+    planet_textures_.init(GL_TEXTURE0, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
+    mercury_.layer_ = 0;
+    venus_  .layer_ = 1;
+    mars_   .layer_ = 2;
+    moon_   .layer_ = 3;
 
-    earth_  .tex_.loadPNG(TEXTURE_PATH "/day.png");
-    earth_.night_.loadPNG(TEXTURE_PATH "/night.png");
-    earth_.cloud_.loadPNG(TEXTURE_PATH "/clouds.png");
-    earth_.gloss_.loadPNG(TEXTURE_PATH "/gloss.png");
+    // Load/generate textures: the png files are decoded in the background
+    // and uploaded by timer(), until then each texture shows a placeholder
+    // color close to its average
+    texture_loader_.load(sun_    .tex_, TEXTURE_PATH "/sun.png", 255, 170, 60);
 
-    moon_   .tex_.loadPNG(TEXTURE_PATH "/moon.png");
-    mars_   .tex_.loadPNG(TEXTURE_PATH "/mars.png");
-    stars_  .tex_.loadPNG(TEXTURE_PATH "/stars2.png");
+    texture_loader_.load(earth_  .tex_, TEXTURE_PATH "/day.png", 40, 70, 120);
+    texture_loader_.load(earth_.night_, TEXTURE_PATH "/night.png", 0, 0, 0);
+    texture_loader_.load_packed(earth_.cloud_gloss_, { TEXTURE_PATH "/clouds.png",
+                                                       TEXTURE_PATH "/gloss.png" }, 0, 0, 0);
+
+    // (layers in the order given by the bodies' layer_ above)
+    texture_loader_.load(planet_textures_, { TEXTURE_PATH "/mercury.png",
+                                             TEXTURE_PATH "/venus.png",
+                                             TEXTURE_PATH "/mars.png",
+                                             TEXTURE_PATH "/moon.png" }, 140, 130, 120);
+
+    texture_loader_.load(stars_  .tex_, TEXTURE_PATH "/stars2.png", 0, 0, 0);
 
     ship_.     load_model(TEXTURE_PATH "/spaceship.off");
-    ship_   .tex_.loadPNG(TEXTURE_PATH "/ship.png");
+    texture_loader_.load(ship_   .tex_, TEXTURE_PATH "/ship.png", 128, 128, 128);
+
+    // the bump map only exists paged (texture_baker --paged, see bake_assets)
+    if (earth_.bump_.open(BAKED_TEXTURE_PATH "/earth_bumpmap_flat_8192x4096.btex")) {
+        std::cout << "Virtual texture earth_bumpmap_flat_8192x4096: page cache of "
+                  << earth_.bump_.cache_bytes() / 1024 << " KB" << std::endl;
+    }
+    else {
+        std::cout << "No paged bump map (run make bake_assets), earth without bumps" << std::endl;
+    }
 
     sunglow_.tex_.createSunBillboardTexture();
 
@@ -310,16 +486,27 @@ void Solar_viewer::initialize()
     color_shader_.load(SHADER_PATH "/color.vert", SHADER_PATH "/color.frag");
     phong_shader_.load(SHADER_PATH "/phong.vert", SHADER_PATH "/phong.frag");
     earth_shader_.load(SHADER_PATH "/earth.vert", SHADER_PATH "/earth.frag");
-    sun_shader_.  load(SHADER_PATH   "/sun.vert", SHADER_PATH   "/sun.frag");
+    vt_feedback_shader_.load(SHADER_PATH "/earth.vert", SHADER_PATH "/vt_feedback.frag");
+    sun_shader_.  load(SHADER_PATH   "/sun.vert", SHADER_PATH   "/color.frag");
 
     solid_color_shader_.load(SHADER_PATH "/solid_color.vert", SHADER_PATH "/solid_color.frag");
+    asteroid_shader_.load(SHADER_PATH "/asteroid.vert", SHADER_PATH "/asteroid.frag");
+
+    // reload shaders as soon as they are saved
+    shader_watcher_.watch(SHADER_PATH);
+
+    const Shader::LoadStats& stats = Shader::load_stats();
+    std::cout << "Shaders: " << stats.programs << " programs in " << stats.ms << " ms ("
+              << stats.cached << " from the binary cache)" << std::endl;
+
+    resize_asteroid_belt(20000);
 
     ship_path_renderer_.initialize();
     ship_path_cp_renderer_.initialize();
     ship_path_frame_.initialize();
 
     ship_path_.set_control_polygon(control_polygon_, true);
-    ship_path_renderer_.sample(ship_path_);
+    ship_path_renderer_.sample(ship_path_, frame_arena_.resource());
     ship_path_cp_renderer_.setPoints(ship_path_.bezier_control_points());
 }
 //-----------------------------------------------------------------------------
@@ -327,6 +514,18 @@ void Solar_viewer::initialize()
 
 void Solar_viewer::paint()
 {
+    TRACE_SCOPE("paint");
+
+    double now = glfwGetTime();
+    if (last_paint_time_ > 0.0) {
+        frame_seconds_ += now - last_paint_time_;
+        ++frames_;
+    }
+    last_paint_time_ = now;
+
+    if (bench_) bench_->begin_gpu();
+    gpu_profiler_.begin_frame();
+
     // clear framebuffer and depth buffer first
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -373,8 +572,29 @@ void Solar_viewer::paint()
 
 
 
-    draw_scene(projection, view);
+    // CPU-side visibility: level of detail of the asteroids
+    if (bench_) bench_->begin_stage(Benchmark::STAGE_CULL);
+    asteroids_.cull(vec3(eye), frame_arena_);
+    if (bench_) bench_->end_stage(Benchmark::STAGE_CULL);
+
+    if (bench_) bench_->begin_stage(Benchmark::STAGE_DRAW_SCENE);
+    {
+        GpuProfiler::Scope scope(gpu_profiler_, "draw_scene");
+        draw_scene(projection, view);
+    }
+    if (bench_) bench_->end_stage(Benchmark::STAGE_DRAW_SCENE);
 
+    if (bench_) bench_->end_gpu();
+
+    // read back the frame before the buffer swap
+    if (recorder_) {
+        if (bench_) bench_->begin_stage(Benchmark::STAGE_CAPTURE);
+        {
+            GpuProfiler::Scope scope(gpu_profiler_, "capture");
+            recorder_->capture(width_, height_);
+        }
+        if (bench_) bench_->end_stage(Benchmark::STAGE_CAPTURE);
+    }
 }
 
 
@@ -382,21 +602,33 @@ void Solar_viewer::paint()
 
 void Solar_viewer::draw_scene(mat4& _projection, mat4& _view)
 {
-    switch (curve_display_mode_) {
-    case CURVE_SHOW_PATH_FRAME:
-        ship_path_frame_.draw(solid_color_shader_, _projection * _view, ship_path_(ship_path_param_));
-    case CURVE_SHOW_PATH_CP:
-        solid_color_shader_.use();
-        solid_color_shader_.set_uniform("modelview_projection_matrix", _projection * _view);
-        solid_color_shader_.set_uniform("color", vec4(0.8, 0.8, 0.8, 1.0));
-        ship_path_cp_renderer_.draw();
-    case CURVE_SHOW_PATH:
-        solid_color_shader_.use();
-        solid_color_shader_.set_uniform("modelview_projection_matrix", _projection * _view);
-        solid_color_shader_.set_uniform("color", vec4(1.0, 0.0, 0.0, 1.0));
-        ship_path_renderer_.draw();
-    default:
-        break;
+    TRACE_SCOPE("draw_scene");
+
+    // the variants of the shaders for the rendering mode (greyscale or not)
+    Shader& color_shader    = color_shader_.variant(shader_defines_);
+    Shader& sun_shader      = sun_shader_.variant(shader_defines_);
+    Shader& phong_shader    = phong_shader_.variant(shader_defines_);
+    Shader& asteroid_shader = asteroid_shader_.variant(shader_defines_);
+    Shader& earth_shader    = earth_shader_.variant(shader_defines_);
+
+    {
+        GpuProfiler::Scope scope(gpu_profiler_, "curves");
+        switch (curve_display_mode_) {
+        case CURVE_SHOW_PATH_FRAME:
+            ship_path_frame_.draw(solid_color_shader_, _projection * _view, ship_path_(ship_path_param_));
+        case CURVE_SHOW_PATH_CP:
+            solid_color_shader_.use();
+            solid_color_shader_.set_uniform("modelview_projection_matrix", _projection * _view);
+            solid_color_shader_.set_uniform("color", vec4(0.8, 0.8, 0.8, 1.0));
+            ship_path_cp_renderer_.draw();
+        case CURVE_SHOW_PATH:
+            solid_color_shader_.use();
+            solid_color_shader_.set_uniform("modelview_projection_matrix", _projection * _view);
+            solid_color_shader_.set_uniform("color", vec4(1.0, 0.0, 0.0, 1.0));
+            ship_path_renderer_.draw();
+        default:
+            break;
+        }
     }
 
     // the matrices we need: model, modelview, modelview-projection, normal
@@ -414,18 +646,20 @@ void Solar_viewer::draw_scene(mat4& _projection, mat4& _view)
     if (timer_active_) sun_animation_time += 0.01f;
 
     // render sun
-    m_matrix = mat4::rotate_y(sun_.angle_self_) * mat4::scale(sun_.radius_);
-    mv_matrix = _view * m_matrix;
-    mvp_matrix = _projection * mv_matrix;
+    {
+        GpuProfiler::Scope scope(gpu_profiler_, "sun");
+        m_matrix = mat4::rotate_y(sun_.angle_self_) * mat4::scale(sun_.radius_);
+        mv_matrix = _view * m_matrix;
+        mvp_matrix = _projection * mv_matrix;
 
-    sun_shader_.use();
-    sun_shader_.set_uniform("modelview_projection_matrix", mvp_matrix);
-    sun_shader_.set_uniform("t", sun_animation_time, true /* Indicate that time parameter is optional;
-                                                             it may be optimized away by the GLSL    compiler if it's unused. */);
-    sun_shader_.set_uniform("tex", 0);
-    sun_shader_.set_uniform("greyscale", (int)greyscale_);
-    sun_.tex_.bind();
-    unit_sphere_.draw();
+        sun_shader.use();
+        sun_shader.set_uniform("modelview_projection_matrix", mvp_matrix);
+        sun_shader.set_uniform("t", sun_animation_time, true /* Indicate that time parameter is optional;
+                                                                 it may be optimized away by the GLSL    compiler if it's unused. */);
+        sun_shader.set_uniform("tex", 0);
+        sun_.tex_.bind();
+        unit_sphere_.draw();
+    }
 
 
     /** \todo Switch from using color_shader_ to the fancier shaders you'll
@@ -439,92 +673,118 @@ void Solar_viewer::draw_scene(mat4& _projection, mat4& _view)
      */
 
     //render star background
-    m_matrix = mat4::scale(stars_.radius_);
-    mv_matrix = _view * m_matrix;
-    mvp_matrix = _projection * mv_matrix;
+    {
+        GpuProfiler::Scope scope(gpu_profiler_, "stars");
+        m_matrix = mat4::scale(stars_.radius_);
+        mv_matrix = _view * m_matrix;
+        mvp_matrix = _projection * mv_matrix;
+
+        color_shader.use();
+        color_shader.set_uniform("modelview_projection_matrix", mvp_matrix);
+        color_shader.set_uniform("tex", 0);
+        stars_.tex_.bind();
+        unit_sphere_.draw();
+    }
+
 
-    color_shader_.use();
-    color_shader_.set_uniform("modelview_projection_matrix", mvp_matrix);
-    color_shader_.set_uniform("tex", 0);
-    color_shader_.set_uniform("greyscale", (int)greyscale_);
-    stars_.tex_.bind();
-    unit_sphere_.draw();
 
+    // render all phong-shaded bodies with a single instanced draw call
+    {
+        GpuProfiler::Scope scope(gpu_profiler_, "planets");
+        std::pmr::vector<Instance> phong_instance_data(frame_arena_.resource());
+        phong_instance_data.reserve(4);
+        for (Planet* planet : { &mercury_, &venus_, &mars_, &moon_ }) {
+            m_matrix = mat4::translate(planet->pos_) *
+                       mat4::rotate_y(planet->angle_self_) *
+                       mat4::scale(planet->radius_);
+            phong_instance_data.emplace_back(m_matrix, float(planet->layer_));
+        }
+        phong_instances_.upload(phong_instance_data.data(), phong_instance_data.size());
+
+        phong_shader.use();
+        phong_shader.set_uniform("view_matrix", _view);
+        phong_shader.set_uniform("projection_matrix", _projection);
+        phong_shader.set_uniform("tex_array", 0);
+        phong_shader.set_uniform("light_position", light);
+        planet_textures_.bind();
+        unit_sphere_.draw_instanced(phong_instances_);
+    }
 
+    // render the asteroid belt (as binned by the last cull)
+    {
+        GpuProfiler::Scope scope(gpu_profiler_, "asteroids");
+        asteroid_shader.use();
+        asteroid_shader.set_uniform("view_matrix", _view);
+        asteroid_shader.set_uniform("projection_matrix", _projection);
+        asteroid_shader.set_uniform("light_position", light);
+        asteroids_.draw();
+    }
 
-    //lambda function for simple planets
-    auto draw_planet = [&](Planet& planet) {
-        m_matrix = mat4::translate(planet.pos_) *
-                   mat4::rotate_y(planet.angle_self_) *
-                   mat4::scale(planet.radius_);
+    // render Earth with special shader
+    {
+        GpuProfiler::Scope scope(gpu_profiler_, "earth");
+        m_matrix = mat4::translate(earth_.pos_) *
+                   mat4::rotate_y(earth_.angle_self_) *
+                   mat4::scale(earth_.radius_);
 
         mv_matrix = _view * m_matrix;
         mvp_matrix = _projection * mv_matrix;
         mat3 normal_matrix = mat3(transpose(inverse(mv_matrix)));
 
-        phong_shader_.use();
-        phong_shader_.set_uniform("modelview_projection_matrix", mvp_matrix);
-        phong_shader_.set_uniform("tex", 0);
-        phong_shader_.set_uniform("greyscale", (int)greyscale_);
-        phong_shader_.set_uniform("modelview_matrix", mv_matrix);
-        phong_shader_.set_uniform("normal_matrix", normal_matrix);
-        phong_shader_.set_uniform("light_position", light);
-
-        planet.tex_.bind();
-        unit_sphere_.draw();
-    };
-
-    draw_planet(mercury_);
-    draw_planet(venus_);
-    draw_planet(mars_);
-
-    // render Earth with special shader
-    m_matrix = mat4::translate(earth_.pos_) *
-               mat4::rotate_y(earth_.angle_self_) *
-               mat4::scale(earth_.radius_);
-
-    mv_matrix = _view * m_matrix;
-    mvp_matrix = _projection * mv_matrix;
-    mat3 normal_matrix = mat3(transpose(inverse(mv_matrix)));
+        earth_shader.use();
+        earth_shader.set_uniform("modelview_projection_matrix", mvp_matrix);
+        earth_shader.set_uniform("modelview_matrix", mv_matrix);
+        earth_shader.set_uniform("normal_matrix", normal_matrix);
+        earth_shader.set_uniform("light_position", light);
 
-    earth_shader_.use();
-    earth_shader_.set_uniform("modelview_projection_matrix", mvp_matrix);
-    earth_shader_.set_uniform("modelview_matrix", mv_matrix);
-    earth_shader_.set_uniform("normal_matrix", normal_matrix);
-    earth_shader_.set_uniform("light_position", light);
-    earth_shader_.set_uniform("greyscale", (int)greyscale_);
+        // 3 textures for Earth, clouds and gloss share one
+        earth_shader.set_uniform("day_texture", 0);
+        earth_.tex_.bind();
 
-    // 4 textures for Earth
-    earth_shader_.set_uniform("day_texture", 0);
-    earth_.tex_.bind();
+        earth_shader.set_uniform("night_texture", 1);
+        earth_.night_.bind();
 
-    earth_shader_.set_uniform("night_texture", 1);
-    earth_.night_.bind();
+        earth_shader.set_uniform("cloud_gloss_texture", 2);
+        earth_.cloud_gloss_.bind();
 
-    earth_shader_.set_uniform("cloud_texture", 2);
-    earth_.cloud_.bind();
+        if (earth_.bump_.ready()) {
+            earth_.bump_.bind(earth_shader, 3, 4);
+            earth_shader.set_uniform("bump_scale", 0.005f * earth_.radius_);
+        }
+        else {
+            earth_shader.set_uniform("bump_scale", 0.0f);
+        }
 
-    earth_shader_.set_uniform("gloss_texture", 3);
-    earth_.gloss_.bind();
+        unit_sphere_.draw();
+    }
 
-    unit_sphere_.draw();
-    draw_planet(moon_);
+    // feedback pass: which pages of the bump map the earth needs
+    if (earth_.bump_.ready()) {
+        GpuProfiler::Scope scope(gpu_profiler_, "earth_feedback");
+        vt_feedback_shader_.use();
+        vt_feedback_shader_.set_uniform("modelview_projection_matrix", mvp_matrix);
+        earth_.bump_.begin_feedback(vt_feedback_shader_, width_, height_);
+        unit_sphere_.draw();
+        earth_.bump_.end_feedback();
+    }
 
     //render spaceship
-    m_matrix = mat4::translate(ship_.pos_) *
-               mat4::rotate_y(ship_.angle_) *
-               mat4::scale(ship_.get_scale());
+    {
+        GpuProfiler::Scope scope(gpu_profiler_, "ship");
+        m_matrix = mat4::translate(ship_.pos_) *
+                   mat4::rotate_y(ship_.angle_) *
+                   mat4::scale(ship_.get_scale());
 
-    mv_matrix = _view * m_matrix;
-    mvp_matrix = _projection * mv_matrix;
+        mv_matrix = _view * m_matrix;
+        mvp_matrix = _projection * mv_matrix;
 
-    color_shader_.use();
-    color_shader_.set_uniform("modelview_projection_matrix", mvp_matrix);
-    color_shader_.set_uniform("tex", 0);
-    color_shader_.set_uniform("greyscale", (int)greyscale_);
+        color_shader.use();
+        color_shader.set_uniform("modelview_projection_matrix", mvp_matrix);
+        color_shader.set_uniform("tex", 0);
 
-    ship_.tex_.bind();
-    ship_.draw();
+        ship_.tex_.bind();
+        ship_.draw();
+    }
 
     /** \todo Render the sun's halo here using the "color_shader_"
 *   - Construct a model matrix that scales the billboard to 3 times the
@@ -532,25 +792,27 @@ void Solar_viewer::draw_scene(mat4& _projection, mat4& _view)
 *     billboard_y_angle_
 *   - Bind the texture for and draw sunglow_
 **/
-    glEnable(GL_BLEND);
+    {
+        GpuProfiler::Scope scope(gpu_profiler_, "billboard");
+        glEnable(GL_BLEND);
 
-    m_matrix = mat4::rotate_y(billboard_y_angle_) * mat4::rotate_x(billboard_x_angle_)
-               * mat4::scale(sun_.radius_ * 3);
-    mv_matrix = (_view * m_matrix);
-    mvp_matrix = (_projection * mv_matrix);
+        m_matrix = mat4::rotate_y(billboard_y_angle_) * mat4::rotate_x(billboard_x_angle_)
+                   * mat4::scale(sun_.radius_ * 3);
+        mv_matrix = (_view * m_matrix);
+        mvp_matrix = (_projection * mv_matrix);
 
-    color_shader_.use();
-    color_shader_.set_uniform("modelview_projection_matrix", mvp_matrix);
+        color_shader.use();
+        color_shader.set_uniform("modelview_projection_matrix", mvp_matrix);
 
-    color_shader_.set_uniform("tex", 0);
-    color_shader_.set_uniform("greyscale", (int)greyscale_);
+        color_shader.set_uniform("tex", 0);
 
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    sunglow_.tex_.bind();
-    sunglow_.draw();
+        sunglow_.tex_.bind();
+        sunglow_.draw();
 
-    glDisable(GL_BLEND);
+        glDisable(GL_BLEND);
+    }
 
     // check for OpenGL errors
     glCheckError();
@@ -558,6 +820,7 @@ void Solar_viewer::draw_scene(mat4& _projection, mat4& _view)
 
 void Solar_viewer::randomize_planets()
 {
+    if (nbody_active_) stop_nbody();
     std::cout << "Randomizing planets..." << std::endl;
     float temp_dt = time_step_;
     time_step_ = (float)(rand()%20000);
@@ -566,4 +829,320 @@ void Solar_viewer::randomize_planets()
 }
 
 
+//-----------------------------------------------------------------------------
+
+
+void Solar_viewer::resize_asteroid_belt(size_t n)
+{
+    quiet_frames_ = 0;
+    const AsteroidBelt::Stats& stats = asteroids_.stats();
+    if (frames_ && stats.frames) {
+        std::cout << "Asteroids: " << asteroids_.size()
+                  << "  frame " << 1000.0 * frame_seconds_ / frames_ << " ms"
+                  << "  update " << 1000.0 * stats.update_seconds / stats.frames << " ms"
+                  << "  cull " << 1000.0 * stats.cull_seconds / stats.frames << " ms"
+                  << "  draw " << 1000.0 * stats.draw_seconds / stats.frames << " ms"
+                  << "  (LOD instances/frame:";
+        for (int l = 0; l < AsteroidBelt::LODS; ++l)
+            std::cout << " " << stats.drawn[l] / stats.frames;
+        std::cout << ")" << std::endl;
+    }
+    const NBody::Stats& nbody = nbody_.stats();
+    if (nbody_active_ && nbody.evaluations) {
+        std::cout << "N-body: " << nbody_.size() << " particles, theta " << nbody_.theta()
+                  << "  tree " << 1000.0 * nbody.build_seconds / nbody.evaluations << " ms"
+                  << "  forces " << 1000.0 * nbody.force_seconds / nbody.evaluations << " ms"
+                  << "  (" << nbody.interactions / nbody.evaluations / nbody_.size()
+                  << " interactions/particle)" << std::endl;
+    }
+
+    // back to the Kepler orbits, which place the new rocks and the planets
+    // (with the velocities the simulation restarts from)
+    const bool restart_nbody = nbody_active_;
+    if (restart_nbody) stop_nbody();
+
+    asteroids_.resize(n);
+    asteroids_.reset_stats();
+    frame_seconds_ = 0.0;
+    frames_ = 0;
+    std::cout << "Asteroid belt: " << asteroids_.size() << " rocks" << std::endl;
+
+    // restart the simulation with the new belt
+    if (restart_nbody) start_nbody();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Solar_viewer::start_nbody()
+{
+    quiet_frames_ = 0;
+    // Kepler's third law for the earth's orbit (radius 3.3, one year) gives
+    // the sun's mass (with G = 1, time in days); the planets have their real
+    // mass ratios. The moon's orbit is far too wide for the earth's real
+    // mass to hold it, so it stays on its Kepler orbit around the earth.
+    const float sun_mass = std::pow(2.0f * (float)M_PI / 365.0f, 2.0f) * std::pow(3.3f, 3.0f);
+    const float belt_mass = 5e-10f * sun_mass;
+
+    std::array<Planet*, 4> planets = { &mercury_, &venus_, &earth_, &mars_ };
+    std::array<float, 4> mass_ratio = { 1.66e-7f, 2.45e-6f, 3.04e-6f, 3.23e-7f };
+
+    // orbital velocities of the planets (mean motion from the sun's mass)
+    std::array<float, KeplerOrbits::LANES> n = {}, vx, vy, vz;
+    for (size_t i = 0; i < planets.size(); ++i)
+        n[i] = std::sqrt(sun_mass / std::pow(std::fabs(planets[i]->distance_), 3.0f));
+    planet_orbits_.velocities(0, planets.size(), n.data(), vx.data(), vy.data(), vz.data());
+
+    std::vector<float> rvx, rvy, rvz;
+    asteroids_.velocities(rvx, rvy, rvz);
+    const float rock_mass = belt_mass / std::max<size_t>(1, asteroids_.size());
+
+    // the sun balances the total momentum, so that the system stays in place
+    vec3 momentum(0.0f, 0.0f, 0.0f);
+    for (size_t i = 0; i < planets.size(); ++i)
+        momentum += mass_ratio[i] * sun_mass * vec3(vx[i], vy[i], vz[i]);
+    for (size_t i = 0; i < asteroids_.size(); ++i)
+        momentum += rock_mass * vec3(rvx[i], rvy[i], rvz[i]);
+
+    nbody_.clear();
+    nbody_.add(sun_mass, vec3(sun_.pos_), -momentum / sun_mass);
+    for (size_t i = 0; i < planets.size(); ++i)
+        nbody_.add(mass_ratio[i] * sun_mass, vec3(planets[i]->pos_), vec3(vx[i], vy[i], vz[i]));
+    for (size_t i = 0; i < asteroids_.size(); ++i)
+        nbody_.add(rock_mass, asteroids_.position(i), vec3(rvx[i], rvy[i], rvz[i]));
+    nbody_.reset_stats();
+
+    // the ship starts with the velocity of the closest body
+    size_t closest = 0;
+    for (size_t i = 1; i < 5; ++i)
+        if (norm(nbody_.position(i) - vec3(ship_.pos_)) < norm(nbody_.position(closest) - vec3(ship_.pos_)))
+            closest = i;
+    ship_.velocity_ = vec4(nbody_.velocity(closest), 0.0f);
+
+    nbody_active_ = true;
+    std::cout << "N-body mode: " << nbody_.size() << " particles (Barnes-Hut, theta "
+              << nbody_.theta() << ")" << std::endl;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Solar_viewer::stop_nbody()
+{
+    quiet_frames_ = 0;
+    nbody_active_ = false;
+    asteroids_.set_positions(nullptr, nullptr, nullptr);
+    ship_.velocity_ = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+    update_body_positions();
+    std::cout << "Kepler orbits" << std::endl;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+const char* Solar_viewer::benchmark_scenarios()
+{
+    return "orbit earth belt nbody";
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Solar_viewer::enable_benchmark(const std::string& scenario, unsigned int frames,
+                                    const std::string& output)
+{
+    std::string names = std::string(" ") + benchmark_scenarios() + " ";
+    if (scenario.empty() || names.find(" " + scenario + " ") == std::string::npos)
+        throw std::runtime_error("Unknown benchmark scenario '" + scenario +
+                                 "' (available: " + benchmark_scenarios() + ")");
+
+    // render as fast as possible
+    if (!headless_) glfwSwapInterval(0);
+
+    bench_.reset(new Benchmark(scenario, frames, 30));
+    bench_output_ = output;
+    std::cout << "Benchmark '" << scenario << "': " << frames << " frames" << std::endl;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Solar_viewer::enable_recording(const std::string& output)
+{
+    // offline rendering takes the time it needs, a window drops frames
+    recorder_.reset(new FrameRecorder(output, !headless_));
+    std::cerr << "Recording to " << (output == "-" ? "stdout" : output) << std::endl;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Solar_viewer::finalize()
+{
+    if (recorder_) {
+        recorder_->finish();
+        recorder_->report(std::cerr);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Solar_viewer::script_benchmark()
+{
+    const std::string& scenario = bench_->scenario();
+    const float t = bench_->progress();
+
+    // scene setup in the first frame; the timeline only depends on the
+    // frame number, never on the wall clock
+    if (bench_->frame() == 0) {
+        // measure with the final textures
+        texture_loader_.finish();
+
+        timer_active_ = true;
+        time_step_ = 1.0f / 24.0f;
+        in_ship_ = false;
+        curve_display_mode_ = CURVE_SHOW_NONE;
+        if (nbody_active_) stop_nbody();
+
+        if (scenario == "belt")       resize_asteroid_belt(200000);
+        else if (scenario == "nbody") resize_asteroid_belt(100000);
+        else                          resize_asteroid_belt(20000);
+
+        if (scenario == "nbody") {
+            update_body_positions();
+            start_nbody();
+        }
+    }
+
+    if (scenario == "orbit") {
+        // circle the sun once, swinging between top and side view
+        planet_to_look_at_ = &sun_;
+        dist_factor_ = 9.0f;
+        y_angle_ = 360.0f * t;
+        x_angle_ = -50.0f - 40.0f * std::cos(2.0f * (float)M_PI * t);
+    }
+    else if (scenario == "earth") {
+        // zoom in and out of the earth while circling it
+        planet_to_look_at_ = &earth_;
+        dist_factor_ = 7.5f - 4.5f * std::cos(4.0f * (float)M_PI * t);
+        y_angle_ = 180.0f * t;
+        x_angle_ = -20.0f;
+    }
+    else if (scenario == "belt") {
+        // look across the asteroid belt from close to mars
+        planet_to_look_at_ = &mars_;
+        dist_factor_ = 40.0f;
+        y_angle_ = 360.0f * t;
+        x_angle_ = -10.0f;
+    }
+    else if (scenario == "nbody") {
+        planet_to_look_at_ = &sun_;
+        dist_factor_ = 9.0f;
+        y_angle_ = 90.0f * t;
+        x_angle_ = -60.0f;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Solar_viewer::frame_finished()
+{
+    // Once the frames have settled (no input, no scene changes), the render
+    // loop must not touch the heap; see user input or a resize for the rest.
+    AllocationCounts allocations = AllocationTracker::thread() - frame_allocations_;
+    assert((quiet_frames_ < 10 || allocations.allocations == 0) &&
+           "the steady-state render loop allocated memory");
+    (void)allocations;
+    ++quiet_frames_;
+
+    if (first_frame_time_ < 0.0) {
+        first_frame_time_ = glfwGetTime();
+        std::cout << "Time to first frame: " << int(1000.0 * first_frame_time_) << " ms" << std::endl;
+    }
+
+    finish_benchmark_frame();
+    frame_allocations_ = AllocationTracker::thread();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Solar_viewer::finish_benchmark_frame()
+{
+    if (!bench_) return;
+
+    bench_->end_frame();
+    if (!bench_->done()) return;
+
+    std::vector<std::pair<std::string, std::string>> text = {
+        { "renderer",   (const char*)glGetString(GL_RENDERER) },
+        { "gl_version", (const char*)glGetString(GL_VERSION) },
+        { "resolution", std::to_string(width_) + "x" + std::to_string(height_) },
+        { "headless",   headless_ ? "true" : "false" },
+    };
+    std::vector<std::pair<std::string, double>> numbers = {
+        { "asteroids", double(asteroids_.size()) },
+        { "nbody_particles", nbody_active_ ? double(nbody_.size()) : 0.0 },
+        { "threads", double(ThreadPool::instance().concurrency()) },
+        { "time_to_first_frame_ms", 1000.0 * first_frame_time_ },
+        { "time_to_fully_loaded_ms", 1000.0 * loaded_time_ },
+        { "shader_load_ms", Shader::load_stats().ms },
+        { "shader_binary_cache_hits", double(Shader::load_stats().cached) },
+        { "peak_resident_mb", double(AllocationTracker::peak_resident_bytes()) / (1 << 20) },
+        { "bump_resident_pages", double(earth_.bump_.resident_pages()) },
+        { "bump_page_loads", double(earth_.bump_.page_loads()) },
+    };
+    if (recorder_) {
+        numbers.emplace_back("recorded_frames", double(recorder_->frames()));
+        numbers.emplace_back("dropped_frames", double(recorder_->dropped_frames()));
+        numbers.emplace_back("capture_ms", recorder_->average_capture_ms());
+        numbers.emplace_back("encode_ms", recorder_->average_encode_ms());
+    }
+
+    if (bench_output_ == "-") {
+        bench_->write_json(std::cout, text, numbers, gpu_profiler_.averages());
+    }
+    else {
+        std::ofstream ofs(bench_output_);
+        bench_->write_json(ofs, text, numbers, gpu_profiler_.averages());
+        std::cout << "Benchmark results written to " << bench_output_ << std::endl;
+    }
+
+    glfwSetWindowShouldClose(window_, GL_TRUE);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Solar_viewer::write_trace(const std::string& filename, double seconds) const
+{
+    int64_t since = seconds > 0.0 ? Tracer::now() - int64_t(1e9 * seconds) : 0;
+
+    std::vector<TraceEvent> events;
+    std::vector<std::pair<int, std::string>> threads;
+    Tracer::instance().collect(since, events, threads);
+
+    // the GPU as one more thread
+    const int gpu_tid = 0;
+    gpu_profiler_.trace_events(since, gpu_tid, events);
+    threads.emplace_back(gpu_tid, "GPU");
+
+    std::ofstream ofs(filename);
+    write_chrome_trace(ofs, events, threads);
+    std::cout << "Trace (" << events.size() << " events) written to " << filename << std::endl;
+}
+
+
 //=============================================================================
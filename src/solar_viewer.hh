@@ -20,6 +20,21 @@
 #include "frame.hh"
 #include "billboard.hh"
 #include "bezier.hh"
+#include "texture_array.hh"
+#include "texture_loader.hh"
+#include "instance_buffer.hh"
+#include "asteroid_belt.hh"
+#include "kepler.hh"
+#include "nbody.hh"
+#include "benchmark.hh"
+#include "gpu_profiler.hh"
+#include "allocation_tracker.hh"
+#include "frame_arena.hh"
+#include "frame_recorder.hh"
+#include "file_watcher.hh"
+#include <array>
+#include <memory>
+#include <string>
 
 
 /// OpenGL viewer that handles all the rendering for us
@@ -31,7 +46,30 @@ public:
     /// \_title the window's title
     /// \_width the window's width
     /// \_height the window's height
-    Solar_viewer(const char* _title, int _width, int _height);
+    /// \_headless render offscreen (see GLFW_window)
+    Solar_viewer(const char* _title, int _width, int _height, bool _headless=false);
+
+    /// Run the scripted benchmark scenario instead of interactive control:
+    /// disables vsync, renders warm-up frames and then the given number of
+    /// measured frames, writes the timings as JSON to the output file ("-"
+    /// for stdout) and closes the window. Throws for unknown scenarios.
+    void enable_benchmark(const std::string& scenario, unsigned int frames,
+                          const std::string& output);
+
+    /// Record every frame (see FrameRecorder for the output); frames are
+    /// dropped when the encoders fall behind, except for headless runs.
+    void enable_recording(const std::string& output);
+
+    /// Load the textures from their png files even if baked versions exist
+    /// (see TextureLoader::set_use_baked()); call before run().
+    void use_png_textures() { texture_loader_.set_use_baked(false); }
+
+    /// names of the benchmark scenarios, separated by spaces
+    static const char* benchmark_scenarios();
+
+    /// Write the CPU trace markers and the GPU profiler scopes of the last
+    /// seconds (all that are buffered for 0) as Chrome trace_event JSON.
+    void write_trace(const std::string& filename, double seconds) const;
 
 
 protected:
@@ -57,11 +95,45 @@ protected:
     /// update function on every timer event (controls the animation)
     virtual void timer();
 
+    /// end of frame: checks the frame's allocations and finishes the
+    /// benchmark's frame timing
+    virtual void frame_finished();
+
+    /// writes the frames still being recorded
+    virtual void finalize();
+
+    /// record the benchmark frame and write the results after the last one
+    void finish_benchmark_frame();
+
+    /// set the camera and scene of the benchmark scenario for its current frame
+    void script_benchmark();
+
+    /// Start reloading the shaders whose files changed and finish the
+    /// reloads in flight; the programs in use stay until the new ones are
+    /// linked, so frames go on while the driver compiles (called by the
+    /// timer).
+    void update_shaders();
+
+    /// all shader programs
+    std::array<Shader*, 7> shaders();
+
     /// update the body positions (called by the timer).
     void update_body_positions();
 
     void randomize_planets();
 
+    /// change the number of asteroids and report the frame timings measured
+    /// with the previous number
+    void resize_asteroid_belt(size_t n);
+
+    /// switch from Kepler orbits to the gravitational N-body simulation of
+    /// the sun, the planets, the asteroids and the ship, starting from the
+    /// current positions and orbital velocities
+    void start_nbody();
+
+    /// switch back to Kepler orbits
+    void stop_nbody();
+
 private:
 
     /// sphere object
@@ -86,18 +158,48 @@ private:
     /// sunglow billboard
     Billboard sunglow_;
 
+    /// diffuse textures of all phong-shaded bodies, one layer per body
+    TextureArray planet_textures_;
+    /// per-instance data of all phong-shaded bodies
+    InstanceBuffer phong_instances_;
+
+    /// orbits of mercury, venus, earth, mars and the moon (evaluated together
+    /// in update_body_positions)
+    KeplerOrbits planet_orbits_;
+
+    /// N-body system of the sun, mercury, venus, earth, mars (in this order)
+    /// and the asteroids; the moon stays on its Kepler orbit around the earth
+    NBody nbody_;
+    /// whether the bodies move by gravity (toggle with k) or on Kepler orbits
+    bool nbody_active_ = false;
+
+    /// asteroid belt between mars and the (empty) jupiter orbit
+    AsteroidBelt asteroids_;
+
     /// default color shader (renders only texture)
     Shader   color_shader_;
     // sun shader (renders the sun: texture plus an optional shimmer effect)
     Shader   sun_shader_;
-    /// phong shader (renders texture and basic illumination)
+    /// phong shader (renders texture and basic illumination for all
+    /// instances in phong_instances_ in a single draw call)
     Shader   phong_shader_;
     /// earth shader (renders the earth using multi texturing)
     Shader   earth_shader_;
+    /// feedback pass of the earth's virtual bump map
+    Shader   vt_feedback_shader_;
 
     /// simple shader for visualizing curves (just using solid color).
     Shader   solid_color_shader_;
 
+    /// asteroid shader (instanced rocks, diffuse lighting)
+    Shader   asteroid_shader_;
+
+    /// watches the shader directory, and the files it reported changed
+    FileWatcher shader_watcher_;
+    std::vector<std::filesystem::path> changed_shader_files_;
+    /// whether shaders are being reloaded (in the background)
+    bool reloading_shaders_ = false;
+
     /// interval for the animation timer
     bool  timer_active_;
     /// update factor for the animation
@@ -105,6 +207,8 @@ private:
 
     /// state whether the rendering should be in color or not
     bool greyscale_;
+    /// definitions selecting the shader variants for it
+    ShaderDefines shader_defines_;
 
     /// Whether/how to display the ship path curve.
     enum CurveDisplayMode {
@@ -158,5 +262,36 @@ private:
 
     /// current viewport dimension
     int  width_, height_;
+
+    /// benchmark of the current run (null when interactive) and its output
+    std::unique_ptr<Benchmark> bench_;
+    std::string bench_output_;
+
+    /// recorder of the frames (null when not recording)
+    std::unique_ptr<FrameRecorder> recorder_;
+
+    /// GPU time of the passes of draw_scene()
+    GpuProfiler gpu_profiler_;
+
+    /// memory for the transient data of a frame (draw lists, culling results)
+    FrameArena frame_arena_;
+
+    /// allocations of the rendering thread when the current frame started
+    AllocationCounts frame_allocations_;
+    /// frames since the last user input or scene change
+    unsigned int quiet_frames_ = 0;
+
+    /// background decoding of the textures
+    TextureLoader texture_loader_;
+    /// seconds since startup until the first frame was shown and until all
+    /// textures were uploaded (negative before)
+    double first_frame_time_ = -1.0;
+    double loaded_time_ = -1.0;
+
+    /// time of the previous call to paint() and accumulated frame times (in
+    /// seconds) since the asteroid belt was last resized
+    double last_paint_time_ = 0.0;
+    double frame_seconds_ = 0.0;
+    unsigned int frames_ = 0;
 };
 
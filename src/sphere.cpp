@@ -149,4 +149,22 @@ void Sphere::draw()
 }
 
 
+//-----------------------------------------------------------------------------
+
+
+void Sphere::draw_instanced(InstanceBuffer& instances)
+{
+    if (n_indices_ == 0) initialize();
+    if (instances.size() == 0) return;
+
+    glBindVertexArray(vao_);
+    if (attached_instances_ != instances.id()) {
+        instances.attach();
+        attached_instances_ = instances.id();
+    }
+    glDrawElementsInstanced(GL_TRIANGLES, n_indices_, GL_UNSIGNED_INT, NULL, instances.size());
+    glBindVertexArray(0);
+}
+
+
 //=============================================================================
@@ -9,6 +9,7 @@
 //=============================================================================
 
 #include "gl.hh"
+#include "instance_buffer.hh"
 
 /// class that creates a sphere with a desired tessellation degree and renders it
 class Sphere
@@ -25,6 +26,9 @@ public:
     /// render mesh of the sphere
     void draw();
 
+    /// render one copy of the sphere mesh per instance stored in \c instances
+    void draw_instanced(InstanceBuffer& instances);
+
 
 private:
 
@@ -53,5 +57,7 @@ private:
     GLuint tbo_ = 0;
     /// index buffer object
     GLuint ibo_ = 0;
+    /// instance buffer whose attributes are set up in vao_
+    GLuint attached_instances_ = 0;
 };
 
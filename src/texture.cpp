@@ -8,17 +8,24 @@
 //=============================================================================
 
 #include "texture.hh"
+#include "png_decoder.hh"
+#include "procedural_texture.hh"
+#include "trace.hh"
 #include <iostream>
 #include <cassert>
 #include <cmath>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <string>
 #include "lodepng.h"
 
 //=============================================================================
 
 
 Texture::Texture() :
-    id_(0)
+    id_(0), pending_id_(0), pending_width_(0), pending_levels_(0), pending_format_(GL_RGBA)
 {
 }
 
@@ -29,6 +36,7 @@ Texture::Texture() :
 Texture::~Texture()
 {
     if (id_) glDeleteTextures(1, &id_);
+    if (pending_id_) glDeleteTextures(1, &pending_id_);
 }
 
 
@@ -36,12 +44,13 @@ Texture::~Texture()
 
 bool Texture::loadPNG(const char* filename)
 {
+    TRACE_SCOPE("Texture::loadPNG");
     std::cout << "Load texture " << filename << "\n" << std::flush;
 
     std::vector<uint8_t> img;
     unsigned width, height;
 
-    unsigned error = lodepng::decode(img, width, height, filename);
+    unsigned error = png_decode_file(img, width, height, filename);
     if (error) {
         std::cout << "read error: " << lodepng_error_text(error) << std::endl;
         return false;
@@ -61,16 +70,8 @@ bool Texture::uploadImage(std::vector<uint8_t> &img, unsigned width, unsigned he
     }
 
     // flip vertically in order to adhere to how OpenGL interpretes image data
-    if (height % 2) throw std::runtime_error("Image must be of even height");
-    assert(height % 2 == 0);
-    for (unsigned int y = 0; y < height/2; ++y) {
-        for (unsigned int x = 0; x < width; ++x) {
-            for (unsigned int c = 0; c < 4; ++c) {
-                std::swap(img[(              y  * width + x) * 4 + c],
-                          img[((height - y - 1) * width + x) * 4 + c]);
-            }
-        }
-    }
+    assert(img.size() >= size_t(width) * height * 4);
+    flip_rows(img.data(), size_t(width) * 4, height);
 
     // upload texture data
     glActiveTexture(unit_);
@@ -92,74 +93,141 @@ bool Texture::uploadImage(std::vector<uint8_t> &img, unsigned width, unsigned he
 
 //-----------------------------------------------------------------------------
 
-bool Texture::createSunBillboardTexture()
+
+void Texture::uploadPlaceholder(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
 {
-    std::cout << "creating sun billboard " << "\n" << std::flush;
+    assert(id_);
+    const unsigned char texel[4] = { r, g, b, a };
+    glActiveTexture(unit_);
+    glBindTexture(type_, id_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(type_, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    if (minfilter_ == GL_LINEAR_MIPMAP_LINEAR)
+        glGenerateMipmap(type_);
+}
 
-    std::vector<uint8_t> img;
-    int width = 900;
-    int height = 900;
-    img.resize(width*height * 4);
 
-    /** \todo Set up the texture for the sun billboard.
-  *   - Draw an opaque circle with a 150 pixel radius in its middle
-  *   - Outside that circle the texture should become more and more transparent to mimic a nice glow effect
-  *   - Make sure that your texture is fully transparent at its borders to avoid seeing visible edges
-  *   - Experiment with the color and with how fast you change the transparency until the effect satisfies you
-  **/
+//-----------------------------------------------------------------------------
 
 
-    //assign texture centerpoint
-    float center_x = width / 2.0f;
-    float center_y = height / 2.0f;
+void Texture::beginUpload(unsigned width, unsigned height, unsigned levels, GLenum format)
+{
+    assert(id_ && type_ == GL_TEXTURE_2D && levels > 0);
+    if (pending_id_) glDeleteTextures(1, &pending_id_);
+
+    // upload into a second texture, the current one is still drawn
+    pending_id_     = createTexture();
+    pending_width_  = width;
+    pending_levels_ = levels;
+    pending_format_ = format;
+
+    const unsigned block_bytes = compressedBlockBytes(format);
+    for (unsigned int level = 0; level < levels; ++level) {
+        unsigned w = std::max(1u, width >> level), h = std::max(1u, height >> level);
+        if (block_bytes) {
+            GLsizei size = ((w + 3) / 4) * ((h + 3) / 4) * block_bytes;
+            glCompressedTexImage2D(type_, level, format, w, h, 0, size, NULL);
+        }
+        else {
+            glTexImage2D(type_, level, format, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+    }
 
-    //assign radius values
-    float inner_radius = 150; //full effect strength radius
-    float outer_radius = 450; //gradual fading between inner radius and this
+    // single channel: grey instead of red
+    if (format == GL_COMPRESSED_RED_RGTC1) {
+        glTexParameteri(type_, GL_TEXTURE_SWIZZLE_G, GL_RED);
+        glTexParameteri(type_, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    }
+}
 
-    //base sun glow color to fill
-    uint8_t R = 255;
-    uint8_t G = 110;
-    uint8_t B = 50;
 
+//-----------------------------------------------------------------------------
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
 
-            float dist_x = fabs(x - center_x);
-            float dist_y = fabs(y - center_y);
-            float dist_center = sqrtf((dist_x * dist_x) + (dist_y * dist_y));
-            float alpha;
+void Texture::uploadRows(unsigned level, unsigned y, unsigned rows, const void* pixels)
+{
+    assert(pending_id_ && level < pending_levels_);
+    const unsigned w = std::max(1u, pending_width_ >> level);
+    glActiveTexture(unit_);
+    glBindTexture(type_, pending_id_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-            if (dist_center < inner_radius) {
-                //color opaque
-                alpha = 1;
-            }
-            else if (dist_center < outer_radius) {
-
-                //modify alpha based on dist_center
-                float rel_dist = (outer_radius - dist_center) / (outer_radius - inner_radius);
-                
-                float attenuate = 3.5; //soften glow strength towards edges
-                alpha = powf(rel_dist, attenuate);
-                
-                G = std::max((200 * alpha), 90.0f); //add bright yellow highlight close to surface
-            }
-            else 
-            {
-                alpha = 0;
-            }
+    if (const unsigned block_bytes = compressedBlockBytes(pending_format_)) {
+        assert(y % 4 == 0);
+        GLsizei size = ((w + 3) / 4) * ((rows + 3) / 4) * block_bytes;
+        glCompressedTexSubImage2D(type_, level, 0, y, w, rows, pending_format_, size, pixels);
+    }
+    else {
+        glTexSubImage2D(type_, level, 0, y, w, rows, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+}
 
-            uint8_t A = 255 * alpha;
 
-            img[(y * width + x) * 4 + 0] = R;
-            img[(y * width + x) * 4 + 1] = G;
-            img[(y * width + x) * 4 + 2] = B;
-            img[(y * width + x) * 4 + 3] = A;
+//-----------------------------------------------------------------------------
 
-        }
+
+unsigned Texture::compressedBlockBytes(GLenum format)
+{
+    switch (format) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RED_RGTC1:
+            return 8;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RG_RGTC2:
+            return 16;
+        default:
+            return 0;
     }
-    return uploadImage(img, width, height);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Texture::finishUpload()
+{
+    assert(pending_id_);
+    glDeleteTextures(1, &id_);
+    id_ = pending_id_;
+    pending_id_ = 0;
+
+    glActiveTexture(unit_);
+    glBindTexture(type_, id_);
+    if (pending_levels_ > 1)
+        glTexParameteri(type_, GL_TEXTURE_MAX_LEVEL, pending_levels_ - 1);
+    else if (mipmapped())
+        glGenerateMipmap(type_);
+}
+
+
+//-----------------------------------------------------------------------------
+
+bool Texture::createSunBillboardTexture()
+{
+    if (!id_) {
+        std::cerr << "Texture: initialize before loading!\n";
+        return false;
+    }
+
+    /** \todo Set up the texture for the sun billboard.
+  *   - Draw an opaque circle with a 150 pixel radius in its middle
+  *   - Outside that circle the texture should become more and more transparent to mimic a nice glow effect
+  *   - Make sure that your texture is fully transparent at its borders to avoid seeing visible edges
+  *   - Experiment with the color and with how fast you change the transparency until the effect satisfies you
+  **/
+
+    // 900x900: opaque within 150 pixels of the center, fading out with
+    // (relative distance)^3.5 until 450 pixels, with a yellow highlight
+    // close to the surface (see GlowParams for the defaults)
+    GlowParams params;
+    const std::vector<uint8_t>& img = glow_sprite(params);
+
+    // symmetric, and generated bottom row first anyway
+    beginUpload(params.size, params.size);
+    uploadRows(0, 0, params.size, img.data());
+    finishUpload();
+    return true;
 }
 
 
@@ -172,19 +240,34 @@ void Texture::init(GLenum unit, GLenum type, GLint minfilter, GLint magfilter, G
     unit_ = unit;
     type_ = type;
     minfilter_ = minfilter;
+    magfilter_ = magfilter;
+    wrap_ = wrap;
+
+    // create texture object
+    id_ = createTexture();
+}
 
+
+//-----------------------------------------------------------------------------
+
+
+GLuint Texture::createTexture() const
+{
     // activate texture unit
     glActiveTexture(unit_);
 
     // create texture object
-    glGenTextures(1, &id_);
-    glBindTexture(type_, id_);
+    GLuint id;
+    glGenTextures(1, &id);
+    glBindTexture(type_, id);
 
     // set texture parameters
-    glTexParameteri(type_, GL_TEXTURE_MAG_FILTER, magfilter);
-    glTexParameteri(type_, GL_TEXTURE_MIN_FILTER, minfilter);
-    glTexParameteri(type_, GL_TEXTURE_WRAP_S, wrap);
-    glTexParameteri(type_, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(type_, GL_TEXTURE_MAG_FILTER, magfilter_);
+    glTexParameteri(type_, GL_TEXTURE_MIN_FILTER, minfilter_);
+    glTexParameteri(type_, GL_TEXTURE_WRAP_S, wrap_);
+    glTexParameteri(type_, GL_TEXTURE_WRAP_T, wrap_);
+
+    return id;
 }
 
 
@@ -199,5 +282,79 @@ void Texture::bind()
 }
 
 
+//=============================================================================
+
+
+void flip_rows(uint8_t* pixels, size_t row_bytes, unsigned height)
+{
+    // swap_ranges over whole rows compiles to wide loads and stores
+    for (unsigned int y = 0; y < height / 2; ++y) {
+        uint8_t* top    = pixels + y * row_bytes;
+        uint8_t* bottom = pixels + (height - 1 - y) * row_bytes;
+        std::swap_ranges(top, top + row_bytes, bottom);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void texture_flip_benchmark(std::ostream& os)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    os << "Vertical flip of RGBA textures\n"
+       << std::setw(36) << "texture" << std::setw(12) << "size"
+       << std::setw(14) << "bytes [ms]" << std::setw(14) << "rows [ms]"
+       << std::setw(14) << "copy [ms]" << std::setw(10) << "speedup" << std::endl;
+
+    for (const char* name : { "earth_bumpmap_flat_8192x4096.png", "gloss.png", "stars2.png", "sun.png" }) {
+        std::vector<uint8_t> img;
+        unsigned width, height;
+        std::string filename = std::string(TEXTURE_PATH "/") + name;
+        if (lodepng::decode(img, width, height, filename)) {
+            os << std::setw(36) << name << "  (not found)" << std::endl;
+            continue;
+        }
+        const size_t row_bytes = size_t(width) * 4;
+        std::vector<uint8_t> staging(img.size());
+
+        // best of a few runs, each flip undoes the previous one
+        auto time = [&](auto&& flip) {
+            double best = 1e30;
+            for (int run = 0; run < 5; ++run) {
+                auto start = Clock::now();
+                flip();
+                best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+            }
+            return best;
+        };
+
+        // the former per-byte swap of uploadImage()
+        double bytes_ms = time([&] {
+            for (unsigned int y = 0; y < height / 2; ++y)
+                for (unsigned int x = 0; x < width; ++x)
+                    for (unsigned int c = 0; c < 4; ++c)
+                        std::swap(img[(              y  * width + x) * 4 + c],
+                                  img[((height - y - 1) * width + x) * 4 + c]);
+        });
+
+        double rows_ms = time([&] { flip_rows(img.data(), row_bytes, height); });
+
+        // what the streaming upload does: copy the rows flipped into the
+        // staging buffer
+        double copy_ms = time([&] {
+            for (unsigned int y = 0; y < height; ++y)
+                std::memcpy(&staging[y * row_bytes], &img[(height - 1 - y) * row_bytes], row_bytes);
+        });
+
+        os << std::setw(36) << name << std::setw(12) << (std::to_string(width) + "x" + std::to_string(height))
+           << std::fixed << std::setprecision(2)
+           << std::setw(14) << bytes_ms << std::setw(14) << rows_ms << std::setw(14) << copy_ms
+           << std::setprecision(1) << std::setw(9) << bytes_ms / rows_ms << "x"
+           << std::defaultfloat << std::endl;
+    }
+}
+
 
 //=============================================================================
@@ -9,6 +9,8 @@
 //=============================================================================
 
 #include "gl.hh"
+#include <cstdint>
+#include <iosfwd>
 #include <vector>
 
 /// class that handles texture io and GPU upload
@@ -43,6 +45,31 @@ public:
     /// Side-effect: vertically flips the image data stored in "img."
     bool uploadImage(std::vector<unsigned char> &img, unsigned width, unsigned height);
 
+    /// Upload a single texel of the given color, e.g. as placeholder while
+    /// the real image is being loaded.
+    void uploadPlaceholder(unsigned char r, unsigned char g, unsigned char b, unsigned char a = 255);
+
+    /// Start replacing the image by one of the given size that is uploaded in
+    /// row slices with uploadRows(), either only its base level (the mip
+    /// maps are then generated by finishUpload()) or all \c levels of its
+    /// mip chain. The current image stays in use until finishUpload().
+    /// \param format GL_RGBA, or a block-compressed format (S3TC DXT1/DXT5,
+    /// RGTC1/2); a single-channel one is sampled as grey
+    void beginUpload(unsigned width, unsigned height, unsigned levels = 1, GLenum format = GL_RGBA);
+
+    /// Upload rows [y, y + rows) of a level of the new image, bottom row
+    /// first as OpenGL expects; for block-compressed formats y is a multiple
+    /// of 4, as is rows unless it reaches the top of the level. \c pixels is
+    /// an offset into the bound GL_PIXEL_UNPACK_BUFFER, or client memory if
+    /// none is bound.
+    void uploadRows(unsigned level, unsigned y, unsigned rows, const void* pixels);
+
+    /// switch to the new image, generating its mip maps if needed
+    void finishUpload();
+
+    /// whether the min filter uses mip maps
+    bool mipmapped() const { return minfilter_ == GL_LINEAR_MIPMAP_LINEAR; }
+
     /// Generate the sun halo texture bitmap and upload it to the GPU
     bool createSunBillboardTexture();
 
@@ -52,19 +79,44 @@ public:
     /// returns the texture id
     GLint id() const { return id_; }
 
+private:
+
+    /// create a texture object with the parameters given to init()
+    GLuint createTexture() const;
+
 private:
 
     /// texture ID on GPU
     GLuint id_;
 
+    /// bytes per 4x4 block of a compressed format, 0 for uncompressed ones
+    static unsigned compressedBlockBytes(GLenum format);
+
+    /// texture that beginUpload() is filling, its width, levels and format
+    GLuint pending_id_;
+    unsigned pending_width_, pending_levels_;
+    GLenum pending_format_;
+
     /// texture unit (important for use of multiple textures in shader)
     GLenum unit_;
 
     /// the type of the texture (TEXTURE_1D,TEXTURE_2D, etc)
     GLint  type_;
 
-    /// the minfilter setting
-    GLint minfilter_;
+    /// the filter and wrap settings
+    GLint minfilter_, magfilter_, wrap_;
 
 };
 
+
+/// Flip an image vertically in place by swapping whole rows (the middle row
+/// of an odd height stays), e.g. to bring top-down PNG rows into the
+/// bottom-up order OpenGL expects.
+void flip_rows(uint8_t* pixels, size_t row_bytes, unsigned height);
+
+/// Time the vertical flip of the largest textures: the former byte-wise swap,
+/// flip_rows() and the flipped row copy of the streaming upload.
+void texture_flip_benchmark(std::ostream& os);
+
+
+//=============================================================================
@@ -0,0 +1,340 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "texture_array.hh"
+#include "trace.hh"
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include "lodepng.h"
+
+//=============================================================================
+
+namespace {
+
+/// bilinearly resample an RGBA image to size w x h, flipping it vertically on
+/// the way to adhere to how OpenGL interpretes image data
+void resample_flipped(const std::vector<uint8_t>& src, unsigned sw, unsigned sh,
+                      std::vector<uint8_t>& dst, unsigned w, unsigned h)
+{
+    dst.resize(w * h * 4);
+    const float fx = float(sw) / w, fy = float(sh) / h;
+    for (unsigned int y = 0; y < h; ++y) {
+        // sample at pixel centers
+        float sy = std::max(0.0f, (h - y - 0.5f) * fy - 0.5f);
+        unsigned int y0 = std::min(unsigned(sy), sh - 1), y1 = std::min(y0 + 1, sh - 1);
+        float ty = sy - y0;
+        for (unsigned int x = 0; x < w; ++x) {
+            float sx = std::max(0.0f, (x + 0.5f) * fx - 0.5f);
+            unsigned int x0 = std::min(unsigned(sx), sw - 1), x1 = std::min(x0 + 1, sw - 1);
+            float tx = sx - x0;
+            for (unsigned int c = 0; c < 4; ++c) {
+                float top = (1 - tx) * src[(y0 * sw + x0) * 4 + c] + tx * src[(y0 * sw + x1) * 4 + c];
+                float bot = (1 - tx) * src[(y1 * sw + x0) * 4 + c] + tx * src[(y1 * sw + x1) * 4 + c];
+                dst[(y * w + x) * 4 + c] = uint8_t((1 - ty) * top + ty * bot + 0.5f);
+            }
+        }
+    }
+}
+
+/// halve an RGBA image with a 2x2 box filter (odd sizes clamp at the border)
+void downsample(const std::vector<uint8_t>& src, unsigned sw, unsigned sh,
+                std::vector<uint8_t>& dst, unsigned w, unsigned h)
+{
+    dst.resize(w * h * 4);
+    for (unsigned int y = 0; y < h; ++y) {
+        unsigned int y0 = std::min(2 * y, sh - 1), y1 = std::min(2 * y + 1, sh - 1);
+        for (unsigned int x = 0; x < w; ++x) {
+            unsigned int x0 = std::min(2 * x, sw - 1), x1 = std::min(2 * x + 1, sw - 1);
+            for (unsigned int c = 0; c < 4; ++c) {
+                unsigned int sum = src[(y0 * sw + x0) * 4 + c] + src[(y0 * sw + x1) * 4 + c]
+                                 + src[(y1 * sw + x0) * 4 + c] + src[(y1 * sw + x1) * 4 + c];
+                dst[(y * w + x) * 4 + c] = uint8_t((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+}
+
+
+//=============================================================================
+
+
+TextureArray::TextureArray() :
+    id_(0), pending_id_(0), width_(0), height_(0), layers_(0), levels_(0)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+TextureArray::~TextureArray()
+{
+    if (id_) glDeleteTextures(1, &id_);
+    if (pending_id_) glDeleteTextures(1, &pending_id_);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureArray::init(GLenum unit, GLint minfilter, GLint magfilter, GLint wrap)
+{
+    // remember this
+    unit_ = unit;
+    minfilter_ = minfilter;
+    magfilter_ = magfilter;
+    wrap_ = wrap;
+
+    // create texture object
+    id_ = createTexture();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+GLuint TextureArray::createTexture() const
+{
+    // activate texture unit
+    glActiveTexture(unit_);
+
+    // create texture object
+    GLuint id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+
+    // set texture parameters
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, magfilter_);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, minfilter_);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap_);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap_);
+
+    return id;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureArray::allocate(unsigned width, unsigned height, unsigned layers)
+{
+    assert(id_);
+    glActiveTexture(unit_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id_);
+    allocateStorage(width, height, layers);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureArray::allocateStorage(unsigned width, unsigned height, unsigned layers)
+{
+    width_  = width;
+    height_ = height;
+    layers_ = layers;
+
+    levels_ = mipLevels(width_, height_);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels_ - 1);
+    for (unsigned int level = 0; level < levels_; ++level) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA,
+                     std::max(1u, width_ >> level), std::max(1u, height_ >> level), layers_,
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool TextureArray::loadPNGs(const std::vector<std::string>& filenames)
+{
+    TRACE_SCOPE("TextureArray::loadPNGs");
+
+    // decode everything first, the common size depends on all images
+    std::vector<std::vector<uint8_t>> images(filenames.size());
+    std::vector<unsigned> widths(filenames.size()), heights(filenames.size());
+    unsigned width = 1, height = 1;
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        std::cout << "Load texture " << filenames[i] << " into layer " << i << "\n" << std::flush;
+        unsigned error = lodepng::decode(images[i], widths[i], heights[i], filenames[i]);
+        if (error) {
+            std::cout << "read error: " << lodepng_error_text(error) << std::endl;
+            return false;
+        }
+        width  = std::max(width,  widths[i]);
+        height = std::max(height, heights[i]);
+    }
+
+    allocate(width, height, filenames.size());
+
+    bool ok = true;
+    for (size_t i = 0; i < filenames.size(); ++i)
+        ok &= uploadLayer(i, images[i], widths[i], heights[i]);
+    return ok;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool TextureArray::loadPNG(unsigned layer, const char* filename)
+{
+    TRACE_SCOPE("TextureArray::loadPNG");
+    std::cout << "Load texture " << filename << " into layer " << layer << "\n" << std::flush;
+
+    std::vector<uint8_t> img;
+    unsigned width, height;
+
+    unsigned error = lodepng::decode(img, width, height, filename);
+    if (error) {
+        std::cout << "read error: " << lodepng_error_text(error) << std::endl;
+        return false;
+    }
+
+    return uploadLayer(layer, img, width, height);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool TextureArray::uploadLayer(unsigned layer, const std::vector<uint8_t> &img, unsigned width, unsigned height)
+{
+    if (!id_ || !layers_) {
+        std::cerr << "TextureArray: initialize and allocate before loading!\n";
+        return false;
+    }
+
+    std::vector<std::vector<uint8_t>> mips;
+    buildLevels(img, width, height, width_, height_, levels_, mips);
+    return uploadLevels(layer, mips);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+unsigned TextureArray::mipLevels(unsigned width, unsigned height) const
+{
+    // full mip chain down to 1x1, or just the base level
+    unsigned levels = 1;
+    if (minfilter_ == GL_LINEAR_MIPMAP_LINEAR)
+        while ((std::max(width, height) >> levels) > 0) ++levels;
+    return levels;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureArray::buildLevels(const std::vector<uint8_t>& img, unsigned img_width, unsigned img_height,
+                               unsigned width, unsigned height, unsigned levels,
+                               std::vector<std::vector<uint8_t>>& mips)
+{
+    // bring the image to the size of the array, then box-filter the chain
+    mips.resize(levels);
+    resample_flipped(img, img_width, img_height, mips[0], width, height);
+    unsigned w = width, h = height;
+    for (unsigned int level = 1; level < levels; ++level) {
+        unsigned nw = std::max(1u, w / 2), nh = std::max(1u, h / 2);
+        downsample(mips[level - 1], w, h, mips[level], nw, nh);
+        w = nw; h = nh;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool TextureArray::uploadLevels(unsigned layer, const std::vector<std::vector<uint8_t>>& mips)
+{
+    if (!id_ || !layers_) {
+        std::cerr << "TextureArray: initialize and allocate before loading!\n";
+        return false;
+    }
+    if (layer >= layers_) {
+        std::cerr << "TextureArray: layer " << layer << " out of range\n";
+        return false;
+    }
+    assert(mips.size() == levels_);
+
+    glActiveTexture(unit_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    unsigned w = width_, h = height_;
+    for (unsigned int level = 0; level < levels_; ++level) {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, mips[level].data());
+        w = std::max(1u, w / 2);
+        h = std::max(1u, h / 2);
+    }
+
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureArray::beginUpload(unsigned width, unsigned height, unsigned layers)
+{
+    assert(id_);
+    if (pending_id_) glDeleteTextures(1, &pending_id_);
+
+    // upload into a second texture, the current one is still drawn; the
+    // array takes the new size right away, so that mipLevels() and
+    // buildLevels() match the pending storage
+    pending_id_ = createTexture();
+    allocateStorage(width, height, layers);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureArray::uploadRows(unsigned level, unsigned layer, unsigned y, unsigned rows, const void* pixels)
+{
+    assert(pending_id_ && level < levels_ && layer < layers_);
+    glActiveTexture(unit_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, pending_id_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, y, layer, std::max(1u, width_ >> level), rows, 1,
+                    GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureArray::finishUpload()
+{
+    assert(pending_id_);
+    glDeleteTextures(1, &id_);
+    id_ = pending_id_;
+    pending_id_ = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureArray::bind()
+{
+    assert(id_);
+    glActiveTexture(unit_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id_);
+}
+
+
+//=============================================================================
@@ -0,0 +1,126 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "gl.hh"
+#include <vector>
+#include <string>
+
+/// class that packs several same-sized images into one GL_TEXTURE_2D_ARRAY,
+/// so that objects using different textures can be rendered in a single
+/// (instanced) draw call
+class TextureArray
+{
+public:
+
+    /// default constructor
+    TextureArray();
+
+    // TextureArray objects may not be assigned or copied, or both copies will
+    // believe they own the OpenGL texture exclusively.
+    TextureArray(const TextureArray&) = delete;
+    TextureArray& operator=(const TextureArray&) = delete;
+
+    /// default destructor
+    ~TextureArray();
+
+    /// creates an empty texture array on the GPU
+    /// \param unit texure unit (important for use of multiple texturs in shader)
+    /// \param minfilter interpolation filter for minification
+    /// \param magfilter interpolation filter for magnification
+    /// \param wrap texture coordinates wrap preference
+    void init(GLenum unit, GLint minfilter, GLint magfilter, GLint wrap);
+
+    /// allocate storage (including all mip levels, if mipmapping is enabled)
+    /// for \c layers images of size \c width x \c height
+    void allocate(unsigned width, unsigned height, unsigned layers);
+
+    /// Load several png files, one per layer in the given order. The array is
+    /// allocated with the largest width and height found among the images;
+    /// smaller images are resampled to that common size.
+    /// \param filenames the locations and names of the textures for upload
+    bool loadPNGs(const std::vector<std::string>& filenames);
+
+    /// Load a png file into the given layer of an already allocated array.
+    /// Images of a different size are resampled to the size of the array.
+    /// \param filename the location and name of the texture for upload
+    bool loadPNG(unsigned layer, const char* filename);
+
+    /// Upload an RGBA byte array into the given layer, resampling it to the
+    /// size of the array and building its mip chain on the CPU.
+    bool uploadLayer(unsigned layer, const std::vector<unsigned char> &img, unsigned width, unsigned height);
+
+    /// number of mip levels an array of the given size gets with the min
+    /// filter chosen in init()
+    unsigned mipLevels(unsigned width, unsigned height) const;
+
+    /// Resample an RGBA image to width x height (flipped for OpenGL) and
+    /// build its box-filtered mip chain of the given number of levels. CPU
+    /// only and thread-safe, for preparing layers off the GL thread.
+    static void buildLevels(const std::vector<unsigned char>& img, unsigned img_width, unsigned img_height,
+                            unsigned width, unsigned height, unsigned levels,
+                            std::vector<std::vector<unsigned char>>& mips);
+
+    /// upload a mip chain made by buildLevels() for the array's size into
+    /// the given layer
+    bool uploadLevels(unsigned layer, const std::vector<std::vector<unsigned char>>& mips);
+
+    /// Start replacing the array by one of the given size, whose levels are
+    /// uploaded in row slices with uploadRows(). The current array stays in
+    /// use until finishUpload().
+    void beginUpload(unsigned width, unsigned height, unsigned layers);
+
+    /// Upload rows [y, y + rows) of a level of a layer of the new array.
+    /// \c pixels is an offset into the bound GL_PIXEL_UNPACK_BUFFER, or
+    /// client memory if none is bound.
+    void uploadRows(unsigned level, unsigned layer, unsigned y, unsigned rows, const void* pixels);
+
+    /// switch to the new array
+    void finishUpload();
+
+    /// activates this texture array for the predefined unit
+    void bind();
+
+    /// returns the texture id
+    GLint id() const { return id_; }
+
+    /// returns the number of layers
+    unsigned layers() const { return layers_; }
+
+private:
+
+    /// create a texture object with the parameters given to init()
+    GLuint createTexture() const;
+
+    /// set the size and allocate the storage of the bound texture object
+    void allocateStorage(unsigned width, unsigned height, unsigned layers);
+
+private:
+
+    /// texture ID on GPU
+    GLuint id_;
+
+    /// texture that beginUpload() is filling
+    GLuint pending_id_;
+
+    /// texture unit (important for use of multiple textures in shader)
+    GLenum unit_;
+
+    /// the filter and wrap settings
+    GLint minfilter_, magfilter_, wrap_;
+
+    /// size of every layer
+    unsigned width_, height_;
+
+    /// number of layers
+    unsigned layers_;
+
+    /// number of mip levels
+    unsigned levels_;
+};
@@ -0,0 +1,176 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+// Offline texture baker: converts a PNG file into a baked texture with its
+// complete mip chain (see baked_texture.hh), optionally block compressed,
+// run for all textures by the bake_assets target. Given several PNG files,
+// it packs their red channels into the channels of one texture; with
+// --paged it cuts the levels into pages for virtual texturing.
+
+#include "baked_texture.hh"
+#include "block_compression.hh"
+#include "png_decoder.hh"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include "lodepng.h"
+
+//=============================================================================
+
+
+int main(int argc, char *argv[])
+{
+    // command line: [--linear] [--paged] [--format F] [--quality Q] [--min-psnr DB] input.png [input.png ...] output.btex
+    bool srgb = true, paged = false;
+    std::string format_name = "auto", output;
+    std::vector<std::string> inputs;
+    int quality = 1;
+    double min_psnr = 0.0;
+    bool usage = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--linear")                         srgb = false;
+        else if (arg == "--paged")                     paged = true;
+        else if (arg == "--format" && i + 1 < argc)    format_name = argv[++i];
+        else if (arg == "--quality" && i + 1 < argc)   quality = std::atoi(argv[++i]);
+        else if (arg == "--min-psnr" && i + 1 < argc)  min_psnr = std::atof(argv[++i]);
+        else if (arg.compare(0, 2, "--") == 0)         usage = true;
+        else                                           inputs.push_back(arg);
+    }
+    if (inputs.size() >= 2) {
+        output = inputs.back();
+        inputs.pop_back();
+    }
+    static const char* formats[] = { "auto", "rgba8", "bc1", "bc3", "bc4", "bc5" };
+    int format_index = int(std::find(std::begin(formats), std::end(formats), format_name) - std::begin(formats));
+    if (usage || inputs.empty() || inputs.size() > 4 || format_index == 6 || quality < 0 || quality > 2) {
+        std::cerr << "Usage: " << argv[0] << " [--linear] [--paged] [--format F] [--quality Q] [--min-psnr DB] INPUT.png [INPUT.png ...] OUTPUT.btex\n"
+                  << "  several inputs (up to four) are packed: the red channel of each input\n"
+                  << "  becomes the next channel of the output\n"
+                  << "  --linear    the image holds data, not sRGB colors (filter it as is)\n"
+                  << "  --paged     cut the levels into pages with borders for virtual texturing,\n"
+                  << "              down to the first level that fits into one page\n"
+                  << "  --format    auto (default), rgba8, bc1, bc3, bc4 or bc5; auto picks bc4 for\n"
+                  << "              grey images, bc5 for two packed channels, bc1 for opaque and\n"
+                  << "              bc3 for transparent ones\n"
+                  << "  --quality   block compression effort from 0 (fastest) to 2 (default 1)\n"
+                  << "  --min-psnr  fail if the compressed base level is worse (dB)" << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::vector<uint8_t>> images(inputs.size());
+    std::vector<unsigned> widths(inputs.size()), heights(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        unsigned error = png_decode_file(images[i], widths[i], heights[i], inputs[i]);
+        if (error) {
+            std::cerr << inputs[i] << ": " << lodepng_error_text(error) << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<uint8_t> img;
+    unsigned width, height;
+    if (inputs.size() == 1) {
+        img.swap(images[0]);
+        width  = widths[0];
+        height = heights[0];
+    }
+    else {
+        pack_channels(images, widths, heights, img, width, height);
+    }
+    images.clear();
+
+    BakedFormat format = BakedFormat(format_index);
+    if (format_index == 0 && inputs.size() == 2) {
+        format = BAKED_BC5;
+    }
+    else if (format_index == 0) {
+        bool grey = true, opaque = true;
+        for (size_t i = 0; i < img.size(); i += 4) {
+            grey   &= img[i] == img[i + 1] && img[i] == img[i + 2];
+            opaque &= img[i + 3] == 255;
+        }
+        format = (grey && opaque) ? BAKED_BC4 : opaque ? BAKED_BC1 : BAKED_BC3;
+    }
+
+    std::vector<std::vector<uint8_t>> levels;
+    bake_mip_chain(img, width, height, srgb, levels);
+
+    // pages: each level becomes a column of pages (the page grid has to halve
+    // from level to level, so that the viewer's page table is a mip chain)
+    if (paged) {
+        const unsigned pages_x = baked_pages(width), pages_y = baked_pages(height);
+        size_t n = 0;
+        while (n < levels.size()) {
+            unsigned w = std::max(1u, width >> n), h = std::max(1u, height >> n);
+            if (baked_pages(w) != std::max(1u, pages_x >> n) || baked_pages(h) != std::max(1u, pages_y >> n)) {
+                std::cerr << inputs[0] << ": paged textures need sides of " << BAKED_PAGE_SIZE
+                          << " times a power of two" << std::endl;
+                return 1;
+            }
+            std::vector<uint8_t> pages;
+            cut_pages(levels[n], w, h, pages);
+            levels[n].swap(pages);
+            ++n;
+            if (w <= BAKED_PAGE_SIZE && h <= BAKED_PAGE_SIZE) break;
+        }
+        levels.resize(n);
+    }
+
+    // block compression of all levels; the error is measured on level 0
+    // (against the flipped source, which it is made of)
+    double psnr = std::numeric_limits<double>::infinity();
+    if (format != BAKED_RGBA8) {
+        for (size_t l = 0; l < levels.size(); ++l) {
+            unsigned w = std::max(1u, width >> l), h = std::max(1u, height >> l);
+            if (paged) {
+                h = levels[l].size() / (BAKED_PAGE_STRIDE * 4);
+                w = BAKED_PAGE_STRIDE;
+            }
+            std::vector<uint8_t> blocks;
+            compress_image(levels[l], w, h, format, quality, blocks);
+            if (l == 0) {
+                std::vector<uint8_t> decoded;
+                decompress_image(blocks, w, h, format, decoded);
+                psnr = compression_psnr(levels[0], decoded, format);
+            }
+            levels[l].swap(blocks);
+        }
+    }
+
+    uint32_t flags = (srgb ? uint32_t(BAKED_SRGB) : 0u) | (paged ? uint32_t(BAKED_PAGED) : 0u);
+    if (!write_baked_texture(output, format, flags, width, height, levels)) {
+        std::cerr << output << ": write error" << std::endl;
+        return 1;
+    }
+
+    size_t bytes = 0;
+    for (auto& level : levels) bytes += level.size();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Baked " << output << ": " << width << "x" << height << ", " << levels.size() << " levels "
+              << (paged ? "of pages " : "") << formats[format] << (srgb ? " (sRGB)" : " (linear)") << ", " << bytes / 1024 << " KB";
+    if (format != BAKED_RGBA8) std::cout << ", PSNR " << std::fixed << std::setprecision(1) << psnr << " dB";
+    std::cout << " in " << int(ms) << " ms" << std::endl;
+
+    if (psnr < min_psnr) {
+        std::cerr << output << ": PSNR " << psnr << " dB below the required " << min_psnr << " dB" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+//=============================================================================
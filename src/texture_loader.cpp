@@ -0,0 +1,470 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "texture_loader.hh"
+#include "png_decoder.hh"
+#include "trace.hh"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include "lodepng.h"
+
+//=============================================================================
+
+
+struct TextureLoader::ArrayJob
+{
+    TextureArray* array;
+    std::vector<std::string> filenames;
+    std::vector<std::vector<uint8_t>> images;
+    std::vector<unsigned> widths, heights;
+    std::vector<unsigned> errors;
+    /// layers still being decoded
+    std::atomic<size_t> remaining;
+    double seconds = 0.0;
+};
+
+
+//=============================================================================
+
+
+TextureLoader::TextureLoader()
+    : decoders_(new ThreadPool(std::max(2u, std::thread::hardware_concurrency()) - 1))
+{
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+TextureLoader::~TextureLoader()
+{
+    // join the decoders before the results they write to go away
+    decoders_.reset();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureLoader::load(Texture& texture, const std::string& filename,
+                         unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+    texture.uploadPlaceholder(r, g, b, a);
+    queue(texture, { filename });
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureLoader::load_packed(Texture& texture, const std::vector<std::string>& filenames,
+                                unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+    assert(filenames.size() >= 2 && filenames.size() <= 4);
+    texture.uploadPlaceholder(r, g, b, a);
+    queue(texture, filenames);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureLoader::queue(Texture& texture, const std::vector<std::string>& filenames)
+{
+    ++pending_;
+
+    decoders_->enqueue([this, &texture, filenames] {
+        TRACE_SCOPE("TextureLoader::decode");
+        auto start = std::chrono::steady_clock::now();
+
+        std::unique_ptr<Result> result(new Result);
+        result->texture  = &texture;
+        result->filename = filenames.front();
+        for (size_t i = 1; i < filenames.size(); ++i) result->filename += " + " + filenames[i];
+
+        // prefer the baked texture, mapped instead of decoded
+        std::unique_ptr<BakedTexture> baked(new BakedTexture);
+        if (use_baked_ && open_baked(filenames, *baked)) {
+            result->width  = baked->width();
+            result->height = baked->height();
+            result->baked  = std::move(baked);
+            result->ok = true;
+        }
+        else {
+            std::vector<std::vector<uint8_t>> images(filenames.size());
+            std::vector<unsigned> widths(filenames.size()), heights(filenames.size());
+            result->ok = true;
+            for (size_t i = 0; i < filenames.size(); ++i) {
+                unsigned error = png_decode_file(images[i], widths[i], heights[i], filenames[i]);
+                if (error) {
+                    std::cout << "read error (" << filenames[i] << "): " << lodepng_error_text(error) << std::endl;
+                    result->ok = false;
+                }
+            }
+
+            if (result->ok && filenames.size() == 1) {
+                result->image.swap(images[0]);
+                result->width  = widths[0];
+                result->height = heights[0];
+            }
+            else if (result->ok) {
+                pack_channels(images, widths, heights, result->image, result->width, result->height);
+            }
+        }
+        result->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        finished(std::move(result));
+    });
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureLoader::load(TextureArray& array, const std::vector<std::string>& filenames,
+                         unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+    const size_t n = filenames.size();
+    if (n == 0) return;
+
+    // placeholder: every layer a single texel of the color
+    array.allocate(1, 1, n);
+    std::vector<uint8_t> texel = { r, g, b, a };
+    for (unsigned int layer = 0; layer < n; ++layer)
+        array.uploadLayer(layer, texel, 1, 1);
+    ++pending_;
+
+    auto job = std::make_shared<ArrayJob>();
+    job->array = &array;
+    job->filenames = filenames;
+    job->images.resize(n);
+    job->widths.assign(n, 0);
+    job->heights.assign(n, 0);
+    job->errors.assign(n, 0);
+    job->remaining = n;
+
+    // decode the layers in parallel; the last one to finish resamples all
+    // of them to the common size and builds the mip chains
+    for (size_t i = 0; i < n; ++i) {
+        decoders_->enqueue([this, job, i] {
+            TRACE_SCOPE("TextureLoader::decode");
+            auto start = std::chrono::steady_clock::now();
+            job->errors[i] = png_decode_file(job->images[i], job->widths[i], job->heights[i], job->filenames[i]);
+            if (job->errors[i]) {
+                std::cout << "read error (" << job->filenames[i] << "): "
+                          << lodepng_error_text(job->errors[i]) << std::endl;
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (job->remaining.fetch_sub(1) != 1) return;
+
+            TRACE_SCOPE("TextureLoader::build_levels");
+            std::unique_ptr<Result> result(new Result);
+            result->array = job->array;
+            result->filename = job->filenames.front() + " (+" + std::to_string(job->filenames.size() - 1) + " layers)";
+            result->ok = std::none_of(job->errors.begin(), job->errors.end(), [](unsigned e) { return e != 0; });
+            if (result->ok) {
+                result->width  = *std::max_element(job->widths.begin(), job->widths.end());
+                result->height = *std::max_element(job->heights.begin(), job->heights.end());
+                unsigned levels = job->array->mipLevels(result->width, result->height);
+                result->layers.resize(job->images.size());
+                for (size_t l = 0; l < job->images.size(); ++l) {
+                    TextureArray::buildLevels(job->images[l], job->widths[l], job->heights[l],
+                                              result->width, result->height, levels, result->layers[l]);
+                    std::vector<uint8_t>().swap(job->images[l]);
+                }
+            }
+            result->seconds = seconds + std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            finished(std::move(result));
+        });
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool TextureLoader::open_baked(const std::vector<std::string>& filenames, BakedTexture& baked)
+{
+    // BAKED_TEXTURE_PATH/<name>[+<name>...].btex, if not older than the png files
+    namespace fs = std::filesystem;
+    std::string name;
+    for (const std::string& filename : filenames)
+        name += (name.empty() ? "" : "+") + fs::path(filename).stem().string();
+    std::error_code error;
+    fs::path path = fs::path(BAKED_TEXTURE_PATH) / (name + ".btex");
+    auto baked_time = fs::last_write_time(path, error);
+    if (error) return false;
+    for (const std::string& filename : filenames) {
+        auto png_time = fs::last_write_time(filename, error);
+        if (!error && png_time > baked_time) return false;
+    }
+
+    // (paged textures are for VirtualTexture)
+    if (!baked.open(path.string()) || !gl_format(baked.format()) || (baked.flags() & BAKED_PAGED)) return false;
+
+    // all levels complete?
+    for (unsigned int level = 0; level < baked.levels(); ++level) {
+        const unsigned b = baked_block_size(baked.format());
+        size_t rows = (baked.height(level) + b - 1) / b;
+        if (baked.level_size(level) < rows * baked_row_bytes(baked.format(), baked.width(level))) return false;
+    }
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+GLenum TextureLoader::gl_format(uint32_t format)
+{
+    switch (format) {
+        case BAKED_RGBA8:
+            return GL_RGBA;
+        case BAKED_BC1:
+            return GLEW_EXT_texture_compression_s3tc ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 0;
+        case BAKED_BC3:
+            return GLEW_EXT_texture_compression_s3tc ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : 0;
+        case BAKED_BC4:
+            // sampled as grey through the texture swizzle
+            return (GLEW_VERSION_3_3 || GLEW_ARB_texture_swizzle) ? GL_COMPRESSED_RED_RGTC1 : 0;
+        case BAKED_BC5:
+            return GL_COMPRESSED_RG_RGTC2;
+        default:
+            return 0;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureLoader::finished(std::unique_ptr<Result> result)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_.push_back(std::move(result));
+    }
+    cond_.notify_all();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool TextureLoader::update(unsigned int max_slots)
+{
+    if (pending_ == 0) return false;
+    TRACE_SCOPE("TextureLoader::update");
+
+    if (!ring_.initialized()) ring_.initialize(SLOTS, SLOT_BYTES);
+    bool progress = false;
+
+    // issue the uploads of the staging buffers the workers have filled
+    for (unsigned int n = 0; n < max_slots && !fills_.empty() && fills_.front()->filled; ++n) {
+        submit(*fills_.front());
+        fills_.pop_front();
+        progress = true;
+    }
+
+    // start uploading newly decoded images
+    std::vector<std::unique_ptr<Result>> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready.swap(finished_);
+    }
+    for (auto& result : ready) {
+        begin_stream(std::move(result));
+        progress = true;
+    }
+
+    // keep the workers busy filling the next staging buffers
+    for (unsigned int n = 0; n < max_slots && queue_fill(); ++n)
+        progress = true;
+
+    return progress;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureLoader::finish()
+{
+    while (pending_) {
+        if (update(~0u)) continue;
+
+        // wait for a decoder or a worker filling a staging buffer, and let
+        // the GPU catch up with the uploads from the staging buffers
+        glFlush();
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait_for(lock, std::chrono::milliseconds(1), [this] {
+            return !finished_.empty() || (!fills_.empty() && fills_.front()->filled);
+        });
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureLoader::begin_stream(std::unique_ptr<Result> result)
+{
+    if (!result->ok) {
+        // keeps the placeholder
+        --pending_;
+        return;
+    }
+
+    std::unique_ptr<Stream> stream(new Stream);
+    stream->start = std::chrono::steady_clock::now();
+
+    if (result->baked) {
+        // the baked levels are ready to use; without mip mapping only the
+        // base level is needed
+        const BakedTexture& baked = *result->baked;
+        unsigned levels = result->texture->mipmapped() ? baked.levels() : 1;
+        result->texture->beginUpload(baked.width(), baked.height(), levels, gl_format(baked.format()));
+        for (unsigned int level = 0; level < levels; ++level)
+            stream->regions.push_back({ level, 0, baked.width(level), baked.height(level), baked.level(level),
+                                        false, baked.format() });
+    }
+    else if (result->texture) {
+        // the png rows are top to bottom, OpenGL wants the bottom row first
+        result->texture->beginUpload(result->width, result->height);
+        stream->regions.push_back({ 0, 0, result->width, result->height, result->image.data(), true, BAKED_RGBA8 });
+    }
+    else {
+        // buildLevels() has already flipped the levels
+        result->array->beginUpload(result->width, result->height, result->layers.size());
+        for (unsigned int layer = 0; layer < result->layers.size(); ++layer) {
+            unsigned w = result->width, h = result->height;
+            for (unsigned int level = 0; level < result->layers[layer].size(); ++level) {
+                stream->regions.push_back({ level, layer, w, h, result->layers[layer][level].data(), false, BAKED_RGBA8 });
+                w = std::max(1u, w / 2);
+                h = std::max(1u, h / 2);
+            }
+        }
+    }
+
+    stream->result = std::move(result);
+    streams_.push_back(std::move(stream));
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool TextureLoader::queue_fill()
+{
+    // the first stream with rows left to copy
+    auto it = std::find_if(streams_.begin(), streams_.end(), [](const std::unique_ptr<Stream>& s) {
+        return s->region < s->regions.size();
+    });
+    if (it == streams_.end()) return false;
+    Stream& stream = **it;
+
+    int slot = ring_.acquire();
+    if (slot < 0) return false;
+
+    // pack as many whole rows of the stream as fit into the buffer
+    std::unique_ptr<Fill> fill(new Fill);
+    fill->slot   = slot;
+    fill->stream = &stream;
+    size_t offset = 0;
+    while (stream.region < stream.regions.size()) {
+        const Region& region = stream.regions[stream.region];
+        const size_t row_bytes = region.row_bytes();
+        assert(row_bytes <= SLOT_BYTES);
+        unsigned rows = std::min<size_t>(region.rows() - stream.row, (SLOT_BYTES - offset) / row_bytes);
+        if (rows == 0) break;
+
+        fill->pieces.push_back({ &region, stream.row, rows, offset });
+        offset += rows * row_bytes;
+        stream.row += rows;
+        if (stream.row == region.rows()) {
+            ++stream.region;
+            stream.row = 0;
+        }
+    }
+    ++stream.in_flight;
+
+    // the copy runs on a decoder thread, straight into the mapped buffer
+    Fill* f = fill.get();
+    uint8_t* data = ring_.data(slot);
+    decoders_->enqueue([this, f, data] {
+        TRACE_SCOPE("TextureLoader::fill");
+        for (const Piece& piece : f->pieces) {
+            const Region& region = *piece.region;
+            const size_t row_bytes = region.row_bytes();
+            for (unsigned int i = 0; i < piece.rows; ++i) {
+                unsigned y = piece.y + i;
+                unsigned src = region.flip ? region.rows() - 1 - y : y;
+                std::memcpy(data + piece.offset + i * row_bytes, region.pixels + src * row_bytes, row_bytes);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            f->filled = true;
+        }
+        cond_.notify_all();
+    });
+
+    fills_.push_back(std::move(fill));
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void TextureLoader::submit(Fill& fill)
+{
+    TRACE_SCOPE("TextureLoader::submit");
+    Stream& stream = *fill.stream;
+    Result& result = *stream.result;
+
+    // pixel arguments are offsets into the bound buffer
+    ring_.bind(fill.slot);
+    for (const Piece& piece : fill.pieces) {
+        const Region& region = *piece.region;
+        const void* offset = (const void*)piece.offset;
+
+        // rows of blocks cover four texel rows, except at the top
+        const unsigned block = baked_block_size(region.format);
+        const unsigned y = piece.y * block, rows = std::min(piece.rows * block, region.height - y);
+
+        if (result.texture)
+            result.texture->uploadRows(region.level, y, rows, offset);
+        else
+            result.array->uploadRows(region.level, region.layer, y, rows, offset);
+    }
+    ring_.release(fill.slot);
+
+    // complete?
+    if (--stream.in_flight > 0 || stream.region < stream.regions.size()) return;
+
+    if (result.texture) result.texture->finishUpload();
+    else                result.array->finishUpload();
+
+    double upload_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stream.start).count();
+    std::cout << "Loaded texture " << result.filename << " (" << result.width << "x" << result.height
+              << (result.baked ? ", baked, mapped in " : ", decoded in ") << int(1000.0 * result.seconds) << " ms, streamed in "
+              << int(upload_ms) << " ms)" << std::endl;
+
+    streams_.erase(std::find_if(streams_.begin(), streams_.end(),
+                                [&](const std::unique_ptr<Stream>& s) { return s.get() == &stream; }));
+    --pending_;
+}
+
+
+//=============================================================================
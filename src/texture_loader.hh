@@ -0,0 +1,203 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "baked_texture.hh"
+#include "texture.hh"
+#include "texture_array.hh"
+#include "thread_pool.hh"
+#include "upload_ring.hh"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//=============================================================================
+
+
+/// Loads textures in the background: PNG decoding (and, for texture arrays,
+/// resampling and mip chain generation) runs on worker threads. The images
+/// are then streamed to the GPU through a ring of pixel unpack buffers:
+/// worker threads copy row slices into the mapped buffers, and update() on
+/// the GL thread issues the uploads from them, a few slices per frame, into
+/// a second texture object that replaces the old one when complete. Until
+/// then the textures show a 1x1 placeholder color, so rendering starts at
+/// once and is never held up by a large upload.
+class TextureLoader
+{
+public:
+
+    /// starts its own decoder threads, at least one even on a single core
+    /// (decoding must not run on the GL thread, and long decodes must not
+    /// hold up the shared pool's parallel loops)
+    TextureLoader();
+
+    /// waits for the running decodes; unfinished textures keep their placeholder
+    ~TextureLoader();
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    /// Set the placeholder color and queue the png file for decoding into
+    /// the (initialized) texture.
+    void load(Texture& texture, const std::string& filename,
+              unsigned char r, unsigned char g, unsigned char b, unsigned char a = 255);
+
+    /// Set the placeholder color and queue png files (two to four) whose red
+    /// channels are packed into the channels of the texture, in the order of
+    /// the files, at the largest size among them (see pack_channels()). The
+    /// baked version is named after all files, e.g. clouds+gloss.btex.
+    void load_packed(Texture& texture, const std::vector<std::string>& filenames,
+                     unsigned char r, unsigned char g, unsigned char b, unsigned char a = 255);
+
+    /// Queue png files, one per layer, for the (initialized) texture array;
+    /// like TextureArray::loadPNGs() the array gets the largest size among
+    /// the images. The array is a 1x1 placeholder of the given color until
+    /// all layers are ready.
+    void load(TextureArray& array, const std::vector<std::string>& filenames,
+              unsigned char r, unsigned char g, unsigned char b, unsigned char a = 255);
+
+    /// Stream decoded textures to the GPU, submitting at most max_slots
+    /// staging buffers of data (GL thread only). Returns true if there was
+    /// any progress.
+    bool update(unsigned int max_slots = 1);
+
+    /// Whether textures are read from their baked version (see the
+    /// bake_assets target) if it exists and is not older than the png file.
+    /// Arrays always use the png files, as they resample their layers to a
+    /// common size.
+    void set_use_baked(bool use_baked) { use_baked_ = use_baked; }
+
+    /// GL internal format for a BakedFormat, 0 if the GL cannot sample it
+    static GLenum gl_format(uint32_t format);
+
+    /// wait for all decodes and upload everything
+    void finish();
+
+    /// true when every queued texture is uploaded (or failed to load)
+    bool done() const { return pending_ == 0; }
+
+private:
+
+    /// a decoded image waiting for its upload
+    struct Result {
+        Texture* texture = nullptr;
+        TextureArray* array = nullptr;
+        std::string filename;
+        bool ok = false;
+        unsigned width = 0, height = 0;
+        /// the image (texture) or the mip chains of all layers (array)
+        std::vector<uint8_t> image;
+        std::vector<std::vector<std::vector<uint8_t>>> layers;
+        /// or the baked texture with its mip chain
+        std::unique_ptr<BakedTexture> baked;
+        /// decoding time
+        double seconds = 0.0;
+    };
+
+    /// texture array whose layers are decoded by separate jobs
+    struct ArrayJob;
+
+    /// image of a texture, or a level of a layer of a texture array, in
+    /// memory; rows are stored top to bottom if flip is set
+    struct Region {
+        unsigned level, layer;
+        unsigned width, height;
+        const uint8_t* pixels;
+        bool flip;
+        /// BakedFormat of the pixels, rows of texels or of 4x4 blocks
+        uint32_t format;
+
+        /// rows (of texels or blocks) and their size
+        unsigned rows() const { unsigned b = baked_block_size(format); return (height + b - 1) / b; }
+        size_t row_bytes() const { return baked_row_bytes(format, width); }
+    };
+
+    /// upload of a decoded image in progress
+    struct Stream {
+        std::unique_ptr<Result> result;
+        std::vector<Region> regions;
+        /// next rows (of texels or blocks) to copy into a staging buffer
+        size_t region = 0;
+        unsigned row = 0;
+        /// slices copied but not yet submitted
+        unsigned int in_flight = 0;
+        /// when the upload started
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /// rows (of texels or blocks) of a region in a staging buffer
+    struct Piece {
+        const Region* region;
+        unsigned y, rows;
+        size_t offset;
+    };
+
+    /// staging buffer being filled by a worker thread
+    struct Fill {
+        int slot;
+        Stream* stream;
+        std::vector<Piece> pieces;
+        std::atomic<bool> filled { false };
+    };
+
+    /// queue the decoding of a texture from one png file, or the packing of several
+    void queue(Texture& texture, const std::vector<std::string>& filenames);
+
+    /// map the baked version of a png file (or a packed set of them), if
+    /// there is an up to date one
+    static bool open_baked(const std::vector<std::string>& filenames, BakedTexture& baked);
+
+    /// hand a decoded image to the GL thread
+    void finished(std::unique_ptr<Result> result);
+
+    /// begin streaming a decoded image (GL thread)
+    void begin_stream(std::unique_ptr<Result> result);
+
+    /// pack the next rows of the streams into a free staging buffer and
+    /// have a worker copy them; false if nothing is left or no buffer free
+    bool queue_fill();
+
+    /// issue the uploads from a filled staging buffer (GL thread)
+    void submit(Fill& fill);
+
+    /// size and number of the staging buffers
+    static const size_t SLOT_BYTES = 4 << 20;
+    static const unsigned int SLOTS = 4;
+
+private:
+
+    /// decoded images (protected by mutex_)
+    std::vector<std::unique_ptr<Result>> finished_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+
+    /// whether to read baked textures
+    bool use_baked_ = true;
+
+    /// textures queued but not yet uploaded, the uploads in progress and the
+    /// staging buffers being filled, in order (GL thread only)
+    size_t pending_ = 0;
+    std::deque<std::unique_ptr<Stream>> streams_;
+    std::deque<std::unique_ptr<Fill>> fills_;
+
+    /// staging buffers
+    UploadRing ring_;
+
+    /// decoder threads; declared last, so that they are joined before the
+    /// state above is destroyed
+    std::unique_ptr<ThreadPool> decoders_;
+};
+
+
+//=============================================================================
@@ -0,0 +1,182 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "thread_pool.hh"
+#include "trace.hh"
+#include <algorithm>
+
+//=============================================================================
+
+
+/// set by ThreadPool::set_thread_serial()
+static thread_local bool serial_thread = false;
+
+
+//-----------------------------------------------------------------------------
+
+
+ThreadPool& ThreadPool::instance()
+{
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+ThreadPool::ThreadPool(unsigned n_workers)
+{
+    for (unsigned i = 0; i < n_workers; ++i) {
+        workers_.emplace_back([this, i] {
+            Tracer::instance().set_thread_name("worker " + std::to_string(i + 1));
+            work();
+        });
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    for (auto& w : workers_) w.join();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void ThreadPool::work()
+{
+    for (;;) {
+        std::function<void()> job;
+        Task* task = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] {
+                return stop_ || !jobs_.empty() || (task_ && task_->next.load() < task_->chunks);
+            });
+
+            // helping with a parallel_for comes first, its caller waits for it
+            if (task_ && task_->next.load() < task_->chunks) {
+                task = task_;
+                ++task->helpers;
+            }
+            else if (!jobs_.empty()) {
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            else return;
+        }
+
+        if (task) {
+            task->run();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--task->helpers == 0) task_cond_.notify_all();
+        }
+        else {
+            job();
+        }
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void ThreadPool::set_thread_serial(bool serial)
+{
+    serial_thread = serial;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void ThreadPool::enqueue(std::function<void()> job)
+{
+    if (workers_.empty()) {
+        job();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    cond_.notify_one();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void ThreadPool::Task::run()
+{
+    size_t c;
+    while ((c = next.fetch_add(1)) < chunks)
+        function(context, c * chunk, std::min(n, (c + 1) * chunk));
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void ThreadPool::run_parallel(size_t n, size_t grain, RangeFunction function, const void* context)
+{
+    if (n == 0) return;
+    grain = std::max<size_t>(grain, 1);
+
+    // a few chunks per thread for load balancing, but never below grain
+    size_t chunk  = std::max(grain, n / (4 * concurrency()) + 1);
+    size_t chunks = (n + chunk - 1) / chunk;
+    if (chunks == 1 || workers_.empty() || serial_thread) {
+        function(context, 0, n);
+        return;
+    }
+
+    // Publish the task for idle workers (unless another parallel_for has
+    // them). Workers join only while the task is published and count
+    // themselves as helpers, so after withdrawing it we just wait for the
+    // helpers to leave; nothing has to outlive this call.
+    Task task;
+    task.function = function;
+    task.context  = context;
+    task.n        = n;
+    task.chunk    = chunk;
+    task.chunks   = chunks;
+    bool published = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!task_) {
+            task_ = &task;
+            published = true;
+        }
+    }
+    if (!published) {
+        function(context, 0, n);
+        return;
+    }
+    cond_.notify_all();
+
+    task.run();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_ = nullptr;
+    task_cond_.wait(lock, [&] { return task.helpers == 0; });
+}
+
+
+//=============================================================================
@@ -0,0 +1,101 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/// small pool of persistent worker threads that executes queued jobs and
+/// data-parallel loops (the calling thread participates in the latter)
+class ThreadPool
+{
+public:
+
+    /// the pool shared by the whole application
+    static ThreadPool& instance();
+
+    /// start \c n_workers worker threads (0: run everything on the caller)
+    explicit ThreadPool(unsigned n_workers);
+
+    /// finish all queued jobs and join the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// number of threads working on a parallel_for (workers plus caller)
+    unsigned concurrency() const { return workers_.size() + 1; }
+
+    /// Let the parallel_for calls of the calling thread run on it alone, e.g.
+    /// on a background thread that must not take the workers away from the
+    /// render thread.
+    static void set_thread_serial(bool serial);
+
+    /// queue a job for asynchronous execution on one of the workers
+    void enqueue(std::function<void()> job);
+
+    /// Call f(begin, end) for consecutive chunks of at least \c grain
+    /// elements covering [0, n) and return when all chunks are done. Does not
+    /// allocate. Only one parallel_for is spread over the workers at a time;
+    /// one called meanwhile (e.g. nested in a chunk) runs on its caller.
+    template <class F>
+    void parallel_for(size_t n, size_t grain, const F& f)
+    {
+        run_parallel(n, grain, [](const void* context, size_t begin, size_t end) {
+            (*static_cast<const F*>(context))(begin, end);
+        }, &f);
+    }
+
+private:
+
+    /// function of a parallel_for, called with the caller's context
+    typedef void (*RangeFunction)(const void* context, size_t begin, size_t end);
+
+    /// a parallel_for in progress; lives on the stack of its caller
+    struct Task {
+        RangeFunction function;
+        const void* context;
+        size_t n, chunk, chunks;
+        /// next chunk to claim
+        std::atomic<size_t> next{0};
+        /// workers currently helping (protected by mutex_)
+        unsigned helpers = 0;
+
+        /// claim and process chunks until none is left
+        void run();
+    };
+
+    /// parallel_for with the type of the loop body erased
+    void run_parallel(size_t n, size_t grain, RangeFunction function, const void* context);
+
+    /// worker thread main loop
+    void work();
+
+private:
+
+    /// worker threads
+    std::vector<std::thread> workers_;
+    /// jobs not yet picked up by a worker
+    std::deque<std::function<void()>> jobs_;
+    /// protects jobs_ and stop_
+    std::mutex mutex_;
+    /// signals new jobs, a new task or shutdown to the workers
+    std::condition_variable cond_;
+    /// the parallel_for the workers may help with (protected by mutex_)
+    Task* task_ = nullptr;
+    /// signals a helper leaving task_
+    std::condition_variable task_cond_;
+    /// true when the workers should exit
+    bool stop_ = false;
+};
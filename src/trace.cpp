@@ -0,0 +1,154 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "trace.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+
+//=============================================================================
+
+
+void write_chrome_trace(std::ostream& os, const std::vector<TraceEvent>& events,
+                        const std::vector<std::pair<int, std::string>>& thread_names)
+{
+    os << "{\"traceEvents\": [";
+    bool first = true;
+    auto separator = [&]() -> std::ostream& {
+        os << (first ? "\n  " : ",\n  ");
+        first = false;
+        return os;
+    };
+
+    for (const auto& tn : thread_names) {
+        separator() << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tn.first
+                    << ", \"args\": {\"name\": \"" << tn.second << "\"}}";
+    }
+
+    // microseconds with nanosecond resolution
+    os << std::fixed << std::setprecision(3);
+    for (const TraceEvent& e : events) {
+        separator() << "{\"name\": \"" << e.name << "\", \"cat\": \"" << e.category
+                    << "\", \"ph\": \"X\", \"ts\": " << 1e-3 * e.start
+                    << ", \"dur\": " << 1e-3 * e.duration
+                    << ", \"pid\": 1, \"tid\": " << e.tid << "}";
+    }
+    os << std::defaultfloat;
+    os << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+
+//=============================================================================
+
+
+Tracer& Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+int64_t Tracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+Tracer::ThreadBuffer& Tracer::buffer()
+{
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffers_.emplace_back(new ThreadBuffer);
+        buffer = buffers_.back().get();
+        buffer->entries.reset(new Entry[EVENTS_PER_THREAD]);
+        buffer->tid = (int)buffers_.size();
+        buffer->name = "thread " + std::to_string(buffer->tid);
+    }
+    return *buffer;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Tracer::record(const char* name, int64_t start, int64_t end)
+{
+    ThreadBuffer& b = buffer();
+    uint64_t head = b.head.load(std::memory_order_relaxed);
+    // a reader that sees any of the stores below also sees head (the
+    // fence pairs with the one in collect())
+    std::atomic_thread_fence(std::memory_order_release);
+    Entry& e = b.entries[head % EVENTS_PER_THREAD];
+    e.name .store(name,  std::memory_order_relaxed);
+    e.start.store(start, std::memory_order_relaxed);
+    e.end  .store(end,   std::memory_order_relaxed);
+    b.head.store(head + 1, std::memory_order_release);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Tracer::set_thread_name(const std::string& name)
+{
+    ThreadBuffer& b = buffer();
+    std::lock_guard<std::mutex> lock(mutex_);
+    b.name = name;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Tracer::collect(int64_t since, std::vector<TraceEvent>& events,
+                     std::vector<std::pair<int, std::string>>& thread_names)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& b : buffers_) {
+        thread_names.emplace_back(b->tid, b->name);
+
+        uint64_t head = b->head.load(std::memory_order_acquire);
+        uint64_t begin = head > EVENTS_PER_THREAD ? head - EVENTS_PER_THREAD : 0;
+        size_t first = events.size();
+        for (uint64_t i = begin; i < head; ++i) {
+            const Entry& e = b->entries[i % EVENTS_PER_THREAD];
+            const int64_t start = e.start.load(std::memory_order_relaxed);
+            events.push_back({ e.name.load(std::memory_order_relaxed), "cpu", start,
+                               e.end.load(std::memory_order_relaxed) - start, b->tid });
+        }
+
+        // The owning thread may have overwritten the oldest entries
+        // meanwhile: with head at after, entries before after have been
+        // replaced and the one at after (entry after - EVENTS_PER_THREAD)
+        // may be half written, so entries up to that one are dropped.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = b->head.load(std::memory_order_relaxed);
+        if (after + 1 > begin + EVENTS_PER_THREAD) {
+            size_t lost = std::min<uint64_t>(after + 1 - EVENTS_PER_THREAD - begin, head - begin);
+            events.erase(events.begin() + first, events.begin() + first + lost);
+        }
+
+        events.erase(std::remove_if(events.begin() + first, events.end(),
+                                    [since](const TraceEvent& e) { return e.start + e.duration < since; }),
+                     events.end());
+    }
+}
+
+
+//=============================================================================
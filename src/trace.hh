@@ -0,0 +1,133 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+//=============================================================================
+
+
+/// A complete event of a trace: a named interval on some thread (or on the
+/// GPU). Times are nanoseconds of std::chrono::steady_clock.
+struct TraceEvent
+{
+    const char* name;
+    const char* category;
+    int64_t start;
+    int64_t duration;
+    int tid;
+};
+
+/// Write events as Chrome trace_event JSON, which chrome://tracing and
+/// ui.perfetto.dev load. thread_names labels the tids.
+void write_chrome_trace(std::ostream& os, const std::vector<TraceEvent>& events,
+                        const std::vector<std::pair<int, std::string>>& thread_names);
+
+
+//=============================================================================
+
+
+/// Recorder of the CPU trace markers (see TRACE_SCOPE). Every thread writes
+/// the scopes it closes into its own ring buffer, without locks; the newest
+/// EVENTS_PER_THREAD events of every thread can be collected at any time.
+class Tracer
+{
+public:
+
+    /// events kept per thread
+    static const size_t EVENTS_PER_THREAD = 1 << 16;
+
+    /// the tracer of the whole application
+    static Tracer& instance();
+
+    /// current steady clock time in nanoseconds
+    static int64_t now();
+
+    /// record the scope [start, end) of the calling thread; the name has to
+    /// be a string literal (it is stored as pointer)
+    void record(const char* name, int64_t start, int64_t end);
+
+    /// name the calling thread in traces
+    void set_thread_name(const std::string& name);
+
+    /// Append the events of all threads that ended at or after time since to
+    /// events, and the names of the threads to thread_names. Events that are
+    /// overwritten while they are copied are dropped.
+    void collect(int64_t since, std::vector<TraceEvent>& events,
+                 std::vector<std::pair<int, std::string>>& thread_names);
+
+    /// scope guard that records the time between its construction and destruction
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name) : name_(name), start_(now()) {}
+        ~Scope() { Tracer::instance().record(name_, start_, now()); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        const char* name_;
+        int64_t start_;
+    };
+
+private:
+
+    Tracer() = default;
+
+    /// An event in a ring buffer. The fields are relaxed atomics, read by
+    /// collect() while the owning thread may overwrite them: the ring works
+    /// like a seqlock, whose head tells the reader afterwards which entries
+    /// may have changed underneath it.
+    struct Entry {
+        std::atomic<const char*> name{nullptr};
+        std::atomic<int64_t> start{0}, end{0};
+    };
+
+    /// ring buffer of one thread, written only by that thread
+    struct ThreadBuffer {
+        std::unique_ptr<Entry[]> entries;
+        /// number of events ever written
+        std::atomic<uint64_t> head{0};
+        std::string name;
+        int tid;
+    };
+
+    /// buffer of the calling thread (created on first use)
+    ThreadBuffer& buffer();
+
+private:
+
+    /// buffers of all threads that ever traced; they outlive their threads
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    /// protects buffers_ and the thread names
+    std::mutex mutex_;
+};
+
+
+//=============================================================================
+
+
+/// TRACE_SCOPE("name") records the enclosing block in the CPU trace. Without
+/// SOLAR_ENABLE_TRACE it compiles to nothing.
+#ifdef SOLAR_ENABLE_TRACE
+#  define TRACE_CONCAT_(a, b) a##b
+#  define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#  define TRACE_SCOPE(name) Tracer::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#  define TRACE_SCOPE(name) ((void)0)
+#endif
+
+
+//=============================================================================
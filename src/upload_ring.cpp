@@ -0,0 +1,120 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "upload_ring.hh"
+#include <cassert>
+
+//=============================================================================
+
+
+UploadRing::~UploadRing()
+{
+    for (auto& slot : slots_) {
+        if (slot.fence) glDeleteSync(slot.fence);
+        if (slot.data) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glDeleteBuffers(1, &slot.buffer);
+    }
+    if (!slots_.empty()) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void UploadRing::initialize(unsigned int slots, size_t slot_bytes)
+{
+    assert(slots_.empty() && slots > 0);
+    slot_bytes_ = slot_bytes;
+    persistent_ = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+
+    slots_.resize(slots);
+    for (auto& slot : slots_) {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        if (persistent_) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slot_bytes_, NULL, flags);
+            slot.data = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slot_bytes_, flags);
+        }
+        else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, slot_bytes_, NULL, GL_STREAM_DRAW);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+int UploadRing::acquire()
+{
+    for (unsigned int i = 0; i < slots_.size(); ++i) {
+        const unsigned int s = (next_ + i) % slots_.size();
+        Slot& slot = slots_[s];
+        if (slot.acquired) continue;
+
+        // still read by the GPU?
+        if (slot.fence) {
+            GLenum status = glClientWaitSync(slot.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+        }
+
+        if (!persistent_) {
+            // the fence has passed, no need for the driver to synchronize
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+            slot.data = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slot_bytes_,
+                                                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+                                                   GL_MAP_UNSYNCHRONIZED_BIT);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (!slot.data) continue;
+        }
+
+        slot.acquired = true;
+        next_ = (s + 1) % slots_.size();
+        return int(s);
+    }
+    return -1;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void UploadRing::bind(int slot)
+{
+    Slot& s = slots_[slot];
+    assert(s.acquired);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+    if (!persistent_) {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        s.data = nullptr;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void UploadRing::release(int slot)
+{
+    Slot& s = slots_[slot];
+    assert(s.acquired);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    s.acquired = false;
+}
+
+
+//=============================================================================
@@ -0,0 +1,82 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "gl.hh"
+#include <cstdint>
+#include <vector>
+
+//=============================================================================
+
+
+/// Ring of pixel unpack buffers (PBOs) for streaming texture data to the GPU
+/// without a synchronous copy of client memory inside the driver. A slot is
+/// mapped while the CPU fills it, persistently if ARB_buffer_storage is
+/// available and otherwise with glMapBufferRange from acquire() to bind().
+/// After the upload commands that read a slot it gets a fence, and it is
+/// handed out again only once the GPU has passed that fence, so neither side
+/// ever waits for the other.
+class UploadRing
+{
+public:
+
+    UploadRing() {}
+    ~UploadRing();
+
+    UploadRing(const UploadRing&) = delete;
+    UploadRing& operator=(const UploadRing&) = delete;
+
+    /// create the buffers (GL thread)
+    /// \param slots number of buffers
+    /// \param slot_bytes size of each buffer
+    void initialize(unsigned int slots, size_t slot_bytes);
+
+    /// whether initialize() was called
+    bool initialized() const { return !slots_.empty(); }
+
+    /// size of each buffer
+    size_t slot_bytes() const { return slot_bytes_; }
+
+    /// whether the buffers stay mapped all the time
+    bool persistent() const { return persistent_; }
+
+    /// Map a free slot for writing and return its index, or -1 if all slots
+    /// are being filled or still read by the GPU. Never blocks (GL thread).
+    int acquire();
+
+    /// Mapped memory of an acquired slot. It may be written from any thread
+    /// until the slot is bound.
+    uint8_t* data(int slot) const { return slots_[slot].data; }
+
+    /// Bind an acquired and filled slot as GL_PIXEL_UNPACK_BUFFER, so that
+    /// the pixel arguments of the following upload commands are offsets into
+    /// it (GL thread).
+    void bind(int slot);
+
+    /// Unbind the slot after its upload commands and fence it (GL thread).
+    void release(int slot);
+
+private:
+
+    struct Slot {
+        GLuint buffer = 0;
+        uint8_t* data = nullptr;
+        GLsync fence = 0;
+        bool acquired = false;
+    };
+
+    std::vector<Slot> slots_;
+    size_t slot_bytes_ = 0;
+    bool persistent_ = false;
+    /// where acquire() starts looking, so that slots are used round-robin
+    unsigned int next_ = 0;
+};
+
+
+//=============================================================================
@@ -0,0 +1,341 @@
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "virtual_texture.hh"
+#include "texture_loader.hh"
+#include "trace.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+//=============================================================================
+
+
+VirtualTexture::~VirtualTexture()
+{
+    for (unsigned int i = 0; i < READBACKS; ++i)
+        if (readback_fence_[i]) glDeleteSync(readback_fence_[i]);
+    if (readback_[0]) glDeleteBuffers(READBACKS, readback_);
+    if (fbo_)       glDeleteFramebuffers(1, &fbo_);
+    if (fbo_color_) glDeleteRenderbuffers(1, &fbo_color_);
+    if (fbo_depth_) glDeleteRenderbuffers(1, &fbo_depth_);
+    if (cache_)     glDeleteTextures(1, &cache_);
+    if (table_)     glDeleteTextures(1, &table_);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool VirtualTexture::open(const std::string& filename, unsigned int cache_pages)
+{
+    assert(!ready());
+    if (!file_.open(filename)) return false;
+
+    // the page table is a mip chain of RGBA8 texels: at most 256 pages (and
+    // cache slots) per side, and page grids that halve from level to level
+    format_  = TextureLoader::gl_format(file_.format());
+    pages_x_ = baked_pages(file_.width());
+    pages_y_ = baked_pages(file_.height());
+    levels_  = file_.levels();
+    bool ok = (file_.flags() & BAKED_PAGED) && format_ != 0
+           && pages_x_ <= 256 && pages_y_ <= 256 && cache_pages >= 2 && cache_pages <= 256;
+    size_t pages = 0;
+    for (unsigned int l = 0; ok && l < levels_; ++l) {
+        level_offset_.push_back(pages);
+        pages += size_t(pages_x(l)) * pages_y(l);
+        ok = baked_pages(file_.width(l)) == pages_x(l) && baked_pages(file_.height(l)) == pages_y(l)
+          && file_.level_size(l) >= size_t(pages_x(l)) * pages_y(l) * baked_page_bytes(file_.format());
+    }
+    ok = ok && pages_x(levels_ - 1) == 1 && pages_y(levels_ - 1) == 1;
+    if (!ok) {
+        std::cerr << "VirtualTexture: " << filename << " is not a paged texture" << std::endl;
+        file_.close();
+        level_offset_.clear();
+        return false;
+    }
+
+    slot_of_page_.assign(pages, -1);
+    used_.assign(pages, 0);
+    table_entries_.assign(pages * 4, 0);
+    missing_.reserve(pages);
+    cache_pages_ = cache_pages;
+    page_of_slot_.assign(size_t(cache_pages) * cache_pages, -1);
+
+    // page cache, filtered within the pages (their borders hold the neighbors)
+    const GLsizei side = cache_pages * BAKED_PAGE_STRIDE;
+    glGenTextures(1, &cache_);
+    glBindTexture(GL_TEXTURE_2D, cache_);
+    if (baked_block_size(file_.format()) > 1) {
+        GLsizei size = GLsizei(page_of_slot_.size() * baked_page_bytes(file_.format()));
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, format_, side, side, 0, size, NULL);
+    }
+    else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, side, side, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    // page table, read with texelFetch
+    glGenTextures(1, &table_);
+    glBindTexture(GL_TEXTURE_2D, table_);
+    for (unsigned int l = 0; l < levels_; ++l)
+        glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, pages_x(l), pages_y(l), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels_ - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // the coarsest level is the fallback for everything else
+    load_page(level_offset_[levels_ - 1], 0);
+    pinned_ = 1;
+    update_table();
+
+    glGenBuffers(READBACKS, readback_);
+    glGenFramebuffers(1, &fbo_);
+    glGenRenderbuffers(1, &fbo_color_);
+    glGenRenderbuffers(1, &fbo_depth_);
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+size_t VirtualTexture::cache_bytes() const
+{
+    return page_of_slot_.size() * (ready() ? baked_page_bytes(file_.format()) : 0);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void VirtualTexture::bind(Shader& shader, int cache_unit, int table_unit)
+{
+    assert(ready());
+    glActiveTexture(GL_TEXTURE0 + cache_unit);
+    glBindTexture(GL_TEXTURE_2D, cache_);
+    glActiveTexture(GL_TEXTURE0 + table_unit);
+    glBindTexture(GL_TEXTURE_2D, table_);
+
+    shader.set_uniform("vt_cache", cache_unit);
+    shader.set_uniform("vt_table", table_unit);
+    shader.set_uniform("vt_size", vec3(file_.width(), file_.height(), levels_));
+    shader.set_uniform("vt_cache_pages", float(cache_pages_));
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void VirtualTexture::begin_feedback(Shader& shader, int viewport_width, int viewport_height)
+{
+    assert(ready());
+    const int width  = (viewport_width  + FEEDBACK_SCALE - 1) / FEEDBACK_SCALE;
+    const int height = (viewport_height + FEEDBACK_SCALE - 1) / FEEDBACK_SCALE;
+
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &saved_fbo_);
+    glGetIntegerv(GL_VIEWPORT, saved_viewport_);
+
+    if (width != feedback_width_ || height != feedback_height_) {
+        feedback_width_  = width;
+        feedback_height_ = height;
+        glBindRenderbuffer(GL_RENDERBUFFER, fbo_color_);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, fbo_depth_);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, fbo_color_);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,  GL_RENDERBUFFER, fbo_depth_);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    glViewport(0, 0, width, height);
+
+    // alpha 0: no page requested
+    const GLfloat none[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, depth = 1.0f;
+    glClearBufferfv(GL_COLOR, 0, none);
+    glClearBufferfv(GL_DEPTH, 0, &depth);
+
+    shader.set_uniform("vt_size", vec3(file_.width(), file_.height(), levels_));
+    shader.set_uniform("vt_lod_bias", -std::log2(float(FEEDBACK_SCALE)));
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void VirtualTexture::end_feedback()
+{
+    // read into the next buffer; if update() has not taken its previous
+    // image yet, that one is outdated anyway
+    const unsigned int r = next_readback_;
+    next_readback_ = (next_readback_ + 1) % READBACKS;
+    if (readback_fence_[r]) glDeleteSync(readback_fence_[r]);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_[r]);
+    if (readback_size_[r][0] != feedback_width_ || readback_size_[r][1] != feedback_height_) {
+        readback_size_[r][0] = feedback_width_;
+        readback_size_[r][1] = feedback_height_;
+        glBufferData(GL_PIXEL_PACK_BUFFER, feedback_width_ * feedback_height_ * 4, NULL, GL_STREAM_READ);
+    }
+    glReadPixels(0, 0, feedback_width_, feedback_height_, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    readback_fence_[r] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, saved_fbo_);
+    glViewport(saved_viewport_[0], saved_viewport_[1], saved_viewport_[2], saved_viewport_[3]);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void VirtualTexture::update(unsigned int max_pages)
+{
+    if (!ready()) return;
+    TRACE_SCOPE("VirtualTexture::update");
+
+    // the newest feedback the GPU has written; older ones are dropped
+    int newest = -1;
+    for (unsigned int i = 1; i <= READBACKS; ++i) {
+        const unsigned int r = (next_readback_ + READBACKS - i) % READBACKS;
+        if (!readback_fence_[r]) continue;
+        if (newest < 0) {
+            GLenum status = glClientWaitSync(readback_fence_[r], 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+            newest = r;
+        }
+        glDeleteSync(readback_fence_[r]);
+        readback_fence_[r] = 0;
+    }
+
+    if (newest >= 0) {
+        // pages used by the pixels, and the coarser pages covering them
+        // (the fallbacks while a page is missing); each is marked once
+        ++frame_;
+        missing_.clear();
+        const size_t bytes = size_t(readback_size_[newest][0]) * readback_size_[newest][1] * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_[newest]);
+        const uint8_t* pixels = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+        for (size_t i = 0; pixels && i < bytes; i += 4) {
+            const uint8_t* p = pixels + i;
+            if (p[3] == 0) continue;
+            unsigned x = p[0], y = p[1], level = p[2];
+            if (level >= levels_ || x >= pages_x(level) || y >= pages_y(level)) continue;
+            for (; level < levels_; ++level, x /= 2, y /= 2) {
+                const size_t page = page_index(level, x, y);
+                if (used_[page] == frame_) break;
+                used_[page] = frame_;
+                if (slot_of_page_[page] < 0) missing_.push_back(page);
+            }
+        }
+        if (pixels) glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // coarse levels first: later levels come first in the page order
+        std::sort(missing_.begin(), missing_.end(), std::greater<size_t>());
+    }
+
+    // stream missing pages into free slots or those of the least recently
+    // used pages, but never evict a page the newest feedback needs
+    size_t loaded = 0;
+    while (loaded < max_pages && loaded < missing_.size()) {
+        unsigned int slot = pinned_;
+        for (unsigned int s = pinned_; s < page_of_slot_.size(); ++s) {
+            if (page_of_slot_[s] < 0) { slot = s; break; }
+            if (used_[page_of_slot_[s]] < used_[page_of_slot_[slot]]) slot = s;
+        }
+        if (page_of_slot_[slot] >= 0) {
+            if (used_[page_of_slot_[slot]] == frame_) break;
+            slot_of_page_[page_of_slot_[slot]] = -1;
+            --resident_;
+        }
+        load_page(missing_[loaded++], slot);
+    }
+    missing_.erase(missing_.begin(), missing_.begin() + loaded);
+
+    if (table_dirty_) update_table();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void VirtualTexture::load_page(size_t page, unsigned int slot)
+{
+    const unsigned level = unsigned(std::upper_bound(level_offset_.begin(), level_offset_.end(), page)
+                                    - level_offset_.begin()) - 1;
+    const size_t page_bytes = baked_page_bytes(file_.format());
+    const uint8_t* data = file_.level(level) + (page - level_offset_[level]) * page_bytes;
+    const GLint x = (slot % cache_pages_) * BAKED_PAGE_STRIDE, y = (slot / cache_pages_) * BAKED_PAGE_STRIDE;
+
+    // straight from the mapped file
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, cache_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (baked_block_size(file_.format()) > 1)
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, BAKED_PAGE_STRIDE, BAKED_PAGE_STRIDE, format_, page_bytes, data);
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, BAKED_PAGE_STRIDE, BAKED_PAGE_STRIDE, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    slot_of_page_[page] = slot;
+    page_of_slot_[slot] = page;
+    ++resident_;
+    ++page_loads_;
+    table_dirty_ = true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void VirtualTexture::update_table()
+{
+    // coarse to fine: a missing page inherits the entry of its parent
+    for (unsigned int l = levels_; l-- > 0; ) {
+        for (unsigned int y = 0; y < pages_y(l); ++y) {
+            for (unsigned int x = 0; x < pages_x(l); ++x) {
+                const size_t page = page_index(l, x, y);
+                uint8_t* entry = &table_entries_[page * 4];
+                const int slot = slot_of_page_[page];
+                if (slot >= 0) {
+                    entry[0] = uint8_t(slot % cache_pages_);
+                    entry[1] = uint8_t(slot / cache_pages_);
+                    entry[2] = uint8_t(l);
+                    entry[3] = 255;
+                }
+                else {
+                    assert(l + 1 < levels_);
+                    std::memcpy(entry, &table_entries_[page_index(l + 1, x / 2, y / 2) * 4], 4);
+                }
+            }
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, table_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int l = 0; l < levels_; ++l)
+        glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, pages_x(l), pages_y(l), GL_RGBA, GL_UNSIGNED_BYTE,
+                        &table_entries_[level_offset_[l] * 4]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    table_dirty_ = false;
+}
+
+
+//=============================================================================
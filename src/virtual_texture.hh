@@ -0,0 +1,143 @@
+#pragma once
+//=============================================================================
+//
+//   Exercise code for the lecture "Introduction to Computer Graphics"
+//     by Prof. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) by Computer Graphics Group, Bielefeld University
+//
+//=============================================================================
+
+#include "gl.hh"
+#include "baked_texture.hh"
+#include "shader.hh"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//=============================================================================
+
+
+/// Virtual texture: a paged baked texture (texture_baker --paged) of which
+/// only the visible pages are on the GPU. A feedback pass renders the
+/// objects using it at a fraction of the resolution and records for every
+/// pixel the page and mip level it samples. That image is read back
+/// asynchronously, and update() streams the missing pages from the memory
+/// mapped file into a page cache texture of a fixed number of slots,
+/// evicting the least recently used pages. A page table (a mip chain with a
+/// texel per page) maps every page to its cache slot, or to the slot of the
+/// finest resident coarser page covering it, so that sampling always finds
+/// data; the coarsest level stays resident. The GPU memory is that of the
+/// cache, however large the texture is.
+///
+/// Shaders sample it with the vt_sample() function of earth.frag, which
+/// expects the uniforms set by bind().
+class VirtualTexture
+{
+public:
+
+    VirtualTexture() {}
+    ~VirtualTexture();
+
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    /// Map a paged baked texture and create the page cache of cache_pages^2
+    /// slots and the page table (GL thread); false if the file is missing
+    /// or not a paged texture the GL can sample.
+    bool open(const std::string& filename, unsigned int cache_pages = 16);
+
+    /// whether open() succeeded
+    bool ready() const { return cache_ != 0; }
+
+    /// Bind the page cache and the page table to the given texture units and
+    /// set the vt_ uniforms of the (used) shader.
+    void bind(Shader& shader, int cache_unit, int table_unit);
+
+    /// Render the feedback pass between these calls with vt_feedback.frag:
+    /// begin_feedback() binds the feedback framebuffer (a fraction of the
+    /// viewport) and sets the vt_ uniforms of the (used) shader, end_feedback()
+    /// starts the readback and restores the framebuffer and viewport.
+    void begin_feedback(Shader& shader, int viewport_width, int viewport_height);
+    void end_feedback();
+
+    /// Process the newest feedback that has arrived, if any, and load up to
+    /// max_pages missing pages, coarse levels first (GL thread). Never waits
+    /// for the GPU.
+    void update(unsigned int max_pages);
+
+    /// pages in the cache and pages loaded since open()
+    unsigned int resident_pages() const { return resident_; }
+    size_t page_loads() const { return page_loads_; }
+
+    /// GPU memory of the page cache
+    size_t cache_bytes() const;
+
+private:
+
+    /// index of a page in the per-page arrays, and the page grid of a level
+    size_t page_index(unsigned level, unsigned x, unsigned y) const
+    {
+        return level_offset_[level] + size_t(y) * pages_x(level) + x;
+    }
+    unsigned pages_x(unsigned level) const { return std::max(1u, pages_x_ >> level); }
+    unsigned pages_y(unsigned level) const { return std::max(1u, pages_y_ >> level); }
+
+    /// copy a page into a cache slot
+    void load_page(size_t page, unsigned int slot);
+
+    /// rewrite and upload the page table
+    void update_table();
+
+    /// downscaling of the feedback pass
+    static const int FEEDBACK_SCALE = 8;
+    /// feedback images in flight
+    static const unsigned int READBACKS = 3;
+
+private:
+
+    /// the paged texture
+    BakedTexture file_;
+    GLenum format_ = 0;
+    unsigned pages_x_ = 0, pages_y_ = 0, levels_ = 0;
+    /// for every level the index of its first page in the per-page arrays
+    std::vector<size_t> level_offset_;
+
+    /// cache texture, its slots per side, and the page table texture
+    GLuint cache_ = 0, table_ = 0;
+    unsigned int cache_pages_ = 0;
+
+    /// per page: its cache slot (or -1) and the feedback that last used it
+    std::vector<int> slot_of_page_;
+    std::vector<uint32_t> used_;
+    /// per slot: the page in it (or -1); the first pinned_ slots hold the
+    /// coarsest level and are never evicted
+    std::vector<int64_t> page_of_slot_;
+    unsigned int pinned_ = 0;
+    /// page table entries (RGBA: slot x, slot y, level, 255) of all levels
+    std::vector<uint8_t> table_entries_;
+    bool table_dirty_ = false;
+
+    /// pages requested by the last feedback, not resident
+    std::vector<size_t> missing_;
+
+    /// feedback framebuffer, its size and the readback buffers with their fences
+    GLuint fbo_ = 0, fbo_color_ = 0, fbo_depth_ = 0;
+    int feedback_width_ = 0, feedback_height_ = 0;
+    GLuint readback_[READBACKS] = {};
+    GLsync readback_fence_[READBACKS] = {};
+    int readback_size_[READBACKS][2] = {};
+    unsigned int next_readback_ = 0;
+    /// framebuffer and viewport to restore after the feedback pass
+    GLint saved_fbo_ = 0;
+    GLint saved_viewport_[4] = {};
+
+    /// feedback images processed
+    uint32_t frame_ = 0;
+    unsigned int resident_ = 0;
+    size_t page_loads_ = 0;
+};
+
+
+//=============================================================================